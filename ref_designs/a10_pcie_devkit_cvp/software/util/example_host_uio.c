@@ -75,6 +75,8 @@
 #include <sys/ioctl.h>
 
 #include "fpga-ioctl.h"
+#include "gol_verify.h"
+#include "pr_poll.h"
 
 #define PR_PERSONA_ID 0x00
 #define PR_CONTROL_REGISTER 0x10
@@ -165,6 +167,35 @@ static void reset_pr_logic(uint32_t verbose, int fd)
 
 }
 
+/*
+ * The busy registers of the personas are waited on with pr_poll_wait(),
+ * with one pr_poll per persona so each learns its own latency.
+ */
+static struct pr_poll ddr4_poll;
+static struct pr_poll gol_poll;
+
+struct pr_busy_register {
+	int fd;
+	uint32_t offset;
+};
+
+static int pr_busy_register_read(void *arg)
+{
+	struct pr_busy_register *reg = arg;
+
+	return read_pr(reg->fd, reg->offset) != 0;
+}
+
+static void wait_pr_busy_register(struct pr_poll *poll, uint64_t started_ns, uint32_t offset, int fd)
+{
+	struct pr_busy_register reg = { fd, offset };
+
+	if (pr_poll_wait(poll, started_ns, pr_busy_register_read, &reg)) {
+		printf("Timed out waiting for register 0x%x to clear\n", offset);
+		exit(EXIT_FAILURE);
+	}
+}
+
 #define PR_OPERAND HOST_PR_REGISTER_0
 #define PR_INCR HOST_PR_REGISTER_1
 #define PR_RESULT PR_HOST_REGISTER_0
@@ -284,13 +315,13 @@ static int do_basic_dsp_persona(uint32_t number_of_runs, uint32_t verbose, int f
 #define DDR4_BUSY_REGISTER PR_HOST_REGISTER_1
 #define DDR4_START_MASK 2
 #define DDR4_LOAD_SEED_MASK 1
-#define DDR4_ADDRESS_MAX 1 << 25
+#define DDR4_ADDRESS_MAX (1 << 25)
 #define DDR4_CAL_MASK 3
 #define DDR4_CAL_OFFSET 0x10010
 static int run_ddr4_address_sweep(uint32_t base_address, uint32_t final_offset, uint32_t calibration, uint32_t verbose, int fd)
 {
 	uint32_t data = 0;
-	uint32_t busy = 0;
+	uint64_t started_ns;
 	
 	data = base_address;
 	write_pr(fd, DDR4_MEM_ADDRESS, data);
@@ -301,15 +332,150 @@ static int run_ddr4_address_sweep(uint32_t base_address, uint32_t final_offset,
 	data = 0 | (0 << DDR4_START_MASK) | (calibration << DDR4_CAL_MASK);
 	write_pr(fd, PR_CONTROL_REGISTER, data);	
 
-	do {
-		data = 0;
-		data = read_pr(fd, DDR4_BUSY_REGISTER);
-		busy = data;
-	} while(busy);
+	started_ns = pr_poll_now_ns();
+	wait_pr_busy_register(&ddr4_poll, started_ns, DDR4_BUSY_REGISTER, fd);
 
 	return 0;	
 }
-static int do_ddr4_access_persona (uint32_t seed, uint32_t number_of_runs, uint32_t verbose, int fd)
+/*
+ * The persona writes a 512 bit word to every address from DDR4_MEM_ADDRESS
+ * to DDR4_MEM_ADDRESS + DDR4_FINAL_OFFSET in turn, reads it back, and counts
+ * the words that match in PERFORMANCE_COUNTER.  The counter is only cleared
+ * by the logic reset, so it adds up over the sweeps of a benchmark run.
+ * Sequential runs are one sweep over the whole size; strided and random
+ * runs cover the same size in DDR4_BENCH_CHUNK word sweeps, spread evenly
+ * over the memory or at random chunk aligned addresses.
+ */
+#define DDR4_WORD_BYTES 64
+#define DDR4_BENCH_CHUNK 256
+#define DDR4_BENCH_MIN_SIZE (1 << 9)
+#define DDR4_BENCH_SIZE_STEP 2
+
+enum ddr4_pattern {
+	DDR4_SEQUENTIAL,
+	DDR4_STRIDED,
+	DDR4_RANDOM,
+	DDR4_ALL_PATTERNS
+};
+
+static const char * const ddr4_pattern_names[] = {
+	[DDR4_SEQUENTIAL] = "seq",
+	[DDR4_STRIDED] = "stride",
+	[DDR4_RANDOM] = "random",
+	[DDR4_ALL_PATTERNS] = "all",
+};
+
+static int parse_ddr4_pattern(const char *name)
+{
+	int i;
+
+	for (i = 0; i <= DDR4_ALL_PATTERNS; i++)
+		if (!strcmp(name, ddr4_pattern_names[i]))
+			return i;
+
+	return -1;
+}
+
+static void print_ddr4_size(uint64_t bytes)
+{
+	if (bytes >= (1ull << 30))
+		printf("%7ju GiB", (uintmax_t)(bytes >> 30));
+	else if (bytes >= (1ull << 20))
+		printf("%7ju MiB", (uintmax_t)(bytes >> 20));
+	else
+		printf("%7ju KiB", (uintmax_t)(bytes >> 10));
+}
+
+/* One line of the table; returns the number of words that failed */
+static uint64_t run_ddr4_bench_row(int pattern, uint32_t size, uint32_t calibration, uint32_t seed, uint32_t number_of_runs, uint32_t verbose, int fd)
+{
+	uint32_t length = (pattern == DDR4_SEQUENTIAL || size < DDR4_BENCH_CHUNK) ? size : DDR4_BENCH_CHUNK;
+	uint32_t sweeps = size / length;
+	uint32_t stride = DDR4_ADDRESS_MAX / sweeps;
+	struct timespec begin;
+	struct timespec end;
+	uint64_t words = 0;
+	uint64_t passes = 0;
+	double seconds = 0.0;
+	uint32_t base_address;
+	uint32_t data;
+	uint32_t run;
+	uint32_t i;
+
+	/*
+	 * The sweeps of a row all take about as long as each other; a poller
+	 * that learnt the latency of another row would sleep through part of
+	 * these inside the timed loop.
+	 */
+	pr_poll_init(&ddr4_poll);
+
+	for (run = 0; run < number_of_runs; run++) {
+		reset_pr_logic(verbose, fd);
+		write_pr(fd, DDR4_SEED_ADDRESS, seed);
+		write_pr(fd, PR_CONTROL_REGISTER, (1 << DDR4_LOAD_SEED_MASK));
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for (i = 0; i < sweeps; i++) {
+			if (pattern == DDR4_STRIDED)
+				base_address = i * stride;
+			else if (pattern == DDR4_RANDOM)
+				base_address = (rand() % (DDR4_ADDRESS_MAX / length)) * length;
+			else
+				base_address = i * length;
+			run_ddr4_address_sweep(base_address, length - 1, calibration, verbose, fd);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		data = read_pr(fd, PERFORMANCE_COUNTER);
+		seconds += (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+		words += (uint64_t)sweeps * length;
+		passes += data;
+		VERBOSE_MESSAGE(verbose, "\t%s run %u: %u of %u words passed\n", ddr4_pattern_names[pattern], run, data, sweeps * length);
+	}
+
+	/* every word that passed was written once and read once */
+	printf("%-8s", ddr4_pattern_names[pattern]);
+	print_ddr4_size((uint64_t)size * DDR4_WORD_BYTES);
+	printf(" %8u %11.3f %10.2f %9.3f %s\n", sweeps,
+	       seconds * 1000.0 / number_of_runs,
+	       seconds * 1000000.0 / ((double)sweeps * number_of_runs),
+	       (double)passes * DDR4_WORD_BYTES * 2 / seconds / 1000000000.0,
+	       passes == words ? "PASS" : "FAIL");
+
+	if (verbose)
+		pr_poll_print(&ddr4_poll, "DDR4 busy");
+
+	return words - passes;
+}
+
+static int do_ddr4_bench(int pattern, uint32_t calibration, uint32_t seed, uint32_t number_of_runs, uint32_t verbose, int fd)
+{
+	uint64_t failed = 0;
+	uint32_t size;
+	int p;
+
+	printf("DDR4 bandwidth, %u runs per line, GB/s counts words written and read back\n", number_of_runs);
+	printf("%-8s %11s %8s %11s %10s %9s %s\n", "pattern", "size", "sweeps", "ms/run", "us/sweep", "GB/s", "result");
+
+	for (p = 0; p < DDR4_ALL_PATTERNS; p++) {
+		if (pattern != DDR4_ALL_PATTERNS && pattern != p)
+			continue;
+		for (size = DDR4_BENCH_MIN_SIZE; size < DDR4_ADDRESS_MAX; size <<= DDR4_BENCH_SIZE_STEP)
+			failed += run_ddr4_bench_row(p, size, calibration, seed, number_of_runs, verbose, fd);
+		failed += run_ddr4_bench_row(p, DDR4_ADDRESS_MAX, calibration, seed, number_of_runs, verbose, fd);
+	}
+
+	reset_pr_logic(verbose, fd);
+
+	if (failed) {
+		printf("DDR4 benchmark FAILED, %ju words did not read back\n", (uintmax_t)failed);
+		exit(EXIT_FAILURE);
+	}
+	printf("DDR4 Access persona passed\n");
+	return 0;
+}
+
+static int do_ddr4_access_persona (uint32_t seed, uint32_t number_of_runs, int ddr4_pattern, uint32_t verbose, int fd)
 {
 	uint32_t data;
 	uint32_t calibration = 0;
@@ -329,6 +495,9 @@ static int do_ddr4_access_persona (uint32_t seed, uint32_t number_of_runs, uint3
 		calibration = 1;
 
 	VERBOSE_MESSAGE(verbose,"\tDDR4 Calibration Check Successful\n");
+	if (ddr4_pattern >= 0)
+		return do_ddr4_bench(ddr4_pattern, calibration, seed, number_of_runs, verbose, fd);
+
 	VERBOSE_MESSAGE(verbose,"\tDDR4 lfsr Seed 0x%08X Loading\n", seed);
 	VERBOSE_MESSAGE(verbose,"\tDDR4 lfsr Seed 0x%08X Successfully loaded \n", seed);
 	VERBOSE_MESSAGE(verbose,"\tStarting Test cases\n");
@@ -364,11 +533,11 @@ static int do_ddr4_access_persona (uint32_t seed, uint32_t number_of_runs, uint3
 		VERBOSE_MESSAGE(verbose,"\tChecking result for test case %d\n", i);
 		data = 0;
 		data = read_pr(fd, PERFORMANCE_COUNTER);
-		VERBOSE_MESSAGE(verbose,"\tPercent of passing writes = %0.2f%% \n", ((float)data/(float)final_offset) * 100.0);
+		VERBOSE_MESSAGE(verbose,"\tPercent of passing writes = %0.2f%% \n", ((float)data/(float)(final_offset + 1)) * 100.0);
 		printf("Perfromance counter returned %d\n", data);
 
 		if(data != final_offset + 1) {
-			printf("\tDDR4 Access failed %0d of %0d (%0.2f%%) writes\n", final_offset - data, final_offset, ((float)(final_offset - data)/(float)final_offset) * 100.0);
+			printf("\tDDR4 Access failed %0d of %0d (%0.2f%%) writes\n", final_offset + 1 - data, final_offset + 1, ((float)(final_offset + 1 - data)/(float)(final_offset + 1)) * 100.0);
 			exit(EXIT_FAILURE);
 		}
 		printf("Test %d of %d PASS\n", i, number_of_runs);
@@ -384,8 +553,6 @@ static int do_ddr4_access_persona (uint32_t seed, uint32_t number_of_runs, uint3
 #define GOL_TOP_END PR_HOST_REGISTER_1
 #define GOL_BOT_END PR_HOST_REGISTER_2
 #define GOL_START_MASK 1
-#define GOL_ROWS 8
-#define GOL_COLS 8
 static uint32_t getbit(uint64_t value, uint32_t position) 
 {
 	
@@ -417,8 +584,7 @@ static void run_gol_accelerated(uint32_t top_half, uint32_t bottom_half, uint32_
 
 	struct timespec begin;
 	struct timespec end;
-	uint32_t data = 0;
-	uint32_t busy = 0;
+	uint64_t started_ns;
 	
 	printf("Loading GOL data over PCIe, starting timer\n");
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
@@ -429,11 +595,8 @@ static void run_gol_accelerated(uint32_t top_half, uint32_t bottom_half, uint32_
 	write_pr(fd, PR_CONTROL_REGISTER, (1 << GOL_START_MASK));
 	write_pr(fd, PR_CONTROL_REGISTER, (0 << GOL_START_MASK));
 	
-	do {
-		data = 0;
-		data = read_pr(fd, GOL_BUSY_REG);
-		busy = data;
-	} while(busy);
+	started_ns = pr_poll_now_ns();
+	wait_pr_busy_register(&gol_poll, started_ns, GOL_BUSY_REG, fd);
 	
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
 	printf("Accelerated GOL complete\n");
@@ -443,72 +606,16 @@ static void run_gol_accelerated(uint32_t top_half, uint32_t bottom_half, uint32_
 }
 
 
-static void calculate_neighbors(uint64_t current_board, uint32_t *neighbors)
-{
-
-	int i = 0;
-	int j = 0;
-
-	for(i = 0; i < GOL_ROWS; i++){
-		for(j = 0; j < GOL_COLS; j++){
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] = 0;
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j+1) + GOL_ROWS) % GOL_ROWS) + ((((i-1) + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j)   + GOL_ROWS) % GOL_ROWS) + ((((i-1) + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j-1) + GOL_ROWS) % GOL_ROWS) + ((((i-1) + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j+1) + GOL_ROWS) % GOL_ROWS) + ((((i)   + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j-1) + GOL_ROWS) % GOL_ROWS) + ((((i)   + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j+1) + GOL_ROWS) % GOL_ROWS) + ((((i+1) + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j)   + GOL_ROWS) % GOL_ROWS) + ((((i+1) + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-			neighbors[((j + GOL_COLS) % GOL_COLS) + (((i + GOL_ROWS) % GOL_ROWS) * GOL_COLS)] += getbit(current_board, ((((j-1) + GOL_ROWS) % GOL_ROWS) + ((((i+1) + GOL_COLS) % GOL_COLS) * GOL_COLS)));
-		}
-	}
-
-}
-static uint64_t apply_gol_rules(uint64_t current_board, uint32_t *neighbors)
-{
-
-	uint32_t i = 0;
-	uint64_t return_board = 0;
-	for(i = 0; i < (GOL_ROWS * GOL_COLS); i++){
-		if (getbit(current_board,i) == 1){
-			if((neighbors[i] == 2) || ( (neighbors[i] == 3)))
-				return_board = (return_board) | (uint64_t)((uint64_t)1 << (uint64_t)i);
-		}
-		else{
-			if(neighbors[i] == 3)
-				return_board = (return_board) | (uint64_t)((uint64_t)1 << (uint64_t)i);
-		}
-		neighbors[i]=0;
-	}
-	return return_board;
-}
 static uint64_t run_gol_verify(uint64_t board, uint32_t number_of_runs, uint32_t verbose)
 {
-	uint32_t i = 0;
-	uint32_t j = 0;
 	uint64_t current_board = 0;
-	uint64_t next_board = 0;
-	uint32_t *neighbors;
 	struct timespec begin;
 	struct timespec end;
 	printf("Beginning host side GOL for verification, starting timer\n");
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
-	neighbors = (uint32_t*) calloc((GOL_ROWS * GOL_COLS),sizeof(uint32_t));
 
-	current_board = board;
+	current_board = gol_run(board, number_of_runs);
 
-	for(i = 0;i < number_of_runs; i++){
-		for(j = 0; j < 64; j++){
-			if(neighbors[j] != 0)
-			{
-				exit(EXIT_FAILURE);
-			}
-		}
-		calculate_neighbors(current_board, neighbors);
-		next_board = apply_gol_rules(current_board, neighbors);
-		current_board = next_board;
-	}
-	free(neighbors);
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
 
 	printf("Host side GOL execution complete\n");
@@ -516,7 +623,106 @@ static uint64_t run_gol_verify(uint64_t board, uint32_t number_of_runs, uint32_t
 	return current_board;
 }
 
-static int do_gol_persona (uint32_t seed, uint32_t number_of_runs, uint32_t verbose, int fd)
+/*
+ * The persona has a single engine, but it only samples the board when it is
+ * started and holds the result until the next start.  So in batch mode the
+ * next board is written to the input registers while the current one runs,
+ * and starting it costs just the control register toggle once the result
+ * has been read back.  The generation count is written once for the batch.
+ */
+static int do_gol_batch(uint32_t number_of_boards, uint32_t number_of_runs, uint32_t verbose, int fd)
+{
+	struct timespec begin;
+	struct timespec end;
+	uint64_t *boards;
+	uint64_t *results;
+	uint64_t *expected;
+	uint64_t started_ns;
+	uint32_t top_half;
+	uint32_t bottom_half;
+	double seconds;
+	double verify_seconds;
+	uint32_t errors = 0;
+	uint32_t i;
+
+	printf("Running %u GOL boards back to back\n", number_of_boards);
+	boards = malloc(number_of_boards * sizeof(*boards));
+	results = malloc(number_of_boards * sizeof(*results));
+	expected = malloc(number_of_boards * sizeof(*expected));
+	if (!boards || !results || !expected) {
+		printf("failed to allocate %u boards\n", number_of_boards);
+		free(boards);
+		free(results);
+		free(expected);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < number_of_boards; i++) {
+		generate_random_number(&top_half, &bottom_half, 32);
+		boards[i] = ((uint64_t)top_half << 32) | (uint64_t)bottom_half;
+	}
+
+	reset_pr_logic(verbose, fd);
+	write_pr(fd, GOL_COUNTER_LIMIT_ADDRESS, number_of_runs);
+	write_pr(fd, GOL_TOP_HALF, (uint32_t)(boards[0] >> 32));
+	write_pr(fd, GOL_BOT_HALF, (uint32_t)boards[0]);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < number_of_boards; i++) {
+		write_pr(fd, PR_CONTROL_REGISTER, (1 << GOL_START_MASK));
+		write_pr(fd, PR_CONTROL_REGISTER, (0 << GOL_START_MASK));
+		started_ns = pr_poll_now_ns();
+
+		/* board i has been latched, queue the next one behind it */
+		if (i + 1 < number_of_boards) {
+			write_pr(fd, GOL_TOP_HALF, (uint32_t)(boards[i + 1] >> 32));
+			write_pr(fd, GOL_BOT_HALF, (uint32_t)boards[i + 1]);
+		}
+
+		wait_pr_busy_register(&gol_poll, started_ns, GOL_BUSY_REG, fd);
+
+		top_half = read_pr(fd, GOL_TOP_END);
+		bottom_half = read_pr(fd, GOL_BOT_END);
+		results[i] = ((uint64_t)top_half << 32) | (uint64_t)bottom_half;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+
+	memcpy(expected, boards, number_of_boards * sizeof(*expected));
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	gol_run_many(expected, number_of_boards, number_of_runs);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	verify_seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+
+	for (i = 0; i < number_of_boards; i++) {
+		if (results[i] == expected[i])
+			continue;
+		if (errors++ < 4 || verbose == 1)
+			printf("\tboard %u 0x%016jX: expected 0x%016jX received 0x%016jX\n", i,
+			       (uintmax_t)boards[i], (uintmax_t)expected[i], (uintmax_t)results[i]);
+	}
+
+	printf("Accelerated GOL batch complete\n");
+	printf("\t%u boards of %u generations in %0.3f ms, %0.0f boards/s\n",
+	       number_of_boards, number_of_runs, seconds * 1000.0, number_of_boards / seconds);
+	pr_poll_print(&gol_poll, "GOL busy");
+	printf("\thost verification %0.3f ms, %0.0f boards/s\n",
+	       verify_seconds * 1000.0, number_of_boards / verify_seconds);
+
+	free(boards);
+	free(results);
+	free(expected);
+
+	if (errors) {
+		printf("GOL batch FAILED with %u mismatches\n", errors);
+		exit(EXIT_FAILURE);
+	}
+	printf("GOL persona passed\n");
+
+	return 0;
+}
+
+static int do_gol_persona (uint32_t seed, uint32_t number_of_runs, uint32_t number_of_boards, uint32_t verbose, int fd)
 {
 	
 	uint32_t top_half=0;
@@ -526,6 +732,9 @@ static int do_gol_persona (uint32_t seed, uint32_t number_of_runs, uint32_t verb
 	uint64_t accelerated_result=0;
 	uint64_t host_generated_result=0;
 	printf("This is the Game of Life Persona\n");
+	if (number_of_boards > 1)
+		return do_gol_batch(number_of_boards, number_of_runs, verbose, fd);
+
 
 	reset_pr_logic(verbose, fd);
 	generate_random_number(&top_half, &bottom_half, 32);
@@ -567,6 +776,8 @@ static void usage(const char *prog_name)
 	printf("\t<-d,--device> [val]: PCIe id for card (e.g. -d=0000:03:00.0)\n");
 	printf("\t<-s,--seed> [val]:Used for random parameterization\n");
 	printf("\t<-n,--iterations> [val]:Number of times to perform a given personas task\n");
+	printf("\t<-b,--boards> [val]:Number of GOL boards to run back to back (default 1)\n");
+	printf("\t<-p,--pattern> [val]:Run the DDR4 bandwidth benchmark with seq, stride, random or all patterns\n");
 	printf("\t<-v, --verbose> :Verbose information is reported.\n\n");
 	printf("\tMust declare device, other opts are optional\n\n");
 	exit(0);
@@ -578,6 +789,8 @@ int main(int argc, char **argv)
 	int ret;
 	uint32_t seed = 1;
 	uint32_t number_of_runs = 3;
+	uint32_t number_of_boards = 1;
+	int ddr4_pattern = -1;
 	uint32_t verbose = 0;
 	int opt;
 	int fd;
@@ -587,6 +800,8 @@ int main(int argc, char **argv)
 		{"verbose", no_argument, 0, 'v'},
 		{"seed", required_argument, 0, 's'},
 		{"iterations", required_argument, 0, 'n'},
+		{"boards", required_argument, 0, 'b'},
+		{"pattern", required_argument, 0, 'p'},
 		{"help", no_argument, 0, 'h'},
 		{"device", required_argument, 0, 'd'},
 		{0, 0, 0, 0}
@@ -599,7 +814,7 @@ int main(int argc, char **argv)
 		return 2;
 	}
 
-	while((opt = getopt_long(argc, argv, "vd:s:n:h", long_options, NULL)) != -1){
+	while((opt = getopt_long(argc, argv, "vd:s:n:b:p:h", long_options, NULL)) != -1){
 		switch(opt){
 			case 'v':
 				verbose = 1;
@@ -610,6 +825,16 @@ int main(int argc, char **argv)
 			case 'n':
 				number_of_runs = (uint32_t) strtol(optarg, &optarg,10);
 				break;
+			case 'b':
+				number_of_boards = (uint32_t) strtol(optarg, &optarg,10);
+				break;
+			case 'p':
+				ddr4_pattern = parse_ddr4_pattern(optarg);
+				if (ddr4_pattern < 0) {
+					printf("\nUnknown DDR4 pattern %s\n", optarg);
+					usage(argv[0]);
+				}
+				break;
 			case 's':
 				seed = (uint32_t) strtol(optarg, &optarg, 10);
 				break;
@@ -623,6 +848,8 @@ int main(int argc, char **argv)
 	}
 
 	srand(seed);
+	pr_poll_init(&ddr4_poll);
+	pr_poll_init(&gol_poll);
 
 	persona_id = read_pr(fd, PR_PERSONA_ID);
 	if (!persona_id)
@@ -640,15 +867,20 @@ int main(int argc, char **argv)
 		break;
 
 	case 0x000000EF:
-		ret = do_ddr4_access_persona(seed, number_of_runs, verbose, fd);
+		ret = do_ddr4_access_persona(seed, number_of_runs, ddr4_pattern, verbose, fd);
 		break;
 	case 0x00676F6C:
-		ret = do_gol_persona(seed, number_of_runs, verbose, fd);
+		ret = do_gol_persona(seed, number_of_runs, number_of_boards, verbose, fd);
 		break;
 	default:
 		printf("unknown PR ID value 0x%x\n", persona_id);
 		ret = EINVAL;
 	}
+	if (verbose == 1) {
+		pr_poll_print(&ddr4_poll, "DDR4 busy");
+		pr_poll_print(&gol_poll, "GOL busy");
+	}
+
 	close (fd);
 
 	return ret;
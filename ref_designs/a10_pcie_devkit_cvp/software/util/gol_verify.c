@@ -0,0 +1,245 @@
+// Copyright (c) 2001-2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "gol_verify.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GOL_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+/* Cells in the first and last column of every row */
+#define GOL_COL_FIRST 0x0101010101010101ULL
+#define GOL_COL_LAST 0x8080808080808080ULL
+
+static uint32_t getbit(uint64_t value, uint32_t position)
+{
+	return (value >> position) & 1;
+}
+
+static uint32_t calculate_coord(int x, int y)
+{
+	return (uint32_t)(((x + GOL_ROWS) % GOL_ROWS) + (((y + GOL_COLS) % GOL_COLS) * GOL_ROWS));
+}
+
+/*
+ * The original host side implementation, kept as the reference the other
+ * implementations are checked against.
+ */
+uint64_t gol_step_reference(uint64_t board)
+{
+	uint32_t neighbors;
+	uint64_t next = 0;
+	int i, j;
+
+	for(i = 0; i < GOL_ROWS; i++){
+		for(j = 0; j < GOL_COLS; j++){
+			neighbors = 0;
+			neighbors += getbit(board, calculate_coord(i+1,j+1));
+			neighbors += getbit(board, calculate_coord(i+1,j));
+			neighbors += getbit(board, calculate_coord(i+1,j-1));
+			neighbors += getbit(board, calculate_coord(i,j-1));
+			neighbors += getbit(board, calculate_coord(i,j+1));
+			neighbors += getbit(board, calculate_coord(i-1,j+1));
+			neighbors += getbit(board, calculate_coord(i-1,j));
+			neighbors += getbit(board, calculate_coord(i-1,j-1));
+
+			if ((neighbors == 3) ||
+			    ((neighbors == 2) && getbit(board, calculate_coord(i,j))))
+				next |= (uint64_t)1 << calculate_coord(i,j);
+		}
+	}
+
+	return next;
+}
+
+/*
+ * The neighbour planes hold, for every cell, the state of one of its
+ * neighbours.  Horizontal moves wrap within a byte, vertical moves rotate
+ * whole bytes.  The eight planes are then added bit-sliced with full
+ * adders; only the sum modulo 8 is kept, which is enough since 8
+ * neighbours, like 0, leaves the cell dead.
+ */
+#define GOL_ROTL(b, n) (((b) << (n)) | ((b) >> (64 - (n))))
+#define GOL_ROTR(b, n) (((b) >> (n)) | ((b) << (64 - (n))))
+
+uint64_t gol_step(uint64_t b)
+{
+	uint64_t e, w, n, s, ne, nw, se, sw;
+	uint64_t a0, a1, b0, b1, c0, c1, d1, t0, t1;
+	uint64_t s0, s1, s2;
+
+	e = ((b >> 1) & ~GOL_COL_LAST) | ((b << 7) & GOL_COL_LAST);
+	w = ((b << 1) & ~GOL_COL_FIRST) | ((b >> 7) & GOL_COL_FIRST);
+	n = GOL_ROTL(b, 8);
+	s = GOL_ROTR(b, 8);
+	ne = GOL_ROTL(e, 8);
+	nw = GOL_ROTL(w, 8);
+	se = GOL_ROTR(e, 8);
+	sw = GOL_ROTR(w, 8);
+
+	/* three full adders and a half adder give bits of weight 1 and 2 */
+	a0 = n ^ s ^ e;
+	a1 = (n & s) | (e & (n ^ s));
+	b0 = w ^ ne ^ nw;
+	b1 = (w & ne) | (nw & (w ^ ne));
+	c0 = se ^ sw;
+	c1 = se & sw;
+
+	s0 = a0 ^ b0 ^ c0;
+	d1 = (a0 & b0) | (c0 & (a0 ^ b0));
+
+	/* four bits of weight 2 */
+	t0 = a1 ^ b1 ^ c1;
+	t1 = (a1 & b1) | (c1 & (a1 ^ b1));
+	s1 = t0 ^ d1;
+	s2 = t1 ^ (t0 & d1);
+
+	/* 3 neighbours, or 2 and alive */
+	return s1 & ~s2 & (s0 | b);
+}
+
+uint64_t gol_run(uint64_t board, uint32_t generations)
+{
+	uint32_t i;
+
+	for (i = 0; i < generations; i++)
+		board = gol_step(board);
+
+	return board;
+}
+
+void gol_run_many_scalar(uint64_t *boards, size_t count, uint32_t generations)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		boards[i] = gol_run(boards[i], generations);
+}
+
+#ifdef GOL_HAVE_AVX2
+
+int gol_simd_available(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#define GOL_AND(a, b) _mm256_and_si256(a, b)
+#define GOL_OR(a, b) _mm256_or_si256(a, b)
+#define GOL_XOR(a, b) _mm256_xor_si256(a, b)
+/* ~a & b */
+#define GOL_ANDNOT(a, b) _mm256_andnot_si256(a, b)
+#define GOL_VROTL(b, n) GOL_OR(_mm256_slli_epi64(b, n), _mm256_srli_epi64(b, 64 - (n)))
+#define GOL_VROTR(b, n) GOL_OR(_mm256_srli_epi64(b, n), _mm256_slli_epi64(b, 64 - (n)))
+
+/* gol_step() on the four boards in the 64 bit lanes of b */
+__attribute__((target("avx2")))
+static inline __m256i gol_step_avx2(__m256i b, __m256i first, __m256i last)
+{
+	__m256i e, w, n, s, ne, nw, se, sw;
+	__m256i a0, a1, b0, b1, c0, c1, d1, t0, t1;
+	__m256i s0, s1, s2;
+
+	e = GOL_OR(GOL_ANDNOT(last, _mm256_srli_epi64(b, 1)),
+		   GOL_AND(_mm256_slli_epi64(b, 7), last));
+	w = GOL_OR(GOL_ANDNOT(first, _mm256_slli_epi64(b, 1)),
+		   GOL_AND(_mm256_srli_epi64(b, 7), first));
+	n = GOL_VROTL(b, 8);
+	s = GOL_VROTR(b, 8);
+	ne = GOL_VROTL(e, 8);
+	nw = GOL_VROTL(w, 8);
+	se = GOL_VROTR(e, 8);
+	sw = GOL_VROTR(w, 8);
+
+	a0 = GOL_XOR(GOL_XOR(n, s), e);
+	a1 = GOL_OR(GOL_AND(n, s), GOL_AND(e, GOL_XOR(n, s)));
+	b0 = GOL_XOR(GOL_XOR(w, ne), nw);
+	b1 = GOL_OR(GOL_AND(w, ne), GOL_AND(nw, GOL_XOR(w, ne)));
+	c0 = GOL_XOR(se, sw);
+	c1 = GOL_AND(se, sw);
+
+	s0 = GOL_XOR(GOL_XOR(a0, b0), c0);
+	d1 = GOL_OR(GOL_AND(a0, b0), GOL_AND(c0, GOL_XOR(a0, b0)));
+
+	t0 = GOL_XOR(GOL_XOR(a1, b1), c1);
+	t1 = GOL_OR(GOL_AND(a1, b1), GOL_AND(c1, GOL_XOR(a1, b1)));
+	s1 = GOL_XOR(t0, d1);
+	s2 = GOL_XOR(t1, GOL_AND(t0, d1));
+
+	return GOL_ANDNOT(s2, GOL_AND(s1, GOL_OR(s0, b)));
+}
+
+/*
+ * Two registers are stepped together so the dependency chain of one hides
+ * the latency of the other.
+ */
+__attribute__((target("avx2")))
+void gol_run_many_simd(uint64_t *boards, size_t count, uint32_t generations)
+{
+	const __m256i first = _mm256_set1_epi64x(GOL_COL_FIRST);
+	const __m256i last = _mm256_set1_epi64x(GOL_COL_LAST);
+	__m256i v0, v1;
+	size_t i = 0;
+	uint32_t g;
+
+	for (; i + 8 <= count; i += 8) {
+		v0 = _mm256_loadu_si256((const __m256i *)&boards[i]);
+		v1 = _mm256_loadu_si256((const __m256i *)&boards[i + 4]);
+		for (g = 0; g < generations; g++) {
+			v0 = gol_step_avx2(v0, first, last);
+			v1 = gol_step_avx2(v1, first, last);
+		}
+		_mm256_storeu_si256((__m256i *)&boards[i], v0);
+		_mm256_storeu_si256((__m256i *)&boards[i + 4], v1);
+	}
+
+	for (; i + 4 <= count; i += 4) {
+		v0 = _mm256_loadu_si256((const __m256i *)&boards[i]);
+		for (g = 0; g < generations; g++)
+			v0 = gol_step_avx2(v0, first, last);
+		_mm256_storeu_si256((__m256i *)&boards[i], v0);
+	}
+
+	gol_run_many_scalar(boards + i, count - i, generations);
+}
+
+#else
+
+int gol_simd_available(void)
+{
+	return 0;
+}
+
+void gol_run_many_simd(uint64_t *boards, size_t count, uint32_t generations)
+{
+	gol_run_many_scalar(boards, count, generations);
+}
+
+#endif
+
+void gol_run_many(uint64_t *boards, size_t count, uint32_t generations)
+{
+	if (gol_simd_available())
+		gol_run_many_simd(boards, count, generations);
+	else
+		gol_run_many_scalar(boards, count, generations);
+}
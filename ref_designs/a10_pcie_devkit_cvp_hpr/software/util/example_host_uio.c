@@ -38,8 +38,14 @@
 #include <errno.h>
 #include <time.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <sys/mman.h>
 
+#include "gol_verify.h"
+#include "pr_poll.h"
+
 #define PR_PERSONA_ID 0x00
 #define PR_CONTROL_REGISTER 0x10
 #define PR_HOST_REGISTER_0 0x20
@@ -68,7 +74,11 @@
 
 static uint32_t seed;
 static uint32_t number_of_runs;
+static uint32_t number_of_boards;
+static int ddr4_pattern;
 static uint32_t verbose;
+static const char *device_name;
+static const char *shadow_images;
 
 
 struct test_handle {
@@ -293,6 +303,37 @@ static void reset_pr_logic(struct test_handle *th, uint32_t verbose, uint32_t re
 
 }
 
+/*
+ * The busy registers of the personas are waited on with pr_poll_wait(),
+ * with one pr_poll per persona so each learns its own latency.
+ */
+static struct pr_poll ddr4_poll;
+static struct pr_poll gol_poll;
+
+struct pr_busy_register {
+	struct test_handle *th;
+	uint32_t offset;
+};
+
+static int pr_busy_register_read(void *arg)
+{
+	struct pr_busy_register *reg = arg;
+	uint32_t data = 0;
+
+	(*reg->th->read_u32)(reg->th->arg, reg->offset, &data);
+	return data != 0;
+}
+
+static void wait_pr_busy_register(struct test_handle *th, struct pr_poll *poll, uint64_t started_ns, uint32_t offset)
+{
+	struct pr_busy_register reg = { th, offset };
+
+	if (pr_poll_wait(poll, started_ns, pr_busy_register_read, &reg)) {
+		printf("Timed out waiting for register 0x%x to clear\n", offset);
+		exit(EXIT_FAILURE);
+	}
+}
+
 #define PR_OPERAND HOST_PR_REGISTER_0
 #define PR_INCR HOST_PR_REGISTER_1
 #define PR_RESULT PR_HOST_REGISTER_0
@@ -412,13 +453,13 @@ static int do_basic_dsp_persona(struct test_handle *th, uint32_t number_of_runs,
 #define DDR4_BUSY_REGISTER PR_HOST_REGISTER_1
 #define DDR4_START_MASK 2
 #define DDR4_LOAD_SEED_MASK 1
-#define DDR4_ADDRESS_MAX 1 << 25
+#define DDR4_ADDRESS_MAX (1 << 25)
 #define DDR4_CAL_MASK 3
 #define DDR4_CAL_OFFSET 0x10010
 static int run_ddr4_address_sweep(struct test_handle *th, uint32_t base_address, uint32_t final_offset, uint32_t calibration, uint32_t verbose, uint32_t region_offset)
 {
 	uint32_t data = 0;
-	uint32_t busy = 0;
+	uint64_t started_ns;
 	
 	data = base_address;
 	(*th->write_u32)(th->arg, (DDR4_MEM_ADDRESS + region_offset), data);
@@ -429,14 +470,149 @@ static int run_ddr4_address_sweep(struct test_handle *th, uint32_t base_address,
 	data = 0 | (0 << DDR4_START_MASK) | (calibration << DDR4_CAL_MASK);
 	(*th->write_u32)(th->arg, (PR_CONTROL_REGISTER + region_offset), data);	
 
-	do {
-		data = 0;
-		(*th->read_u32)(th->arg, (DDR4_BUSY_REGISTER + region_offset), &data);
-		busy = data;
-	} while(busy);
+	started_ns = pr_poll_now_ns();
+	wait_pr_busy_register(th, &ddr4_poll, started_ns, DDR4_BUSY_REGISTER + region_offset);
 
 	return 0;	
 }
+/*
+ * The persona writes a 512 bit word to every address from DDR4_MEM_ADDRESS
+ * to DDR4_MEM_ADDRESS + DDR4_FINAL_OFFSET in turn, reads it back, and counts
+ * the words that match in PERFORMANCE_COUNTER.  The counter is only cleared
+ * by the logic reset, so it adds up over the sweeps of a benchmark run.
+ * Sequential runs are one sweep over the whole size; strided and random
+ * runs cover the same size in DDR4_BENCH_CHUNK word sweeps, spread evenly
+ * over the memory or at random chunk aligned addresses.
+ */
+#define DDR4_WORD_BYTES 64
+#define DDR4_BENCH_CHUNK 256
+#define DDR4_BENCH_MIN_SIZE (1 << 9)
+#define DDR4_BENCH_SIZE_STEP 2
+
+enum ddr4_pattern {
+	DDR4_SEQUENTIAL,
+	DDR4_STRIDED,
+	DDR4_RANDOM,
+	DDR4_ALL_PATTERNS
+};
+
+static const char * const ddr4_pattern_names[] = {
+	[DDR4_SEQUENTIAL] = "seq",
+	[DDR4_STRIDED] = "stride",
+	[DDR4_RANDOM] = "random",
+	[DDR4_ALL_PATTERNS] = "all",
+};
+
+static int parse_ddr4_pattern(const char *name)
+{
+	int i;
+
+	for (i = 0; i <= DDR4_ALL_PATTERNS; i++)
+		if (!strcmp(name, ddr4_pattern_names[i]))
+			return i;
+
+	return -1;
+}
+
+static void print_ddr4_size(uint64_t bytes)
+{
+	if (bytes >= (1ull << 30))
+		printf("%7ju GiB", (uintmax_t)(bytes >> 30));
+	else if (bytes >= (1ull << 20))
+		printf("%7ju MiB", (uintmax_t)(bytes >> 20));
+	else
+		printf("%7ju KiB", (uintmax_t)(bytes >> 10));
+}
+
+/* One line of the table; returns the number of words that failed */
+static uint64_t run_ddr4_bench_row(struct test_handle *th, int pattern, uint32_t size, uint32_t calibration, uint32_t seed, uint32_t number_of_runs, uint32_t verbose, uint32_t region_offset)
+{
+	uint32_t length = (pattern == DDR4_SEQUENTIAL || size < DDR4_BENCH_CHUNK) ? size : DDR4_BENCH_CHUNK;
+	uint32_t sweeps = size / length;
+	uint32_t stride = DDR4_ADDRESS_MAX / sweeps;
+	struct timespec begin;
+	struct timespec end;
+	uint64_t words = 0;
+	uint64_t passes = 0;
+	double seconds = 0.0;
+	uint32_t base_address;
+	uint32_t data;
+	uint32_t run;
+	uint32_t i;
+
+	/*
+	 * The sweeps of a row all take about as long as each other; a poller
+	 * that learnt the latency of another row would sleep through part of
+	 * these inside the timed loop.
+	 */
+	pr_poll_init(&ddr4_poll);
+
+	for (run = 0; run < number_of_runs; run++) {
+		reset_pr_logic(th, verbose, region_offset);
+		(*th->write_u32)(th->arg, (DDR4_SEED_ADDRESS + region_offset), seed);
+		(*th->write_u32)(th->arg, (PR_CONTROL_REGISTER + region_offset), (1 << DDR4_LOAD_SEED_MASK));
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for (i = 0; i < sweeps; i++) {
+			if (pattern == DDR4_STRIDED)
+				base_address = i * stride;
+			else if (pattern == DDR4_RANDOM)
+				base_address = (rand() % (DDR4_ADDRESS_MAX / length)) * length;
+			else
+				base_address = i * length;
+			run_ddr4_address_sweep(th, base_address, length - 1, calibration, verbose, region_offset);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		(*th->read_u32)(th->arg, (PERFORMANCE_COUNTER + region_offset), &data);
+		seconds += (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+		words += (uint64_t)sweeps * length;
+		passes += data;
+		VERBOSE_MESSAGE("\t%s run %u: %u of %u words passed\n", ddr4_pattern_names[pattern], run, data, sweeps * length);
+	}
+
+	/* every word that passed was written once and read once */
+	printf("%-8s", ddr4_pattern_names[pattern]);
+	print_ddr4_size((uint64_t)size * DDR4_WORD_BYTES);
+	printf(" %8u %11.3f %10.2f %9.3f %s\n", sweeps,
+	       seconds * 1000.0 / number_of_runs,
+	       seconds * 1000000.0 / ((double)sweeps * number_of_runs),
+	       (double)passes * DDR4_WORD_BYTES * 2 / seconds / 1000000000.0,
+	       passes == words ? "PASS" : "FAIL");
+
+	if (verbose)
+		pr_poll_print(&ddr4_poll, "DDR4 busy");
+
+	return words - passes;
+}
+
+static int do_ddr4_bench(struct test_handle *th, int pattern, uint32_t calibration, uint32_t seed, uint32_t number_of_runs, uint32_t verbose, uint32_t region_offset)
+{
+	uint64_t failed = 0;
+	uint32_t size;
+	int p;
+
+	printf("DDR4 bandwidth, %u runs per line, GB/s counts words written and read back\n", number_of_runs);
+	printf("%-8s %11s %8s %11s %10s %9s %s\n", "pattern", "size", "sweeps", "ms/run", "us/sweep", "GB/s", "result");
+
+	for (p = 0; p < DDR4_ALL_PATTERNS; p++) {
+		if (pattern != DDR4_ALL_PATTERNS && pattern != p)
+			continue;
+		for (size = DDR4_BENCH_MIN_SIZE; size < DDR4_ADDRESS_MAX; size <<= DDR4_BENCH_SIZE_STEP)
+			failed += run_ddr4_bench_row(th, p, size, calibration, seed, number_of_runs, verbose, region_offset);
+		failed += run_ddr4_bench_row(th, p, DDR4_ADDRESS_MAX, calibration, seed, number_of_runs, verbose, region_offset);
+	}
+
+	reset_pr_logic(th, verbose, region_offset);
+
+	if (failed) {
+		printf("DDR4 benchmark FAILED, %ju words did not read back\n", (uintmax_t)failed);
+		exit(EXIT_FAILURE);
+	}
+	printf("DDR4 Access persona passed\n");
+	return 0;
+}
+
 static int do_ddr4_access_persona (struct  test_handle *th, uint32_t seed, uint32_t number_of_runs, uint32_t verbose, uint32_t region_offset)
 {
 	uint32_t data;
@@ -457,6 +633,9 @@ static int do_ddr4_access_persona (struct  test_handle *th, uint32_t seed, uint3
 		calibration = 1;
 
 	VERBOSE_MESSAGE("\tDDR4 Calibration Check Successful\n");
+	if (ddr4_pattern >= 0)
+		return do_ddr4_bench(th, ddr4_pattern, calibration, seed, number_of_runs, verbose, region_offset);
+
 	VERBOSE_MESSAGE("\tStarting Test cases\n");
 
 	for( i = 1; i <= number_of_runs; i++) {
@@ -490,10 +669,10 @@ static int do_ddr4_access_persona (struct  test_handle *th, uint32_t seed, uint3
 		VERBOSE_MESSAGE("\tChecking result for test case %d\n", i);
 		data = 0;
 		(*th->read_u32)(th->arg, (PERFORMANCE_COUNTER + region_offset), &data);
-		VERBOSE_MESSAGE("\tPercent of passing writes = %0.2f%% \n", (data/final_offset) * 100.0);
+		VERBOSE_MESSAGE("\tPercent of passing writes = %0.2f%% \n", ((float)data/(float)(final_offset + 1)) * 100.0);
 
 		if(data != final_offset + 1) {
-			printf("\tDDR4 Access failed %0d of %0d (%0.2f%%) writes\n", final_offset - data, final_offset, (data/final_offset) * 100.0);
+			printf("\tDDR4 Access failed %0d of %0d (%0.2f%%) writes\n", final_offset + 1 - data, final_offset + 1, ((float)(final_offset + 1 - data)/(float)(final_offset + 1)) * 100.0);
 			exit(EXIT_FAILURE);
 		}
 		printf("Test %d of %d PASS\n", i, number_of_runs);
@@ -509,8 +688,6 @@ static int do_ddr4_access_persona (struct  test_handle *th, uint32_t seed, uint3
 #define GOL_TOP_END PR_HOST_REGISTER_1
 #define GOL_BOT_END PR_HOST_REGISTER_2
 #define GOL_START_MASK 1
-#define GOL_ROWS 8
-#define GOL_COLS 8
 static uint32_t getbit(uint64_t value, uint32_t position) 
 {
 	
@@ -540,8 +717,7 @@ static void run_gol_accelerated(struct  test_handle *th, uint32_t top_half, uint
 
 	struct timespec begin;
 	struct timespec end;
-	uint32_t data = 0;
-	uint32_t busy = 0;
+	uint64_t started_ns;
 	
 	printf("Loading GOL data over PCIe, starting timer\n");
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
@@ -552,11 +728,8 @@ static void run_gol_accelerated(struct  test_handle *th, uint32_t top_half, uint
 	(*th->write_u32)(th->arg, (PR_CONTROL_REGISTER + region_offset), (1 << GOL_START_MASK));
 	(*th->write_u32)(th->arg, (PR_CONTROL_REGISTER + region_offset), (0 << GOL_START_MASK));
 	
-	do {
-		data = 0;
-		(*th->read_u32)(th->arg, (GOL_BUSY_REG + region_offset), &data);
-		busy = data;
-	} while(busy);
+	started_ns = pr_poll_now_ns();
+	wait_pr_busy_register(th, &gol_poll, started_ns, GOL_BUSY_REG + region_offset);
 	
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
 	printf("Accelerated GOL complete\n");
@@ -565,77 +738,16 @@ static void run_gol_accelerated(struct  test_handle *th, uint32_t top_half, uint
 
 }
 
-static uint32_t calculate_coord(int x, int y)
-{
-	return (uint32_t)(((x + GOL_ROWS) % GOL_ROWS) + (((y + GOL_COLS) % GOL_COLS) * GOL_ROWS));
-}
-
-static void calculate_neighbors(uint64_t current_board, uint32_t *neighbors)
-{
-
-	int i = 0;
-	int j = 0;
-
-	for(i = 0; i < GOL_ROWS; i++){
-		for(j = 0; j < GOL_COLS; j++){
-			neighbors[calculate_coord(i,j)] = 0;
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i+1,j+1));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i+1,j));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i+1,j-1));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i,j-1));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i,j+1));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i-1,j+1));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i-1,j));
-			neighbors[calculate_coord(i,j)] += getbit(current_board, calculate_coord(i-1,j-1));
-		}
-	}
-
-}
-static uint64_t apply_gol_rules(uint64_t current_board, uint32_t *neighbors)
-{
-
-	uint32_t i = 0;
-	uint64_t return_board = 0;
-	for(i = 0; i < (GOL_ROWS * GOL_COLS); i++){
-		if (getbit(current_board,i) == 1){
-			if((neighbors[i] == 2) || ( (neighbors[i] == 3)))
-				return_board = (return_board) | (uint64_t)((uint64_t)1 << (uint64_t)i);
-		}
-		else{
-			if(neighbors[i] == 3)
-				return_board = (return_board) | (uint64_t)((uint64_t)1 << (uint64_t)i);
-		}
-		neighbors[i]=0;
-	}
-	return return_board;
-}
 static uint64_t run_gol_verify(uint64_t board, uint32_t number_of_runs, uint32_t verbose)
 {
-	uint32_t i = 0;
-	uint32_t j = 0;
 	uint64_t current_board = 0;
-	uint64_t next_board = 0;
-	uint32_t *neighbors;
 	struct timespec begin;
 	struct timespec end;
 	printf("Beginning host side GOL for verification, starting timer\n");
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
-	neighbors = (uint32_t*) calloc((GOL_ROWS * GOL_COLS),sizeof(uint32_t));
 
-	current_board = board;
+	current_board = gol_run(board, number_of_runs);
 
-	for(i = 0;i < number_of_runs; i++){
-		for(j = 0; j < 64; j++){
-			if(neighbors[j] != 0)
-			{
-				exit(EXIT_FAILURE);
-			}
-		}
-		calculate_neighbors(current_board, neighbors);
-		next_board = apply_gol_rules(current_board, neighbors);
-		current_board = next_board;
-	}
-	free(neighbors);
 	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
 
 	printf("Host side GOL execution complete\n");
@@ -643,6 +755,105 @@ static uint64_t run_gol_verify(uint64_t board, uint32_t number_of_runs, uint32_t
 	return current_board;
 }
 
+/*
+ * The persona has a single engine, but it only samples the board when it is
+ * started and holds the result until the next start.  So in batch mode the
+ * next board is written to the input registers while the current one runs,
+ * and starting it costs just the control register toggle once the result
+ * has been read back.  The generation count is written once for the batch.
+ */
+static int do_gol_batch(struct test_handle *th, uint32_t number_of_boards, uint32_t number_of_runs, uint32_t verbose, uint32_t region_offset)
+{
+	struct timespec begin;
+	struct timespec end;
+	uint64_t *boards;
+	uint64_t *results;
+	uint64_t *expected;
+	uint64_t started_ns;
+	uint32_t top_half;
+	uint32_t bottom_half;
+	double seconds;
+	double verify_seconds;
+	uint32_t errors = 0;
+	uint32_t i;
+
+	printf("Running %u GOL boards back to back\n", number_of_boards);
+	boards = malloc(number_of_boards * sizeof(*boards));
+	results = malloc(number_of_boards * sizeof(*results));
+	expected = malloc(number_of_boards * sizeof(*expected));
+	if (!boards || !results || !expected) {
+		printf("failed to allocate %u boards\n", number_of_boards);
+		free(boards);
+		free(results);
+		free(expected);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < number_of_boards; i++) {
+		generate_random_number(&top_half, &bottom_half, 32);
+		boards[i] = ((uint64_t)top_half << 32) | (uint64_t)bottom_half;
+	}
+
+	reset_pr_logic(th, verbose, region_offset);
+	(*th->write_u32)(th->arg, (GOL_COUNTER_LIMIT_ADDRESS + region_offset), number_of_runs);
+	(*th->write_u32)(th->arg, (GOL_TOP_HALF + region_offset), (uint32_t)(boards[0] >> 32));
+	(*th->write_u32)(th->arg, (GOL_BOT_HALF + region_offset), (uint32_t)boards[0]);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < number_of_boards; i++) {
+		(*th->write_u32)(th->arg, (PR_CONTROL_REGISTER + region_offset), (1 << GOL_START_MASK));
+		(*th->write_u32)(th->arg, (PR_CONTROL_REGISTER + region_offset), (0 << GOL_START_MASK));
+		started_ns = pr_poll_now_ns();
+
+		/* board i has been latched, queue the next one behind it */
+		if (i + 1 < number_of_boards) {
+			(*th->write_u32)(th->arg, (GOL_TOP_HALF + region_offset), (uint32_t)(boards[i + 1] >> 32));
+			(*th->write_u32)(th->arg, (GOL_BOT_HALF + region_offset), (uint32_t)boards[i + 1]);
+		}
+
+		wait_pr_busy_register(th, &gol_poll, started_ns, GOL_BUSY_REG + region_offset);
+
+		(*th->read_u32)(th->arg, (GOL_TOP_END + region_offset), &top_half);
+		(*th->read_u32)(th->arg, (GOL_BOT_END + region_offset), &bottom_half);
+		results[i] = ((uint64_t)top_half << 32) | (uint64_t)bottom_half;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+
+	memcpy(expected, boards, number_of_boards * sizeof(*expected));
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	gol_run_many(expected, number_of_boards, number_of_runs);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	verify_seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+
+	for (i = 0; i < number_of_boards; i++) {
+		if (results[i] == expected[i])
+			continue;
+		if (errors++ < 4 || verbose == 1)
+			printf("\tboard %u 0x%016jX: expected 0x%016jX received 0x%016jX\n", i,
+			       (uintmax_t)boards[i], (uintmax_t)expected[i], (uintmax_t)results[i]);
+	}
+
+	printf("Accelerated GOL batch complete\n");
+	printf("\t%u boards of %u generations in %0.3f ms, %0.0f boards/s\n",
+	       number_of_boards, number_of_runs, seconds * 1000.0, number_of_boards / seconds);
+	pr_poll_print(&gol_poll, "GOL busy");
+	printf("\thost verification %0.3f ms, %0.0f boards/s\n",
+	       verify_seconds * 1000.0, number_of_boards / verify_seconds);
+
+	free(boards);
+	free(results);
+	free(expected);
+
+	if (errors) {
+		printf("GOL batch FAILED with %u mismatches\n", errors);
+		exit(EXIT_FAILURE);
+	}
+	printf("GOL persona passed\n");
+
+	return 0;
+}
+
 static int do_gol_persona (struct  test_handle *th, uint32_t seed, uint32_t number_of_runs, uint32_t verbose, uint32_t region_offset)
 {
 	
@@ -653,6 +864,9 @@ static int do_gol_persona (struct  test_handle *th, uint32_t seed, uint32_t numb
 	uint64_t accelerated_result=0;
 	uint64_t host_generated_result=0;
 	printf("This is the Game of Life Persona\n");
+	if (number_of_boards > 1)
+		return do_gol_batch(th, number_of_boards, number_of_runs, verbose, region_offset);
+
 
 	reset_pr_logic(th, verbose, region_offset);
 	generate_random_number(&top_half, &bottom_half, 32);
@@ -749,6 +963,215 @@ static int do_hpr_config_a(struct  test_handle *th, uint32_t seed, uint32_t numb
 	return ret_0;
 }
 
+/*
+ * Shadow loading with the HPR parent.  Both children can host the same
+ * personas, so the next persona is loaded into the idle child while the
+ * active one keeps serving requests, and switching to it is the swap of
+ * the pointer requests are dispatched through, instead of a freeze, load
+ * and unfreeze of the child in service.
+ *
+ * The requests are single operations on the persona of the active child,
+ * an addition, a multiplication or, for the other personas, a read of the
+ * persona ID, issued back to back by a server thread.  The idle child is
+ * loaded through its fpga region, which the base device tree describes in
+ * the parent with its own region controller, so the driver freezes only the
+ * child being loaded.  The children are registered when the subdrivers are
+ * probed with the parent loaded.
+ */
+#define HPR_A_REGION_0 "pr-region@4_4000"
+#define HPR_A_REGION_1 "pr-region@4_8000"
+
+struct hpr_child {
+	uint32_t region_offset;
+	const char *region;
+	uint32_t persona_id;
+};
+
+struct hpr_server {
+	struct test_handle *th;
+	/* the dispatch table, the child requests are sent to */
+	struct hpr_child *_Atomic active;
+	atomic_int stop;
+	atomic_int failed;
+	atomic_ulong served;
+	/* longest time between two requests, and that around the last switch */
+	_Atomic uint64_t max_gap_ns;
+	_Atomic uint64_t switch_gap_ns;
+};
+
+static int hpr_serve_one(struct test_handle *th, struct hpr_child *child, unsigned int *rand_seed)
+{
+	uint32_t a = rand_r(rand_seed);
+	uint32_t b = rand_r(rand_seed);
+	uint32_t low = 0;
+	uint32_t high = 0;
+
+	switch (child->persona_id) {
+	case PERSONA_ID_BASIC_ARITHMETIC:
+		(*th->write_u32)(th->arg, (PR_OPERAND + child->region_offset), a);
+		(*th->write_u32)(th->arg, (PR_INCR + child->region_offset), b);
+		(*th->read_u32)(th->arg, (PR_RESULT + child->region_offset), &low);
+		return low != (uint32_t)(a + b);
+
+	case PERSONA_ID_BASIC_DSP:
+		a &= (1 << DSP_INPUT_SIZE) - 1;
+		b &= (1 << DSP_INPUT_SIZE) - 1;
+		(*th->write_u32)(th->arg, (PR_OPERAND + child->region_offset), a);
+		(*th->write_u32)(th->arg, (PR_INCR + child->region_offset), b);
+		(*th->read_u32)(th->arg, (PR_HOST_REGISTER_1 + child->region_offset), &high);
+		(*th->read_u32)(th->arg, (PR_HOST_REGISTER_0 + child->region_offset), &low);
+		return (((uint64_t)high << 32) | low) != (uint64_t)a * b;
+
+	default:
+		(*th->read_u32)(th->arg, (PR_PERSONA_ID + child->region_offset), &low);
+		return low != child->persona_id;
+	}
+}
+
+static void *hpr_serve(void *arg)
+{
+	struct hpr_server *server = arg;
+	struct hpr_child *child;
+	struct hpr_child *last = NULL;
+	unsigned int rand_seed = seed;
+	uint64_t done_ns = pr_poll_now_ns();
+	uint64_t now_ns;
+
+	while (!atomic_load(&server->stop)) {
+		child = atomic_load_explicit(&server->active, memory_order_acquire);
+		if (last && child != last)
+			atomic_store(&server->switch_gap_ns, pr_poll_now_ns() - done_ns);
+		last = child;
+
+		if (hpr_serve_one(server->th, child, &rand_seed))
+			atomic_store(&server->failed, 1);
+
+		now_ns = pr_poll_now_ns();
+		if (now_ns - done_ns > atomic_load(&server->max_gap_ns))
+			atomic_store(&server->max_gap_ns, now_ns - done_ns);
+		done_ns = now_ns;
+		atomic_fetch_add(&server->served, 1);
+	}
+
+	return NULL;
+}
+
+/* Load image into a child through its fpga region, which freezes it around the load */
+static int hpr_load_child(struct hpr_child *child, const char *image, uint32_t verbose)
+{
+	char path[128];
+	int len = strlen(image);
+	int ret = 0;
+	int fd;
+
+	snprintf(path, sizeof(path), "/sys/class/fpga_region/%s.%s/image_file", device_name, child->region);
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		printf("failed to open %s, are the subdrivers probed with the parent loaded?\n", path);
+		return -errno;
+	}
+
+	VERBOSE_MESSAGE("\tLoading %s into %s\n", image, child->region);
+	if (write(fd, image, len) != len) {
+		ret = -errno;
+		printf("failed to write %s to %s: %s\n", image, path, strerror(errno));
+	}
+	close(fd);
+	return ret;
+}
+
+static int do_hpr_shadow(struct test_handle *th, const char *shadow_images, uint32_t verbose)
+{
+	struct hpr_child children[2] = {
+		{ HPR_A_CHILD_0, HPR_A_REGION_0, 0 },
+		{ HPR_A_CHILD_1, HPR_A_REGION_1, 0 },
+	};
+	struct hpr_server server;
+	struct hpr_child *active = &children[0];
+	struct hpr_child *idle;
+	unsigned int check_seed = seed;
+	unsigned long served;
+	uint64_t start_ns;
+	uint64_t load_ns;
+	uint64_t flip_ns;
+	uint64_t total_ns;
+	pthread_t thread;
+	char *images;
+	char *image;
+	char *save;
+	int ret = 0;
+
+	printf("This is a HPR Persona with configuration A, shadow loading the children\n");
+	(*th->read_u32)(th->arg, (PR_PERSONA_ID + children[0].region_offset), &children[0].persona_id);
+	(*th->read_u32)(th->arg, (PR_PERSONA_ID + children[1].region_offset), &children[1].persona_id);
+	reset_pr_logic(th, verbose, active->region_offset);
+
+	memset(&server, 0, sizeof(server));
+	server.th = th;
+	atomic_init(&server.active, active);
+	if (pthread_create(&thread, NULL, hpr_serve, &server)) {
+		printf("failed to start the server thread\n");
+		return -EAGAIN;
+	}
+	printf("Serving from child 0, persona 0x%08X\n", active->persona_id);
+
+	images = strdup(shadow_images);
+	total_ns = pr_poll_now_ns();
+	for (image = strtok_r(images, ",", &save); image; image = strtok_r(NULL, ",", &save)) {
+		idle = active == &children[0] ? &children[1] : &children[0];
+
+		served = atomic_load(&server.served);
+		atomic_store(&server.max_gap_ns, 0);
+		start_ns = pr_poll_now_ns();
+		ret = hpr_load_child(idle, image, verbose);
+		load_ns = pr_poll_now_ns() - start_ns;
+		if (ret) {
+			printf("Loading %s into child %d failed\n", image, (int)(idle - children));
+			break;
+		}
+
+		(*th->read_u32)(th->arg, (PR_PERSONA_ID + idle->region_offset), &idle->persona_id);
+		reset_pr_logic(th, verbose, idle->region_offset);
+		if (hpr_serve_one(th, idle, &check_seed)) {
+			printf("Child %d does not answer correctly after loading %s, not switching\n", (int)(idle - children), image);
+			ret = -EIO;
+			break;
+		}
+
+		printf("Child %d: %s, persona 0x%08X\n", (int)(idle - children), image, idle->persona_id);
+		printf("\tloaded in %.3f ms while child %d served %lu requests, longest gap %.1f us\n",
+		       load_ns / 1e6, (int)(active - children), atomic_load(&server.served) - served,
+		       atomic_load(&server.max_gap_ns) / 1e3);
+
+		start_ns = pr_poll_now_ns();
+		atomic_store_explicit(&server.active, idle, memory_order_release);
+		flip_ns = pr_poll_now_ns() - start_ns;
+
+		/* the child switched from is free once the request in flight
+		 * on it is done; one more shows the gap the switch left */
+		served = atomic_load(&server.served);
+		while (atomic_load(&server.served) < served + 2)
+			sched_yield();
+
+		printf("\tswitched in %ju ns, gap between requests %.1f us\n",
+		       (uintmax_t)flip_ns, atomic_load(&server.switch_gap_ns) / 1e3);
+		active = idle;
+	}
+	free(images);
+
+	atomic_store(&server.stop, 1);
+	pthread_join(thread, NULL);
+	total_ns = pr_poll_now_ns() - total_ns;
+
+	printf("Served %lu requests in %.3f s, %.0f requests/s\n", atomic_load(&server.served),
+	       total_ns / 1e9, atomic_load(&server.served) / (total_ns / 1e9));
+	if (atomic_load(&server.failed)) {
+		printf("Shadow loading FAILED, requests returned wrong results\n");
+		exit(EXIT_FAILURE);
+	}
+	return ret;
+}
+
 static void usage(const char *prog_name) 
 {
 
@@ -756,6 +1179,9 @@ static void usage(const char *prog_name)
 	printf("\t<-d,--device> [val]: PCIe id for card (e.g. -d=0000:03:00.0)\n");
 	printf("\t<-s,--seed> [val]:Used for random parameterization\n");
 	printf("\t<-n,--iterations> [val]:Number of times to perform a given personas task\n");
+	printf("\t<-b,--boards> [val]:Number of GOL boards to run back to back (default 1)\n");
+	printf("\t<-p,--pattern> [val]:Run the DDR4 bandwidth benchmark with seq, stride, random or all patterns\n");
+	printf("\t<-S,--shadow> [val]:With the HPR parent, load these comma separated images in turn into the idle child while the other one serves\n");
 	printf("\t<-v, --verbose> :Verbose information is reported.\n\n");
 	printf("\tMust declare device, other opts are optional\n\n");
 	exit(0);
@@ -771,18 +1197,23 @@ int main(int argc, char **argv)
 
 	verbose = 0;
 	number_of_runs = 3;
+	number_of_boards = 1;
+	ddr4_pattern = -1;
 	seed = 1;
 
 	static struct option long_options[] = {
 		{"verbose", no_argument, 0, 'v'},
 		{"seed", required_argument, 0, 's'},
 		{"iterations", required_argument, 0, 'n'},
+		{"boards", required_argument, 0, 'b'},
+		{"pattern", required_argument, 0, 'p'},
 		{"help", no_argument, 0, 'h'},
 		{"device", required_argument, 0, 'd'},
+		{"shadow", required_argument, 0, 'S'},
 		{0, 0, 0, 0}
 	} ;
 
-	while((opt = getopt_long(argc, argv, "vd:s:n:h", long_options, NULL)) != -1){
+	while((opt = getopt_long(argc, argv, "vd:s:n:b:p:S:h", long_options, NULL)) != -1){
 		switch(opt){
 			case 'v':
 				verbose = 1;
@@ -793,11 +1224,25 @@ int main(int argc, char **argv)
 			case 'n':
 				number_of_runs = (uint32_t) strtol(optarg, &optarg,10);
 				break;
+			case 'b':
+				number_of_boards = (uint32_t) strtol(optarg, &optarg,10);
+				break;
+			case 'p':
+				ddr4_pattern = parse_ddr4_pattern(optarg);
+				if (ddr4_pattern < 0) {
+					printf("\nUnknown DDR4 pattern %s\n", optarg);
+					usage(argv[0]);
+				}
+				break;
 			case 's':
 				seed = (uint32_t) strtol(optarg, &optarg, 10);
 				break;
 			case 'd':
 				uio_num = uio_find_dev_num(optarg);
+				device_name = optarg;
+				break;
+			case 'S':
+				shadow_images = optarg;
 				break;
 			case ':':
 			case '?':
@@ -809,6 +1254,8 @@ int main(int argc, char **argv)
 	}
 
 	srand(seed);
+	pr_poll_init(&ddr4_poll);
+	pr_poll_init(&gol_poll);
 
 	if (uio_num < 0) {
 		printf("\nError: No PCIe device specified.\n");
@@ -848,7 +1295,10 @@ int main(int argc, char **argv)
 		break;
 
 	case PERSONA_ID_HPR_PARENT_ALPHA:
-		ret = do_hpr_config_a(&th, seed, number_of_runs, verbose, 0);
+		if (shadow_images)
+			ret = do_hpr_shadow(&th, shadow_images, verbose);
+		else
+			ret = do_hpr_config_a(&th, seed, number_of_runs, verbose, 0);
 		break;
 
 	default:
@@ -856,6 +1306,11 @@ int main(int argc, char **argv)
 		ret = -EINVAL;
 	}
 
+	if (verbose == 1) {
+		pr_poll_print(&ddr4_poll, "DDR4 busy");
+		pr_poll_print(&gol_poll, "GOL busy");
+	}
+
 	uio_close(uioh);
 	return ret;
 }
@@ -0,0 +1,248 @@
+// Copyright (c) 2001-2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ * Checks the host side Game of Life implementations against the reference
+ * one and measures how many board generations per second each manages.
+ * Needs no FPGA.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gol_verify.h"
+
+static uint64_t random_board(void)
+{
+	return ((uint64_t)(rand() & 0xffff) << 48) |
+	       ((uint64_t)(rand() & 0xffff) << 32) |
+	       ((uint64_t)(rand() & 0xffff) << 16) |
+	       (uint64_t)(rand() & 0xffff);
+}
+
+static double elapsed_s(struct timespec begin, struct timespec end)
+{
+	return (double)(end.tv_sec - begin.tv_sec) +
+	       (double)(end.tv_nsec - begin.tv_nsec) / 1000000000.0;
+}
+
+static int check_step(uint64_t board)
+{
+	uint64_t expected = gol_step_reference(board);
+	uint64_t returned = gol_step(board);
+
+	if (expected == returned)
+		return 0;
+
+	printf("gol_step mismatch for board 0x%016jX:\n", (uintmax_t)board);
+	printf("\tExpected:(0x%016jX)\n", (uintmax_t)expected);
+	printf("\tReceived: (0x%016jX)\n", (uintmax_t)returned);
+	return 1;
+}
+
+/*
+ * Single generations first: every single cell and its complement, which
+ * exercise the wrap around at every edge, then random boards.
+ */
+static int cross_check_steps(uint32_t count)
+{
+	uint32_t i;
+	int errors = 0;
+
+	errors += check_step(0);
+	errors += check_step(~(uint64_t)0);
+
+	for (i = 0; i < 64; i++) {
+		errors += check_step((uint64_t)1 << i);
+		errors += check_step(~((uint64_t)1 << i));
+		/* three cells in a row, wrapping into the next row */
+		errors += check_step(i ? (uint64_t)7 << i | (uint64_t)7 >> (64 - i) : 7);
+	}
+
+	for (i = 0; i < count; i++)
+		errors += check_step(random_board());
+
+	return errors;
+}
+
+static int compare_boards(const char *name, const uint64_t *expected,
+			  const uint64_t *returned, size_t count)
+{
+	size_t i;
+	int errors = 0;
+
+	for (i = 0; i < count; i++) {
+		if (expected[i] == returned[i])
+			continue;
+
+		if (errors++ < 4)
+			printf("%s mismatch on board %zu: expected 0x%016jX received 0x%016jX\n",
+			       name, i, (uintmax_t)expected[i],
+			       (uintmax_t)returned[i]);
+	}
+
+	return errors;
+}
+
+static void reference_run_many(uint64_t *boards, size_t count,
+			       uint32_t generations)
+{
+	size_t i;
+	uint32_t g;
+
+	for (i = 0; i < count; i++)
+		for (g = 0; g < generations; g++)
+			boards[i] = gol_step_reference(boards[i]);
+}
+
+static void print_rate(const char *name, size_t count, uint32_t generations,
+		       double seconds, double reference_seconds)
+{
+	double steps = (double)count * generations;
+
+	printf("%-12s %10.3f ms %14.0f steps/s %8.1fx\n", name,
+	       seconds * 1000.0, steps / seconds,
+	       reference_seconds / seconds);
+}
+
+static void usage(const char *prog_name)
+{
+	printf("\nUsage:%s <opts> [val]\n\n", prog_name);
+	printf("\t<-b,--boards> [val]:Number of boards to run (default 4096)\n");
+	printf("\t<-n,--iterations> [val]:Generations per board (default 1000)\n");
+	printf("\t<-c,--checks> [val]:Random boards to check single generations on (default 100000)\n");
+	printf("\t<-s,--seed> [val]:Used for random boards\n\n");
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t number_of_boards = 4096;
+	uint32_t number_of_runs = 1000;
+	uint32_t number_of_checks = 100000;
+	uint32_t seed = 1;
+	uint64_t *initial, *reference, *boards;
+	struct timespec begin, end;
+	double reference_s, seconds;
+	size_t size;
+	uint32_t i;
+	int errors;
+	int opt;
+
+	static struct option long_options[] = {
+		{"boards", required_argument, 0, 'b'},
+		{"iterations", required_argument, 0, 'n'},
+		{"checks", required_argument, 0, 'c'},
+		{"seed", required_argument, 0, 's'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while ((opt = getopt_long(argc, argv, "b:n:c:s:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'b':
+			number_of_boards = (uint32_t) strtol(optarg, NULL, 10);
+			break;
+		case 'n':
+			number_of_runs = (uint32_t) strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			number_of_checks = (uint32_t) strtol(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = (uint32_t) strtol(optarg, NULL, 10);
+			break;
+		case 'h':
+			usage(argv[0]);
+			break;
+		default:
+			printf("\nInvalid parameter passed.\n");
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	srand(seed);
+
+	errors = cross_check_steps(number_of_checks);
+	printf("Checked single generations: %d mismatches\n", errors);
+
+	size = (size_t)number_of_boards * sizeof(uint64_t);
+	initial = malloc(size);
+	reference = malloc(size);
+	boards = malloc(size);
+	if (!initial || !reference || !boards) {
+		printf("failed to allocate %u boards\n", number_of_boards);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < number_of_boards; i++)
+		initial[i] = random_board();
+
+	printf("Running %u boards for %u generations, SIMD %s\n",
+	       number_of_boards, number_of_runs,
+	       gol_simd_available() ? "available" : "not available");
+
+	memcpy(reference, initial, size);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	reference_run_many(reference, number_of_boards, number_of_runs);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	reference_s = elapsed_s(begin, end);
+	print_rate("reference", number_of_boards, number_of_runs,
+		   reference_s, reference_s);
+
+	memcpy(boards, initial, size);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	gol_run_many_scalar(boards, number_of_boards, number_of_runs);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = elapsed_s(begin, end);
+	print_rate("bit-parallel", number_of_boards, number_of_runs,
+		   seconds, reference_s);
+	errors += compare_boards("bit-parallel", reference, boards,
+				 number_of_boards);
+
+	if (gol_simd_available()) {
+		memcpy(boards, initial, size);
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		gol_run_many_simd(boards, number_of_boards, number_of_runs);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		seconds = elapsed_s(begin, end);
+		print_rate("avx2", number_of_boards, number_of_runs,
+			   seconds, reference_s);
+		errors += compare_boards("avx2", reference, boards,
+					 number_of_boards);
+	}
+
+	free(initial);
+	free(reference);
+	free(boards);
+
+	if (errors) {
+		printf("GOL cross-check FAILED with %d mismatches\n", errors);
+		return EXIT_FAILURE;
+	}
+
+	printf("GOL cross-check passed\n");
+	return 0;
+}
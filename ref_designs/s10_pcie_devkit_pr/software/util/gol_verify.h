@@ -0,0 +1,59 @@
+// Copyright (c) 2001-2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ * Host side Game of Life, used to verify the GOL accelerator persona.
+ *
+ * A board is 8x8 cells on a torus, held in a uint64_t: cell (x, y) is bit
+ * x + 8 * y, so each byte is a row.
+ */
+
+#ifndef GOL_VERIFY_H
+#define GOL_VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GOL_ROWS 8
+#define GOL_COLS 8
+
+/* One generation, counting the neighbours of each cell in turn */
+uint64_t gol_step_reference(uint64_t board);
+
+/* One generation, all 64 cells at once */
+uint64_t gol_step(uint64_t board);
+
+/* generations steps of gol_step() */
+uint64_t gol_run(uint64_t board, uint32_t generations);
+
+/* Nonzero if gol_run_many_simd() can be used on this CPU */
+int gol_simd_available(void);
+
+/*
+ * Advance every board in boards by generations steps, in place.  The
+ * _simd variant runs four boards per AVX2 register and must only be used
+ * when gol_simd_available(); gol_run_many() picks it when it can.
+ */
+void gol_run_many_scalar(uint64_t *boards, size_t count, uint32_t generations);
+void gol_run_many_simd(uint64_t *boards, size_t count, uint32_t generations);
+void gol_run_many(uint64_t *boards, size_t count, uint32_t generations);
+
+#endif
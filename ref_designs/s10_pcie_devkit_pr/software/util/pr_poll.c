@@ -0,0 +1,148 @@
+// Copyright (c) 2001-2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pr_poll.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define pr_poll_pause() _mm_pause()
+#elif defined(__aarch64__)
+#define pr_poll_pause() __asm__ __volatile__("yield")
+#else
+#define pr_poll_pause() do { } while (0)
+#endif
+
+/* pause instructions between reads while spinning, roughly 1 us */
+#define PR_POLL_PAUSES 32
+
+void pr_poll_init(struct pr_poll *poll)
+{
+	memset(poll, 0, sizeof(*poll));
+	poll->spin_ns = 2000;
+	poll->yield_ns = 50000;
+	poll->sleep_min_ns = 10000;
+	poll->sleep_max_ns = 1000000;
+	poll->timeout_ns = 60000000000ull;
+}
+
+uint64_t pr_poll_now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void pr_poll_sleep(struct pr_poll *poll, uint64_t ns)
+{
+	struct timespec delay;
+
+	delay.tv_sec = ns / 1000000000ull;
+	delay.tv_nsec = ns % 1000000000ull;
+	nanosleep(&delay, NULL);
+	poll->sleeps++;
+}
+
+static void pr_poll_record(struct pr_poll *poll, uint64_t latency)
+{
+	uint64_t us = latency / 1000;
+	int bucket = 0;
+
+	while (us && bucket < PR_POLL_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	poll->histogram[bucket]++;
+	poll->total_ns += latency;
+	poll->waits++;
+	poll->average_ns = poll->average_ns ? (poll->average_ns * 7 + latency) / 8 : latency;
+}
+
+int pr_poll_wait(struct pr_poll *poll, uint64_t started_ns, pr_poll_busy_fn busy, void *arg)
+{
+	uint64_t sleep_ns = poll->sleep_min_ns;
+	uint64_t elapsed;
+	int i;
+
+	elapsed = pr_poll_now_ns() - started_ns;
+	if (poll->average_ns / 2 >= poll->sleep_min_ns && elapsed < poll->average_ns / 2)
+		pr_poll_sleep(poll, poll->average_ns / 2 - elapsed);
+
+	for (;;) {
+		poll->reads++;
+		if (!busy(arg))
+			break;
+
+		elapsed = pr_poll_now_ns() - started_ns;
+		if (elapsed >= poll->timeout_ns) {
+			poll->timeouts++;
+			return -ETIMEDOUT;
+		}
+
+		if (elapsed < poll->spin_ns) {
+			for (i = 0; i < PR_POLL_PAUSES; i++)
+				pr_poll_pause();
+		} else if (elapsed < poll->spin_ns + poll->yield_ns) {
+			sched_yield();
+		} else {
+			pr_poll_sleep(poll, sleep_ns);
+			if (sleep_ns < poll->sleep_max_ns)
+				sleep_ns *= 2;
+		}
+	}
+
+	pr_poll_record(poll, pr_poll_now_ns() - started_ns);
+	return 0;
+}
+
+void pr_poll_print(const struct pr_poll *poll, const char *name)
+{
+	int i;
+
+	if (!poll->waits)
+		return;
+
+	printf("\t%s: %ju waits, average %0.3f us, %0.1f reads and %0.1f sleeps per wait, %ju timeouts\n",
+	       name, (uintmax_t)poll->waits,
+	       (double)poll->total_ns / poll->waits / 1000.0,
+	       (double)poll->reads / poll->waits,
+	       (double)poll->sleeps / poll->waits,
+	       (uintmax_t)poll->timeouts);
+
+	for (i = 0; i < PR_POLL_BUCKETS; i++) {
+		if (!poll->histogram[i])
+			continue;
+		if (i == 0)
+			printf("\t\t      < 1 us: %ju\n", (uintmax_t)poll->histogram[i]);
+		else if (i == PR_POLL_BUCKETS - 1)
+			printf("\t\t>= %6u us: %ju\n", 1u << (i - 1), (uintmax_t)poll->histogram[i]);
+		else
+			printf("\t\t < %6u us: %ju\n", 1u << i, (uintmax_t)poll->histogram[i]);
+	}
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2001-2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+/*
+ * Waiting for a persona status register to clear.
+ *
+ * A wait starts by reading the register with a few pause instructions in
+ * between, moves on to yielding the CPU between reads, and finally sleeps
+ * between reads, doubling the sleep each time up to sleep_max_ns.  A wait
+ * that has already taken most of the average latency of the previous ones
+ * is cheap, so when that average is long enough to be worth sleeping for,
+ * the wait sleeps through the first half of it before reading anything.
+ */
+
+#ifndef PR_POLL_H
+#define PR_POLL_H
+
+#include <stdint.h>
+
+/* Bucket 0 counts waits under 1 us, bucket i those under 2^i us */
+#define PR_POLL_BUCKETS 16
+
+struct pr_poll {
+	/* phases of a wait, set by pr_poll_init() */
+	uint64_t spin_ns;
+	uint64_t yield_ns;
+	uint64_t sleep_min_ns;
+	uint64_t sleep_max_ns;
+	uint64_t timeout_ns;
+
+	/* statistics over all waits */
+	uint64_t average_ns;
+	uint64_t total_ns;
+	uint64_t waits;
+	uint64_t reads;
+	uint64_t sleeps;
+	uint64_t timeouts;
+	uint64_t histogram[PR_POLL_BUCKETS];
+};
+
+/* Returns nonzero while the register being polled is busy */
+typedef int (*pr_poll_busy_fn)(void *arg);
+
+void pr_poll_init(struct pr_poll *poll);
+
+/* CLOCK_MONOTONIC in ns */
+uint64_t pr_poll_now_ns(void);
+
+/*
+ * Wait for busy(arg) to return 0.  started_ns is when the operation being
+ * waited for was started, as returned by pr_poll_now_ns(); the latency is
+ * counted from there.  Returns 0, or -ETIMEDOUT if the register was still
+ * busy timeout_ns after started_ns.
+ */
+int pr_poll_wait(struct pr_poll *poll, uint64_t started_ns, pr_poll_busy_fn busy, void *arg);
+
+void pr_poll_print(const struct pr_poll *poll, const char *name);
+
+#endif
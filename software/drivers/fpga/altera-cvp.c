@@ -0,0 +1,527 @@
+/*
+ * Driver for Altera Configuration via Protocol (CvP)
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Based on altera-cvp.c Copyright (C) 2017 DENX Software Engineering
+ *  by Anatolij Gustschin <agust@denx.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "altera-cvp.h"
+#include <linux/delay.h>
+#include <linux/fpga/fpga-mgr.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/pci.h>
+
+/* Vendor Specific Extended Capability registers, relative to its offset */
+#define ALT_CVP_VSEC_HDR		0x04	/* 32bit */
+#define ALT_CVP_VSEC_HDR_ID_MSK		0xffff
+#define ALT_CVP_VSEC_ID			0x1172	/* Altera defined VSEC */
+#define ALT_CVP_VSEC_HDR_REV_SFT	16
+#define ALT_CVP_VSEC_HDR_REV_MSK	(0xf << ALT_CVP_VSEC_HDR_REV_SFT)
+
+#define ALT_CVP_STATUS			0x1c	/* 32bit */
+#define ALT_CVP_STATUS_CFG_RDY		BIT(18)	/* CVP_CONFIG_READY */
+#define ALT_CVP_STATUS_CFG_ERR		BIT(19)	/* CVP_CONFIG_ERROR */
+#define ALT_CVP_STATUS_CVP_EN		BIT(20)	/* control block enables CvP */
+#define ALT_CVP_STATUS_USERMODE		BIT(21)	/* USERMODE */
+#define ALT_CVP_STATUS_CFG_DONE		BIT(23)	/* CVP_CONFIG_DONE */
+#define ALT_CVP_STATUS_PLD_CLK_IN_USE	BIT(24)	/* PLD_CLK_IN_USE */
+
+#define ALT_CVP_MODE_CTRL		0x20	/* 32bit */
+#define ALT_CVP_MODE_CTRL_CVP_MODE	BIT(0)	/* CvP (1) or normal mode (0) */
+#define ALT_CVP_MODE_CTRL_HIP_CLK_SEL	BIT(1)	/* PMA (1) or fabric clock (0) */
+#define ALT_CVP_MODE_CTRL_NUMCLKS_SFT	8
+#define ALT_CVP_MODE_CTRL_NUMCLKS_MSK	(0xff << ALT_CVP_MODE_CTRL_NUMCLKS_SFT)
+
+#define ALT_CVP_DATA			0x28	/* 32bit */
+
+#define ALT_CVP_PROG_CTRL		0x2c	/* 32bit */
+#define ALT_CVP_PROG_CTRL_CONFIG	BIT(0)
+#define ALT_CVP_PROG_CTRL_START_XFER	BIT(1)
+
+#define ALT_CVP_TX_CREDITS		0x49	/* 8bit, version 2 only */
+
+/* Arria 10 places the CvP capability at a fixed offset */
+#define ALT_CVP_V1_VSEC_OFFSET		0x200
+
+/*
+ * Data is written, and checked for errors, in blocks of this size, which is
+ * also the unit version 2 (Stratix 10) endpoints grant credits for.
+ */
+#define ALT_CVP_BLOCK_SIZE		SZ_4K
+
+/* Dummy writes that clock the control block on mode changes */
+#define ALT_CVP_DUMMY_WRITES		244
+
+#define ALT_CVP_CFG_RDY_TIMEOUT_US	10000
+#define ALT_CVP_CREDIT_TIMEOUT_US	20000
+#define ALT_CVP_USERMODE_TIMEOUT_US	10000000
+#define ALT_CVP_POLL_MIN_US		10
+#define ALT_CVP_POLL_MAX_US		20
+
+/* Registers emulated when cvp_sim is set, indexed by offset / 4 */
+#define ALT_CVP_SIM_REGS		((ALT_CVP_TX_CREDITS / 4) + 1)
+
+static bool cvp_sim;
+module_param(cvp_sim, bool, 0444);
+MODULE_PARM_DESC(cvp_sim,
+		 "Emulate the CvP endpoint instead of configuring the FPGA");
+
+static unsigned int cvp_sim_block_us;
+module_param(cvp_sim_block_us, uint, 0644);
+MODULE_PARM_DESC(cvp_sim_block_us,
+		 "Time the emulated CvP endpoint takes per 4 KB of image");
+
+struct alt_cvp_priv {
+	struct device *dev;
+	struct pci_dev *pdev;
+	void __iomem *map;
+	u16 vsec;
+	u8 version;
+	u8 sent_blocks;
+	size_t written;
+	bool sim;
+	u32 sim_regs[ALT_CVP_SIM_REGS];
+};
+
+/*
+ * The emulated endpoint only models the handshakes of the control block:
+ * the configuration request is granted at once, and the FPGA enters user
+ * mode as soon as CvP mode is left.
+ */
+static void alt_cvp_sim_write(struct alt_cvp_priv *priv, u16 where, u32 val)
+{
+	u32 *status = &priv->sim_regs[ALT_CVP_STATUS / 4];
+
+	priv->sim_regs[where / 4] = val;
+
+	switch (where) {
+	case ALT_CVP_MODE_CTRL:
+		if (val & ALT_CVP_MODE_CTRL_CVP_MODE)
+			*status &= ~(ALT_CVP_STATUS_USERMODE |
+				     ALT_CVP_STATUS_PLD_CLK_IN_USE);
+		else
+			*status |= ALT_CVP_STATUS_USERMODE |
+				   ALT_CVP_STATUS_PLD_CLK_IN_USE;
+		break;
+
+	case ALT_CVP_PROG_CTRL:
+		if (val & ALT_CVP_PROG_CTRL_CONFIG)
+			*status |= ALT_CVP_STATUS_CFG_RDY;
+		else
+			*status &= ~ALT_CVP_STATUS_CFG_RDY;
+		break;
+	}
+}
+
+static u32 alt_cvp_read(struct alt_cvp_priv *priv, u16 where)
+{
+	u32 val = 0;
+
+	if (priv->sim)
+		return priv->sim_regs[where / 4];
+
+	pci_read_config_dword(priv->pdev, priv->vsec + where, &val);
+
+	return val;
+}
+
+static void alt_cvp_write(struct alt_cvp_priv *priv, u16 where, u32 val)
+{
+	if (priv->sim)
+		alt_cvp_sim_write(priv, where, val);
+	else
+		pci_write_config_dword(priv->pdev, priv->vsec + where, val);
+}
+
+static void alt_cvp_write_data(struct alt_cvp_priv *priv, u32 val)
+{
+	if (priv->sim)
+		return;
+
+	if (priv->map)
+		writel(val, priv->map);
+	else
+		pci_write_config_dword(priv->pdev, priv->vsec + ALT_CVP_DATA,
+				       val);
+}
+
+static int alt_cvp_wait_status(struct alt_cvp_priv *priv, u32 mask, u32 val,
+			       unsigned long timeout_us)
+{
+	ktime_t start = ktime_get();
+	u32 status;
+
+	for (;;) {
+		status = alt_cvp_read(priv, ALT_CVP_STATUS);
+		if ((status & mask) == val)
+			return 0;
+
+		if (ktime_us_delta(ktime_get(), start) > timeout_us)
+			break;
+
+		usleep_range(ALT_CVP_POLL_MIN_US, ALT_CVP_POLL_MAX_US);
+	}
+
+	dev_err(priv->dev, "timeout waiting for status 0x%x/0x%x, got 0x%x\n",
+		val, mask, status);
+
+	return -ETIMEDOUT;
+}
+
+static int alt_cvp_check_error(struct alt_cvp_priv *priv)
+{
+	u32 status = alt_cvp_read(priv, ALT_CVP_STATUS);
+
+	if (status & ALT_CVP_STATUS_CFG_ERR) {
+		dev_err(priv->dev, "CvP configuration error after %zu bytes\n",
+			priv->written);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static void alt_cvp_set_numclks(struct alt_cvp_priv *priv, u32 numclks)
+{
+	u32 val = alt_cvp_read(priv, ALT_CVP_MODE_CTRL);
+
+	val &= ~ALT_CVP_MODE_CTRL_NUMCLKS_MSK;
+	val |= numclks << ALT_CVP_MODE_CTRL_NUMCLKS_SFT;
+	alt_cvp_write(priv, ALT_CVP_MODE_CTRL, val);
+}
+
+static void alt_cvp_dummy_write(struct alt_cvp_priv *priv)
+{
+	int i;
+
+	alt_cvp_set_numclks(priv, 1);
+
+	for (i = 0; i < ALT_CVP_DUMMY_WRITES; i++)
+		alt_cvp_write_data(priv, 0);
+}
+
+/* Ends a transfer and hands the control block back to the FPGA */
+static int alt_cvp_teardown(struct alt_cvp_priv *priv)
+{
+	u32 val;
+
+	val = alt_cvp_read(priv, ALT_CVP_PROG_CTRL);
+	val &= ~ALT_CVP_PROG_CTRL_START_XFER;
+	alt_cvp_write(priv, ALT_CVP_PROG_CTRL, val);
+
+	val &= ~ALT_CVP_PROG_CTRL_CONFIG;
+	alt_cvp_write(priv, ALT_CVP_PROG_CTRL, val);
+
+	return alt_cvp_wait_status(priv, ALT_CVP_STATUS_CFG_RDY, 0,
+				   ALT_CVP_CFG_RDY_TIMEOUT_US);
+}
+
+static enum fpga_mgr_states alt_cvp_fpga_state(struct fpga_manager *mgr)
+{
+	struct alt_cvp_priv *priv = mgr->priv;
+	u32 status = alt_cvp_read(priv, ALT_CVP_STATUS);
+
+	if (status & ALT_CVP_STATUS_CFG_RDY)
+		return FPGA_MGR_STATE_WRITE;
+
+	if (status & ALT_CVP_STATUS_CFG_ERR)
+		return FPGA_MGR_STATE_WRITE_ERR;
+
+	if (status & ALT_CVP_STATUS_USERMODE)
+		return FPGA_MGR_STATE_OPERATING;
+
+	return FPGA_MGR_STATE_UNKNOWN;
+}
+
+static int alt_cvp_fpga_write_init(struct fpga_manager *mgr,
+				   struct fpga_image_info *info,
+				   const char *buf, size_t count)
+{
+	struct alt_cvp_priv *priv = mgr->priv;
+	u32 status, val;
+	int ret;
+
+	if (info->flags & FPGA_MGR_PARTIAL_RECONFIG) {
+		dev_err(&mgr->dev, "%s Partial Reconfiguration not supported\n",
+			__func__);
+		return -EINVAL;
+	}
+
+	status = alt_cvp_read(priv, ALT_CVP_STATUS);
+	if (!(status & ALT_CVP_STATUS_CVP_EN)) {
+		dev_err(&mgr->dev, "%s CvP not enabled (status 0x%x)\n",
+			__func__, status);
+		return -ENODEV;
+	}
+
+	if (status & ALT_CVP_STATUS_CFG_RDY) {
+		dev_warn(&mgr->dev, "%s CvP already started, tearing down\n",
+			 __func__);
+		ret = alt_cvp_teardown(priv);
+		if (ret)
+			return ret;
+	}
+
+	/* switch the hard IP to the CvP clock and enter CvP mode */
+	val = alt_cvp_read(priv, ALT_CVP_MODE_CTRL);
+	val |= ALT_CVP_MODE_CTRL_HIP_CLK_SEL | ALT_CVP_MODE_CTRL_CVP_MODE;
+	alt_cvp_write(priv, ALT_CVP_MODE_CTRL, val);
+
+	alt_cvp_dummy_write(priv);
+
+	/* request the control block and wait for it to be granted */
+	val = alt_cvp_read(priv, ALT_CVP_PROG_CTRL);
+	val |= ALT_CVP_PROG_CTRL_CONFIG;
+	alt_cvp_write(priv, ALT_CVP_PROG_CTRL, val);
+
+	ret = alt_cvp_wait_status(priv, ALT_CVP_STATUS_CFG_RDY,
+				  ALT_CVP_STATUS_CFG_RDY,
+				  ALT_CVP_CFG_RDY_TIMEOUT_US);
+	if (ret) {
+		/* withdraw the request and go back to normal mode */
+		val = alt_cvp_read(priv, ALT_CVP_PROG_CTRL);
+		val &= ~ALT_CVP_PROG_CTRL_CONFIG;
+		alt_cvp_write(priv, ALT_CVP_PROG_CTRL, val);
+
+		val = alt_cvp_read(priv, ALT_CVP_MODE_CTRL);
+		val &= ~(ALT_CVP_MODE_CTRL_HIP_CLK_SEL |
+			 ALT_CVP_MODE_CTRL_CVP_MODE);
+		alt_cvp_write(priv, ALT_CVP_MODE_CTRL, val);
+		return ret;
+	}
+
+	alt_cvp_dummy_write(priv);
+
+	val = alt_cvp_read(priv, ALT_CVP_PROG_CTRL);
+	val |= ALT_CVP_PROG_CTRL_START_XFER;
+	alt_cvp_write(priv, ALT_CVP_PROG_CTRL, val);
+
+	/* one clock per data write for uncompressed, unencrypted images */
+	alt_cvp_set_numclks(priv, 1);
+
+	priv->sent_blocks = 0;
+	priv->written = 0;
+
+	return 0;
+}
+
+/* Version 2 endpoints grant one credit per 4 KB block they can accept */
+static int alt_cvp_wait_credit(struct alt_cvp_priv *priv)
+{
+	ktime_t start = ktime_get();
+	u8 credits;
+	int ret;
+
+	for (;;) {
+		pci_read_config_byte(priv->pdev, priv->vsec + ALT_CVP_TX_CREDITS,
+				     &credits);
+		if ((u8)(credits - priv->sent_blocks))
+			return 0;
+
+		ret = alt_cvp_check_error(priv);
+		if (ret)
+			return ret;
+
+		if (ktime_us_delta(ktime_get(), start) >
+		    ALT_CVP_CREDIT_TIMEOUT_US)
+			break;
+
+		usleep_range(ALT_CVP_POLL_MIN_US, ALT_CVP_POLL_MAX_US);
+	}
+
+	dev_err(priv->dev, "timeout waiting for CvP credit\n");
+
+	return -ETIMEDOUT;
+}
+
+static int alt_cvp_fpga_write(struct fpga_manager *mgr, const char *buf,
+			      size_t count)
+{
+	struct alt_cvp_priv *priv = mgr->priv;
+	size_t len, i;
+	u32 last;
+	int ret;
+
+	while (count) {
+		len = min_t(size_t, count, ALT_CVP_BLOCK_SIZE);
+
+		if (priv->version >= 2 && !priv->sim) {
+			ret = alt_cvp_wait_credit(priv);
+			if (ret)
+				return ret;
+		}
+
+		for (i = 0; i + sizeof(u32) <= len; i += sizeof(u32))
+			alt_cvp_write_data(priv, *(u32 *)(buf + i));
+
+		if (i < len) {
+			last = 0;
+			memcpy(&last, buf + i, len - i);
+			alt_cvp_write_data(priv, last);
+		}
+
+		if (priv->sim && cvp_sim_block_us)
+			usleep_range(cvp_sim_block_us, cvp_sim_block_us + 1);
+
+		priv->sent_blocks++;
+		priv->written += len;
+		buf += len;
+		count -= len;
+
+		ret = alt_cvp_check_error(priv);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int alt_cvp_fpga_write_complete(struct fpga_manager *mgr,
+				       struct fpga_image_info *info)
+{
+	struct alt_cvp_priv *priv = mgr->priv;
+	unsigned long timeout_us = ALT_CVP_USERMODE_TIMEOUT_US;
+	u32 mask, val;
+	int ret;
+
+	ret = alt_cvp_teardown(priv);
+	if (ret)
+		return ret;
+
+	ret = alt_cvp_check_error(priv);
+	if (ret)
+		return ret;
+
+	/* leave CvP mode and go back to the fabric clock */
+	val = alt_cvp_read(priv, ALT_CVP_MODE_CTRL);
+	val &= ~(ALT_CVP_MODE_CTRL_HIP_CLK_SEL | ALT_CVP_MODE_CTRL_CVP_MODE);
+	alt_cvp_write(priv, ALT_CVP_MODE_CTRL, val);
+
+	if (info->config_complete_timeout_us)
+		timeout_us = info->config_complete_timeout_us;
+
+	mask = ALT_CVP_STATUS_USERMODE | ALT_CVP_STATUS_PLD_CLK_IN_USE;
+	ret = alt_cvp_wait_status(priv, mask, mask, timeout_us);
+	if (ret)
+		return ret;
+
+	dev_info(&mgr->dev, "successful configuration of %zu bytes\n",
+		 priv->written);
+
+	return 0;
+}
+
+static const struct fpga_manager_ops alt_cvp_ops = {
+	.state = alt_cvp_fpga_state,
+	.write_init = alt_cvp_fpga_write_init,
+	.write = alt_cvp_fpga_write,
+	.write_complete = alt_cvp_fpga_write_complete,
+};
+
+static bool alt_cvp_is_vsec(struct pci_dev *pdev, u16 pos)
+{
+	u32 hdr = 0;
+
+	pci_read_config_dword(pdev, pos + ALT_CVP_VSEC_HDR, &hdr);
+
+	return (hdr & ALT_CVP_VSEC_HDR_ID_MSK) == ALT_CVP_VSEC_ID;
+}
+
+/*
+ * Arria 10 designs carry the CvP registers in the Altera defined vendor
+ * specific capability at a fixed offset; later devices may place it
+ * anywhere among other vendor specific capabilities, and report a newer
+ * revision in its header.  Returns 0 when there is no CvP capability.
+ */
+static u16 alt_cvp_find_vsec(struct pci_dev *pdev)
+{
+	u16 pos = 0;
+
+	if (alt_cvp_is_vsec(pdev, ALT_CVP_V1_VSEC_OFFSET))
+		return ALT_CVP_V1_VSEC_OFFSET;
+
+	while ((pos = pci_find_next_ext_capability(pdev, pos,
+						   PCI_EXT_CAP_ID_VNDR)))
+		if (alt_cvp_is_vsec(pdev, pos))
+			return pos;
+
+	return 0;
+}
+
+int alt_cvp_probe(struct device *dev, void __iomem *reg_base)
+{
+	struct alt_cvp_priv *priv;
+	u32 hdr, status;
+
+	if (!dev->parent || !dev_is_pci(dev->parent))
+		return -EINVAL;
+
+	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->dev = dev;
+	priv->pdev = to_pci_dev(dev->parent);
+	priv->map = reg_base;
+	priv->sim = cvp_sim;
+
+	if (priv->sim) {
+		priv->version = 1;
+		priv->sim_regs[ALT_CVP_STATUS / 4] = ALT_CVP_STATUS_CVP_EN |
+						     ALT_CVP_STATUS_USERMODE |
+						     ALT_CVP_STATUS_PLD_CLK_IN_USE;
+		dev_info(dev, "%s emulating CvP endpoint\n", __func__);
+	} else {
+		priv->vsec = alt_cvp_find_vsec(priv->pdev);
+		if (!priv->vsec) {
+			dev_info(dev, "%s no CvP capability\n", __func__);
+			return -ENODEV;
+		}
+
+		hdr = alt_cvp_read(priv, ALT_CVP_VSEC_HDR);
+		priv->version = (hdr & ALT_CVP_VSEC_HDR_REV_MSK) >>
+				ALT_CVP_VSEC_HDR_REV_SFT;
+		if (priv->version < 2)
+			priv->version = 1;
+
+		status = alt_cvp_read(priv, ALT_CVP_STATUS);
+		if (!(status & ALT_CVP_STATUS_CVP_EN)) {
+			dev_info(dev, "%s CvP not enabled (status 0x%x)\n",
+				 __func__, status);
+			return -ENODEV;
+		}
+
+		dev_info(dev, "%s vsec=0x%x version=%d status=0x%x\n",
+			 __func__, priv->vsec, priv->version, status);
+	}
+
+	return fpga_mgr_register(dev, dev_name(dev), &alt_cvp_ops, priv);
+}
+EXPORT_SYMBOL_GPL(alt_cvp_probe);
+
+int alt_cvp_remove(struct device *dev)
+{
+	dev_dbg(dev, "%s\n", __func__);
+
+	fpga_mgr_unregister(dev);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(alt_cvp_remove);
+
+MODULE_DESCRIPTION("Altera Configuration via Protocol");
+MODULE_LICENSE("GPL v2");
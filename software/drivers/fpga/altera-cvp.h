@@ -0,0 +1,31 @@
+/*
+ * Driver for Altera Configuration via Protocol (CvP)
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALT_CVP_H
+#define _ALT_CVP_H
+#include <linux/io.h>
+
+/*
+ * dev must be a child of the PCIe device of the card.  reg_base, if not NULL,
+ * is a memory window on the card that CvP data can be written to, which is
+ * faster than writing it through config space.
+ */
+int alt_cvp_probe(struct device *dev, void __iomem *reg_base);
+int alt_cvp_remove(struct device *dev);
+
+#endif /* _ALT_CVP_H */
@@ -0,0 +1,257 @@
+/*
+ * Driver for Altera Partial Reconfiguration Region Controller Freeze Bridge
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * Based on altera-freeze-bridge.c Copyright (C) 2016 Altera Corporation
+ *  by Alan Tull <atull@opensource.altera.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "altera-freeze-bridge.h"
+#include <linux/delay.h>
+#include <linux/fpga/fpga-bridge.h>
+#include <linux/module.h>
+
+#define FREEZE_CSR_STATUS_OFFSET		0
+#define FREEZE_CSR_CTRL_OFFSET			4
+#define FREEZE_CSR_ILLEGAL_REQ_OFFSET		8
+#define FREEZE_CSR_REG_VERSION			12
+
+#define FREEZE_CSR_SUPPORTED_VERSION		0xad000003
+
+#define FREEZE_CSR_STATUS_FREEZE_REQ_DONE	BIT(0)
+#define FREEZE_CSR_STATUS_UNFREEZE_REQ_DONE	BIT(1)
+
+#define FREEZE_CSR_CTRL_FREEZE_REQ		BIT(0)
+#define FREEZE_CSR_CTRL_RESET_REQ		BIT(1)
+#define FREEZE_CSR_CTRL_UNFREEZE_REQ		BIT(2)
+
+#define FREEZE_BRIDGE_NAME			"freeze"
+
+/* Used when the image info does not provide bridge timeouts */
+#define FREEZE_DEFAULT_TIMEOUT_US		1000
+
+struct alt_freeze_br_data {
+	struct device *dev;
+	void __iomem *base_addr;
+	bool enable;
+};
+
+static int alt_freeze_br_req_ack(struct alt_freeze_br_data *priv,
+				 u32 timeout, u32 req_ack)
+{
+	void __iomem *csr_illegal_req_addr = priv->base_addr +
+					     FREEZE_CSR_ILLEGAL_REQ_OFFSET;
+	u32 status, illegal, ctrl;
+	int ret = -ETIMEDOUT;
+
+	do {
+		illegal = readl(csr_illegal_req_addr);
+		if (illegal) {
+			dev_err(priv->dev, "illegal request detected 0x%x\n",
+				illegal);
+
+			writel(1, csr_illegal_req_addr);
+
+			illegal = readl(csr_illegal_req_addr);
+			if (illegal)
+				dev_err(priv->dev, "illegal request not cleared 0x%x\n",
+					illegal);
+
+			ret = -EINVAL;
+			break;
+		}
+
+		status = readl(priv->base_addr + FREEZE_CSR_STATUS_OFFSET);
+		dev_dbg(priv->dev, "%s %x %x\n", __func__, status, req_ack);
+		status &= req_ack;
+		if (status) {
+			ctrl = readl(priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+			dev_dbg(priv->dev, "%s request %x acknowledged %x %x\n",
+				__func__, req_ack, status, ctrl);
+			ret = 0;
+			break;
+		}
+
+		udelay(1);
+	} while (timeout--);
+
+	if (ret == -ETIMEDOUT)
+		dev_err(priv->dev, "%s timeout waiting for 0x%x\n",
+			__func__, req_ack);
+
+	return ret;
+}
+
+/*
+ * Asserts freeze and then reset on the PR region, so that no transactions
+ * reach the static region while the persona is being replaced.
+ */
+static int alt_freeze_br_do_freeze(struct alt_freeze_br_data *priv,
+				   u32 timeout)
+{
+	u32 status;
+	int ret;
+
+	status = readl(priv->base_addr + FREEZE_CSR_STATUS_OFFSET);
+
+	dev_dbg(priv->dev, "%s %d %d\n", __func__, status,
+		readl(priv->base_addr + FREEZE_CSR_CTRL_OFFSET));
+
+	if (status & FREEZE_CSR_STATUS_FREEZE_REQ_DONE) {
+		dev_dbg(priv->dev, "%s bridge already disabled %d\n",
+			__func__, status);
+		return 0;
+	} else if (!(status & FREEZE_CSR_STATUS_UNFREEZE_REQ_DONE)) {
+		dev_err(priv->dev, "%s bridge not enabled %d\n",
+			__func__, status);
+		return -EINVAL;
+	}
+
+	writel(FREEZE_CSR_CTRL_FREEZE_REQ,
+	       priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+
+	ret = alt_freeze_br_req_ack(priv, timeout,
+				    FREEZE_CSR_STATUS_FREEZE_REQ_DONE);
+	if (ret)
+		writel(0, priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+	else
+		writel(FREEZE_CSR_CTRL_RESET_REQ,
+		       priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+
+	return ret;
+}
+
+/*
+ * Releases reset and then freeze on the PR region once the new persona is
+ * in place.
+ */
+static int alt_freeze_br_do_unfreeze(struct alt_freeze_br_data *priv,
+				     u32 timeout)
+{
+	u32 status;
+	int ret;
+
+	writel(0, priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+
+	status = readl(priv->base_addr + FREEZE_CSR_STATUS_OFFSET);
+
+	dev_dbg(priv->dev, "%s %d %d\n", __func__, status,
+		readl(priv->base_addr + FREEZE_CSR_CTRL_OFFSET));
+
+	if (status & FREEZE_CSR_STATUS_UNFREEZE_REQ_DONE) {
+		dev_dbg(priv->dev, "%s bridge already enabled %d\n",
+			__func__, status);
+		return 0;
+	} else if (!(status & FREEZE_CSR_STATUS_FREEZE_REQ_DONE)) {
+		dev_err(priv->dev, "%s bridge not frozen %d\n",
+			__func__, status);
+		return -EINVAL;
+	}
+
+	writel(FREEZE_CSR_CTRL_UNFREEZE_REQ,
+	       priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+
+	ret = alt_freeze_br_req_ack(priv, timeout,
+				    FREEZE_CSR_STATUS_UNFREEZE_REQ_DONE);
+
+	writel(0, priv->base_addr + FREEZE_CSR_CTRL_OFFSET);
+
+	return ret;
+}
+
+/*
+ * enable = 1 : allow traffic through the bridge
+ * enable = 0 : disable traffic through the bridge
+ */
+static int alt_freeze_br_enable_set(struct fpga_bridge *bridge,
+				    bool enable)
+{
+	struct alt_freeze_br_data *priv = bridge->priv;
+	struct fpga_image_info *info = bridge->info;
+	u32 timeout = FREEZE_DEFAULT_TIMEOUT_US;
+	int ret;
+
+	if (enable) {
+		if (info && info->enable_timeout_us)
+			timeout = info->enable_timeout_us;
+
+		ret = alt_freeze_br_do_unfreeze(priv, timeout);
+	} else {
+		if (info && info->disable_timeout_us)
+			timeout = info->disable_timeout_us;
+
+		ret = alt_freeze_br_do_freeze(priv, timeout);
+	}
+
+	if (!ret)
+		priv->enable = enable;
+
+	return ret;
+}
+
+static int alt_freeze_br_enable_show(struct fpga_bridge *bridge)
+{
+	struct alt_freeze_br_data *priv = bridge->priv;
+
+	return priv->enable;
+}
+
+static const struct fpga_bridge_ops altera_freeze_br_br_ops = {
+	.enable_set = alt_freeze_br_enable_set,
+	.enable_show = alt_freeze_br_enable_show,
+};
+
+int alt_freeze_br_probe(struct device *dev, void __iomem *reg_base)
+{
+	struct alt_freeze_br_data *priv;
+	u32 status, revision;
+
+	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->dev = dev;
+	priv->base_addr = reg_base;
+
+	revision = readl(priv->base_addr + FREEZE_CSR_REG_VERSION);
+	if (revision != FREEZE_CSR_SUPPORTED_VERSION) {
+		dev_err(dev, "%s unsupported region controller version 0x%08x\n",
+			__func__, revision);
+		return -EINVAL;
+	}
+
+	/* Enabled unless frozen, which a freshly configured region is not */
+	status = readl(priv->base_addr + FREEZE_CSR_STATUS_OFFSET);
+	priv->enable = !(status & FREEZE_CSR_STATUS_FREEZE_REQ_DONE);
+
+	dev_info(dev, "%s status=0x%x ver=0x%x\n", __func__, status, revision);
+
+	return fpga_bridge_register(dev, FREEZE_BRIDGE_NAME,
+				    &altera_freeze_br_br_ops, priv);
+}
+EXPORT_SYMBOL_GPL(alt_freeze_br_probe);
+
+int alt_freeze_br_remove(struct device *dev)
+{
+	dev_dbg(dev, "%s\n", __func__);
+
+	fpga_bridge_unregister(dev);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(alt_freeze_br_remove);
+
+MODULE_DESCRIPTION("Altera Freeze Bridge");
+MODULE_LICENSE("GPL v2");
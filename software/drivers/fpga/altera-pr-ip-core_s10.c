@@ -354,6 +354,7 @@ static int alt_pr_fpga_write_complete(struct fpga_manager *mgr,
 }
 
 static const struct fpga_manager_ops alt_pr_ops = {
+	.initial_header_size = ALT_PR_RBF_ID_OFST + sizeof(u32),
 	.state = alt_pr_fpga_state,
 	.write_init = alt_pr_fpga_write_init,
 	.write = alt_pr_fpga_write,
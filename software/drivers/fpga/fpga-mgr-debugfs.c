@@ -16,9 +16,13 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <linux/debugfs.h>
+#include <linux/err.h>
 #include <linux/fpga/fpga-mgr.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include "fpga-mgr-pool.h"
 
 static struct dentry *fpga_mgr_debugfs_root;
 
@@ -28,6 +32,15 @@ struct fpga_mgr_debugfs {
 	struct fpga_image_info info;
 };
 
+/*
+ * Loads through debugfs take the manager exclusively, like region and CvP
+ * loads do, and are refused with -EBUSY while one of those is in progress.
+ */
+static int fpga_mgr_debugfs_get(struct fpga_manager *mgr)
+{
+	return PTR_ERR_OR_ZERO(fpga_mgr_get(mgr->dev.parent));
+}
+
 static ssize_t fpga_mgr_firmware_write_file(struct file *file,
 					    const char __user *user_buf,
 					    size_t count, loff_t *ppos)
@@ -48,10 +61,17 @@ static ssize_t fpga_mgr_firmware_write_file(struct file *file,
 	if (buf[count - 1] == '\n')
 		buf[count - 1] = 0;
 
+	ret = fpga_mgr_debugfs_get(mgr);
+	if (ret) {
+		kfree(buf);
+		return ret;
+	}
+
 	kfree(debugfs->firmware_name);
 	debugfs->firmware_name = buf;
 
 	ret = fpga_mgr_firmware_load(mgr, &debugfs->info, buf);
+	fpga_mgr_put(mgr);
 	if (ret) {
 		dev_err(&mgr->dev,
 			"fpga_mgr_firmware_load returned with value %d\n", ret);
@@ -96,32 +116,172 @@ static const struct file_operations fpga_mgr_firmware_fops = {
 	.llseek = default_llseek,
 };
 
+/*
+ * Stream an image from a file (or FIFO) given by path, without holding the
+ * whole image in memory.
+ */
+static ssize_t fpga_mgr_image_file_write_file(struct file *file,
+					      const char __user *user_buf,
+					      size_t count, loff_t *ppos)
+{
+	struct fpga_manager *mgr = file->private_data;
+	struct fpga_mgr_debugfs *debugfs = mgr->debugfs;
+	char *path;
+	int ret;
+
+	path = memdup_user_nul(user_buf, count);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	strim(path);
+
+	ret = fpga_mgr_debugfs_get(mgr);
+	if (ret) {
+		kfree(path);
+		return ret;
+	}
+
+	ret = fpga_mgr_file_load(mgr, &debugfs->info, path);
+	fpga_mgr_put(mgr);
+	if (ret)
+		dev_err(&mgr->dev,
+			"fpga_mgr_file_load returned with value %d\n", ret);
+
+	kfree(path);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations fpga_mgr_image_file_fops = {
+	.open = simple_open,
+	.write = fpga_mgr_image_file_write_file,
+	.llseek = default_llseek,
+};
+
+/*
+ * Copy the image into chunks of the manager's staging pool.  Returns -ENOMEM
+ * without copying anything when the pool has no room for the image.
+ */
+static int fpga_mgr_image_pool_load(struct fpga_manager *mgr,
+				    const char __user *user_buf, size_t count)
+{
+	struct fpga_mgr_debugfs *debugfs = mgr->debugfs;
+	struct scatterlist *sg;
+	struct sg_table sgt;
+	size_t done = 0;
+	int i, ret;
+
+	ret = fpga_mgr_pool_alloc_sgt(mgr, &sgt, count);
+	if (ret)
+		return ret;
+
+	for_each_sg(sgt.sgl, sg, sgt.nents, i) {
+		if (copy_from_user(sg_virt(sg), user_buf + done, sg->length)) {
+			ret = -EFAULT;
+			goto err_free;
+		}
+		done += sg->length;
+	}
+
+	ret = fpga_mgr_buf_load_sg(mgr, &debugfs->info, &sgt);
+
+err_free:
+	fpga_mgr_pool_free_sgt(mgr, &sgt);
+
+	return ret;
+}
+
+/*
+ * Copy the image from user space a page at a time so that large images do
+ * not need a large physically contiguous buffer.  Only used for buffers that
+ * cannot be written from in place.  The copy is made in the staging pool when
+ * it has room, otherwise in pages allocated on the node of the card.
+ */
+static int fpga_mgr_image_copy_load(struct fpga_manager *mgr,
+				    const char __user *user_buf, size_t count)
+{
+	struct fpga_mgr_debugfs *debugfs = mgr->debugfs;
+	struct page **pages;
+	struct sg_table sgt;
+	size_t len, done;
+	int nr_pages, i;
+	int ret;
+
+	ret = fpga_mgr_image_pool_load(mgr, user_buf, count);
+	if (ret != -ENOMEM)
+		return ret;
+
+	nr_pages = DIV_ROUND_UP(count, PAGE_SIZE);
+	pages = vzalloc_node(nr_pages * sizeof(*pages), fpga_mgr_node(mgr));
+	if (!pages)
+		return -ENOMEM;
+
+	for (i = 0, done = 0; i < nr_pages; i++, done += len) {
+		len = min_t(size_t, count - done, PAGE_SIZE);
+
+		pages[i] = alloc_pages_node(fpga_mgr_node(mgr), GFP_KERNEL, 0);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto err_free_pages;
+		}
+
+		if (copy_from_user(page_address(pages[i]), user_buf + done,
+				   len)) {
+			ret = -EFAULT;
+			goto err_free_pages;
+		}
+	}
+
+	ret = sg_alloc_table_from_pages(&sgt, pages, nr_pages, 0, count,
+					GFP_KERNEL);
+	if (ret)
+		goto err_free_pages;
+
+	ret = fpga_mgr_buf_load_sg(mgr, &debugfs->info, &sgt);
+
+	sg_free_table(&sgt);
+
+err_free_pages:
+	for (i = 0; i < nr_pages && pages[i]; i++)
+		__free_page(pages[i]);
+	vfree(pages);
+
+	return ret;
+}
+
 static ssize_t fpga_mgr_image_write_file(struct file *file,
 					 const char __user *user_buf,
 					 size_t count, loff_t *ppos)
 {
 	struct fpga_manager *mgr = file->private_data;
 	struct fpga_mgr_debugfs *debugfs = mgr->debugfs;
-	char *buf;
 	int ret;
 
 	dev_info(&mgr->dev, "writing %zu bytes to %s\n", count, mgr->name);
 
-	buf = kzalloc(count, GFP_KERNEL);
-	if (!buf)
-		return -ENOMEM;
+	if (!count)
+		return -EINVAL;
 
-	if (copy_from_user(buf, user_buf, count))
-		return -EFAULT;
+	ret = fpga_mgr_debugfs_get(mgr);
+	if (ret)
+		return ret;
 
 	/* If firmware interface was previously used, forget it. */
 	kfree(debugfs->firmware_name);
 	debugfs->firmware_name = NULL;
 
-	ret = fpga_mgr_buf_load(mgr, &debugfs->info, buf, count);
-	if (ret)
+	if (IS_ALIGNED((unsigned long)user_buf, sizeof(u32)))
+		ret = fpga_mgr_user_load(mgr, &debugfs->info, user_buf, count);
+	else
+		ret = fpga_mgr_image_copy_load(mgr, user_buf, count);
+
+	fpga_mgr_put(mgr);
+
+	if (ret) {
 		dev_err(&mgr->dev,
-		       "fpga_mgr_buf_load returned with value %d\n", ret);
+			"fpga_mgr_buf_load returned with value %d\n", ret);
+		return ret;
+	}
 
 	return count;
 }
@@ -132,6 +292,25 @@ static const struct file_operations fpga_mgr_image_fops = {
 	.llseek = default_llseek,
 };
 
+static int fpga_mgr_pool_seq_show(struct seq_file *s, void *data)
+{
+	fpga_mgr_pool_show(s->private, s);
+
+	return 0;
+}
+
+static int fpga_mgr_pool_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fpga_mgr_pool_seq_show, inode->i_private);
+}
+
+static const struct file_operations fpga_mgr_pool_fops = {
+	.open = fpga_mgr_pool_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 void fpga_mgr_debugfs_add(struct fpga_manager *mgr)
 {
 	struct fpga_mgr_debugfs *debugfs;
@@ -153,6 +332,12 @@ void fpga_mgr_debugfs_add(struct fpga_manager *mgr)
 	debugfs_create_file("image", 0200, debugfs->debugfs_dir, mgr,
 			    &fpga_mgr_image_fops);
 
+	debugfs_create_file("image_file", 0200, debugfs->debugfs_dir, mgr,
+			    &fpga_mgr_image_file_fops);
+
+	debugfs_create_file("pool", 0400, debugfs->debugfs_dir, mgr,
+			    &fpga_mgr_pool_fops);
+
 	info = &debugfs->info;
 	debugfs_create_u32("flags", 0600, debugfs->debugfs_dir, &info->flags);
 	debugfs_create_u32("enable_to", 0600, debugfs->debugfs_dir,
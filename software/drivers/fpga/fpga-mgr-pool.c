@@ -0,0 +1,285 @@
+/*
+ * FPGA Manager staging pool
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Image data is staged in kernel memory before it is written to the card:
+ * the chunk buffers of a streaming load and the copy of an image written to
+ * debugfs.  Allocating that memory for every load costs time on the load path
+ * and, from vmalloc, gives buffers mapped a 4K page at a time.
+ *
+ * Instead each manager reserves its staging memory once, at registration, as
+ * physically contiguous 2M blocks on the node of its device.  Kernel memory
+ * is never swapped out, and on architectures that map the kernel's linear
+ * mapping with huge pages (x86_64 among them) a block is covered by a single
+ * TLB entry.  Loads then only take units out of a bitmap.
+ */
+
+#include <linux/bitmap.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include "fpga-mgr-pool.h"
+
+static unsigned int pool_kb = 2048;
+module_param(pool_kb, uint, 0444);
+MODULE_PARM_DESC(pool_kb,
+		 "Staging memory reserved per FPGA manager in KB, rounded up to 2M blocks, 0 to disable (default 2048)");
+
+#define FPGA_MGR_POOL_ORDER	get_order(FPGA_MGR_POOL_BLOCK_SIZE)
+#define FPGA_MGR_POOL_UNITS	(FPGA_MGR_POOL_BLOCK_SIZE / FPGA_MGR_POOL_UNIT_SIZE)
+
+struct fpga_mgr_pool {
+	spinlock_t lock;
+	int node;
+	unsigned int nr_blocks;
+	struct page **blocks;
+	unsigned long *map;
+	size_t used;
+	size_t peak;
+	unsigned long allocs;
+	unsigned long fallbacks;
+};
+
+/**
+ * fpga_mgr_pool_init - reserve the staging memory of a manager
+ * @mgr:	fpga manager
+ * @node:	NUMA node to take the memory from
+ *
+ * Blocks that cannot be allocated are left out, the pool is then smaller than
+ * asked for and loads fall back to vmalloc sooner.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_mgr_pool_init(struct fpga_manager *mgr, int node)
+{
+	struct fpga_mgr_pool *pool;
+	unsigned int nr_blocks, i;
+	struct page *page;
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, node);
+	if (!pool)
+		return -ENOMEM;
+
+	spin_lock_init(&pool->lock);
+	pool->node = node;
+	mgr->pool = pool;
+
+	nr_blocks = DIV_ROUND_UP(pool_kb, FPGA_MGR_POOL_BLOCK_SIZE / SZ_1K);
+	if (!nr_blocks)
+		return 0;
+
+	pool->blocks = kcalloc_node(nr_blocks, sizeof(*pool->blocks),
+				    GFP_KERNEL, node);
+	pool->map = kcalloc_node(BITS_TO_LONGS(nr_blocks * FPGA_MGR_POOL_UNITS),
+				 sizeof(long), GFP_KERNEL, node);
+	if (!pool->blocks || !pool->map) {
+		fpga_mgr_pool_uninit(mgr);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr_blocks; i++) {
+		page = alloc_pages_node(node, GFP_KERNEL | __GFP_NOWARN,
+					FPGA_MGR_POOL_ORDER);
+		if (!page)
+			break;
+		pool->blocks[pool->nr_blocks++] = page;
+	}
+
+	if (pool->nr_blocks < nr_blocks)
+		dev_warn(mgr->dev.parent,
+			 "staging pool has %u of %u blocks\n",
+			 pool->nr_blocks, nr_blocks);
+
+	return 0;
+}
+
+void fpga_mgr_pool_uninit(struct fpga_manager *mgr)
+{
+	struct fpga_mgr_pool *pool = mgr->pool;
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	WARN_ON(pool->used);
+
+	for (i = 0; i < pool->nr_blocks; i++)
+		__free_pages(pool->blocks[i], FPGA_MGR_POOL_ORDER);
+	kfree(pool->map);
+	kfree(pool->blocks);
+	kfree(pool);
+	mgr->pool = NULL;
+}
+
+/* First fit, within one block */
+static void *fpga_mgr_pool_take(struct fpga_mgr_pool *pool, size_t size)
+{
+	unsigned int units = DIV_ROUND_UP(size, FPGA_MGR_POOL_UNIT_SIZE);
+	unsigned long start, end;
+	void *buf = NULL;
+	unsigned int i;
+
+	if (!pool || size > FPGA_MGR_POOL_BLOCK_SIZE)
+		return NULL;
+
+	spin_lock(&pool->lock);
+	for (i = 0; i < pool->nr_blocks; i++) {
+		end = (i + 1) * FPGA_MGR_POOL_UNITS;
+		start = bitmap_find_next_zero_area(pool->map, end,
+						   i * FPGA_MGR_POOL_UNITS,
+						   units, 0);
+		if (start + units > end)
+			continue;
+
+		bitmap_set(pool->map, start, units);
+		buf = page_address(pool->blocks[i]) +
+		      (start - i * FPGA_MGR_POOL_UNITS) * FPGA_MGR_POOL_UNIT_SIZE;
+
+		pool->used += units * FPGA_MGR_POOL_UNIT_SIZE;
+		pool->peak = max(pool->peak, pool->used);
+		pool->allocs++;
+		break;
+	}
+	spin_unlock(&pool->lock);
+
+	return buf;
+}
+
+static void fpga_mgr_pool_put(struct fpga_mgr_pool *pool, void *buf,
+			      size_t size)
+{
+	unsigned int units = DIV_ROUND_UP(size, FPGA_MGR_POOL_UNIT_SIZE);
+	void *block;
+	unsigned int i;
+
+	spin_lock(&pool->lock);
+	for (i = 0; i < pool->nr_blocks; i++) {
+		block = page_address(pool->blocks[i]);
+		if (buf < block || buf >= block + FPGA_MGR_POOL_BLOCK_SIZE)
+			continue;
+
+		bitmap_clear(pool->map, i * FPGA_MGR_POOL_UNITS +
+			     (buf - block) / FPGA_MGR_POOL_UNIT_SIZE, units);
+		pool->used -= units * FPGA_MGR_POOL_UNIT_SIZE;
+		break;
+	}
+	spin_unlock(&pool->lock);
+
+	WARN_ON(i == pool->nr_blocks);
+}
+
+/**
+ * fpga_mgr_pool_alloc - get a staging buffer
+ * @mgr:	fpga manager
+ * @size:	size of the buffer in bytes
+ *
+ * Return: the buffer, from the pool if it has room and from vmalloc otherwise,
+ * or NULL.  Free it with fpga_mgr_pool_free() and the same @size.
+ */
+void *fpga_mgr_pool_alloc(struct fpga_manager *mgr, size_t size)
+{
+	struct fpga_mgr_pool *pool = mgr->pool;
+	void *buf;
+
+	buf = fpga_mgr_pool_take(pool, size);
+	if (buf)
+		return buf;
+
+	if (pool) {
+		spin_lock(&pool->lock);
+		pool->fallbacks++;
+		spin_unlock(&pool->lock);
+	}
+
+	return vmalloc_node(size, pool ? pool->node : NUMA_NO_NODE);
+}
+
+void fpga_mgr_pool_free(struct fpga_manager *mgr, void *buf, size_t size)
+{
+	if (!buf)
+		return;
+
+	if (is_vmalloc_addr(buf))
+		vfree(buf);
+	else
+		fpga_mgr_pool_put(mgr->pool, buf, size);
+}
+
+int fpga_mgr_pool_alloc_sgt(struct fpga_manager *mgr, struct sg_table *sgt,
+			    size_t size)
+{
+	struct scatterlist *sg;
+	size_t len, done = 0;
+	void *buf;
+	int i, ret;
+
+	if (!mgr->pool || !mgr->pool->nr_blocks)
+		return -ENOMEM;
+
+	ret = sg_alloc_table(sgt, DIV_ROUND_UP(size, FPGA_MGR_POOL_BLOCK_SIZE),
+			     GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	for_each_sg(sgt->sgl, sg, sgt->orig_nents, i) {
+		len = min_t(size_t, size - done, FPGA_MGR_POOL_BLOCK_SIZE);
+		buf = fpga_mgr_pool_take(mgr->pool, len);
+		if (!buf) {
+			fpga_mgr_pool_free_sgt(mgr, sgt);
+			return -ENOMEM;
+		}
+		sg_set_buf(sg, buf, len);
+		done += len;
+	}
+
+	return 0;
+}
+
+void fpga_mgr_pool_free_sgt(struct fpga_manager *mgr, struct sg_table *sgt)
+{
+	struct scatterlist *sg;
+	int i;
+
+	/* entries not filled in yet, after a failed alloc, have no length */
+	for_each_sg(sgt->sgl, sg, sgt->orig_nents, i)
+		if (sg->length)
+			fpga_mgr_pool_put(mgr->pool, sg_virt(sg), sg->length);
+	sg_free_table(sgt);
+}
+
+void fpga_mgr_pool_show(struct fpga_manager *mgr, struct seq_file *s)
+{
+	struct fpga_mgr_pool *pool = mgr->pool;
+
+	if (!pool)
+		return;
+
+	spin_lock(&pool->lock);
+	seq_printf(s, "node: %d\n", pool->node);
+	seq_printf(s, "blocks: %u\n", pool->nr_blocks);
+	seq_printf(s, "size_kb: %lu\n", (unsigned long)pool->nr_blocks *
+		   (FPGA_MGR_POOL_BLOCK_SIZE / SZ_1K));
+	seq_printf(s, "used_kb: %zu\n", pool->used / SZ_1K);
+	seq_printf(s, "peak_kb: %zu\n", pool->peak / SZ_1K);
+	seq_printf(s, "allocs: %lu\n", pool->allocs);
+	seq_printf(s, "fallbacks: %lu\n", pool->fallbacks);
+	spin_unlock(&pool->lock);
+}
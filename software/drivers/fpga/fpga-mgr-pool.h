@@ -0,0 +1,54 @@
+/*
+ * FPGA Manager staging pool
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FPGA_MGR_POOL_H
+#define _FPGA_MGR_POOL_H
+
+#include <linux/fpga/fpga-mgr.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+
+/*
+ * Every manager reserves blocks of FPGA_MGR_POOL_BLOCK_SIZE bytes on the node
+ * of its device when it is registered.  Buffers are handed out from the blocks
+ * in units of FPGA_MGR_POOL_UNIT_SIZE and never span two blocks.  When the
+ * pool is exhausted, or a buffer is larger than a block, memory is taken from
+ * vmalloc instead and counted as a fallback.
+ */
+#define FPGA_MGR_POOL_BLOCK_SIZE	SZ_2M
+#define FPGA_MGR_POOL_UNIT_SIZE		SZ_64K
+
+int fpga_mgr_pool_init(struct fpga_manager *mgr, int node);
+void fpga_mgr_pool_uninit(struct fpga_manager *mgr);
+
+void *fpga_mgr_pool_alloc(struct fpga_manager *mgr, size_t size);
+void fpga_mgr_pool_free(struct fpga_manager *mgr, void *buf, size_t size);
+
+/*
+ * Buffers for a whole image, as a table of pool chunks.  Unlike
+ * fpga_mgr_pool_alloc() this does not fall back to vmalloc: -ENOMEM means
+ * the pool does not have room for @size bytes right now.
+ */
+int fpga_mgr_pool_alloc_sgt(struct fpga_manager *mgr, struct sg_table *sgt,
+			    size_t size);
+void fpga_mgr_pool_free_sgt(struct fpga_manager *mgr, struct sg_table *sgt);
+
+void fpga_mgr_pool_show(struct fpga_manager *mgr, struct seq_file *s);
+
+#endif /* _FPGA_MGR_POOL_H */
@@ -18,79 +18,524 @@
  * You should have received a copy of the GNU General Public License along with
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <linux/completion.h>
 #include <linux/firmware.h>
+#include <linux/fs.h>
+#include <linux/highmem.h>
+#include <linux/fpga/fpga-bridge.h>
 #include <linux/fpga/fpga-mgr.h>
+#include <linux/fpga/fpga-region.h>
 #include <linux/idr.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/mutex.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
+#include <linux/time.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include "fpga-mgr-debugfs.h"
+#include "fpga-mgr-pool.h"
 
 static DEFINE_IDA(fpga_mgr_ida);
 static struct class *fpga_mgr_class;
 
+/*
+ * Call the low level driver's write_init function.  This will do the
+ * device-specific things to get the FPGA into the state where it is ready to
+ * receive an FPGA image.  The low level driver only gets to see the first
+ * initial_header_size bytes in the buffer.
+ */
+static int fpga_mgr_write_init_buf(struct fpga_manager *mgr,
+				   struct fpga_image_info *info,
+				   const char *buf, size_t count)
+{
+	int ret;
+
+	mgr->state = FPGA_MGR_STATE_WRITE_INIT;
+	if (!mgr->mops->initial_header_size)
+		ret = mgr->mops->write_init(mgr, info, NULL, 0);
+	else
+		ret = mgr->mops->write_init(
+		    mgr, info, buf, min(mgr->mops->initial_header_size, count));
+
+	if (ret) {
+		dev_err(&mgr->dev, "Error preparing FPGA for writing\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_INIT_ERR;
+		return ret;
+	}
+
+	return 0;
+}
+
+static int fpga_mgr_write_init_sg(struct fpga_manager *mgr,
+				  struct fpga_image_info *info,
+				  struct sg_table *sgt)
+{
+	struct sg_mapping_iter miter;
+	size_t len;
+	char *buf;
+	int ret;
+
+	if (!mgr->mops->initial_header_size)
+		return fpga_mgr_write_init_buf(mgr, info, NULL, 0);
+
+	/*
+	 * First try to use miter to map the first fragment to access the
+	 * header, this is the typical path.
+	 */
+	sg_miter_start(&miter, sgt->sgl, sgt->nents, SG_MITER_FROM_SG);
+	if (sg_miter_next(&miter) &&
+	    miter.length >= mgr->mops->initial_header_size) {
+		ret = fpga_mgr_write_init_buf(mgr, info, miter.addr,
+					      miter.length);
+		sg_miter_stop(&miter);
+		return ret;
+	}
+	sg_miter_stop(&miter);
+
+	/* Otherwise copy the fragments into temporary memory. */
+	buf = kmalloc(mgr->mops->initial_header_size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = sg_copy_to_buffer(sgt->sgl, sgt->nents, buf,
+				mgr->mops->initial_header_size);
+	ret = fpga_mgr_write_init_buf(mgr, info, buf, len);
+
+	kfree(buf);
+
+	return ret;
+}
+
+/*
+ * After all the FPGA image has been written, do the device specific steps to
+ * finish and set the FPGA into operating mode.
+ */
+static int fpga_mgr_write_complete(struct fpga_manager *mgr,
+				   struct fpga_image_info *info)
+{
+	int ret;
+
+	mgr->state = FPGA_MGR_STATE_WRITE_COMPLETE;
+	ret = mgr->mops->write_complete(mgr, info);
+	if (ret) {
+		dev_err(&mgr->dev, "Error after writing image data to FPGA\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_COMPLETE_ERR;
+		return ret;
+	}
+	mgr->state = FPGA_MGR_STATE_OPERATING;
+
+	return 0;
+}
+
 /**
- * fpga_mgr_buf_load - load fpga from image in buffer
+ * fpga_mgr_buf_load_sg - load fpga from image in buffer from a scatter list
  * @mgr:	fpga manager
  * @info:	fpga image specific information
- * @buf:	buffer contain fpga image
- * @count:	byte count of buf
+ * @sgt:	scatterlist table
  *
  * Step the low level fpga manager through the device-specific steps of getting
  * an FPGA ready to be configured, writing the image to it, then doing whatever
  * post-configuration steps necessary.  This code assumes the caller got the
- * mgr pointer from of_fpga_mgr_get() and checked that it is not an error code.
+ * mgr pointer from of_fpga_mgr_get() or similar and checked that it is not an
+ * error code.
+ *
+ * If the low level driver has no write_sg op, each fragment of the table is
+ * passed to its write op in turn, so the image never has to be contiguous.
+ * Every fragment except the last must then be a multiple of 4 bytes long.
  *
  * Return: 0 on success, negative error code otherwise.
  */
-int fpga_mgr_buf_load(struct fpga_manager *mgr, struct fpga_image_info *info,
-		      const char *buf, size_t count)
+int fpga_mgr_buf_load_sg(struct fpga_manager *mgr,
+			 struct fpga_image_info *info,
+			 struct sg_table *sgt)
 {
-	struct device *dev = &mgr->dev;
 	int ret;
 
-	/*
-	 * Call the low level driver's write_init function.  This will do the
-	 * device-specific things to get the FPGA into the state where it is
-	 * ready to receive an FPGA image.
-	 */
-	mgr->state = FPGA_MGR_STATE_WRITE_INIT;
-	ret = mgr->mops->write_init(mgr, info, buf, count);
+	ret = fpga_mgr_write_init_sg(mgr, info, sgt);
+	if (ret)
+		return ret;
+
+	/* Write the FPGA image to the FPGA. */
+	mgr->state = FPGA_MGR_STATE_WRITE;
+	if (mgr->mops->write_sg) {
+		ret = mgr->mops->write_sg(mgr, sgt);
+	} else {
+		struct sg_mapping_iter miter;
+
+		sg_miter_start(&miter, sgt->sgl, sgt->nents, SG_MITER_FROM_SG);
+		while (sg_miter_next(&miter)) {
+			ret = mgr->mops->write(mgr, miter.addr, miter.length);
+			if (ret)
+				break;
+		}
+		sg_miter_stop(&miter);
+	}
+
 	if (ret) {
-		dev_err(dev, "Error preparing FPGA for writing\n");
-		mgr->state = FPGA_MGR_STATE_WRITE_INIT_ERR;
+		dev_err(&mgr->dev, "Error while writing image data to FPGA\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
 		return ret;
 	}
 
+	return fpga_mgr_write_complete(mgr, info);
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_buf_load_sg);
+
+static int fpga_mgr_buf_load_mapped(struct fpga_manager *mgr,
+				    struct fpga_image_info *info,
+				    const char *buf, size_t count)
+{
+	int ret;
+
+	ret = fpga_mgr_write_init_buf(mgr, info, buf, count);
+	if (ret)
+		return ret;
+
 	/*
 	 * Write the FPGA image to the FPGA.
 	 */
 	mgr->state = FPGA_MGR_STATE_WRITE;
 	ret = mgr->mops->write(mgr, buf, count);
 	if (ret) {
-		dev_err(dev, "Error while writing image data to FPGA\n");
+		dev_err(&mgr->dev, "Error while writing image data to FPGA\n");
 		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
 		return ret;
 	}
 
+	return fpga_mgr_write_complete(mgr, info);
+}
+
+/**
+ * fpga_mgr_buf_load - load fpga from image in buffer
+ * @mgr:	fpga manager
+ * @info:	fpga image specific information
+ * @buf:	buffer contain fpga image
+ * @count:	byte count of buf
+ *
+ * Step the low level fpga manager through the device-specific steps of getting
+ * an FPGA ready to be configured, writing the image to it, then doing whatever
+ * post-configuration steps necessary.  This code assumes the caller got the
+ * mgr pointer from of_fpga_mgr_get() and checked that it is not an error code.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_mgr_buf_load(struct fpga_manager *mgr, struct fpga_image_info *info,
+		      const char *buf, size_t count)
+{
+	struct page **pages;
+	struct sg_table sgt;
+	const void *p;
+	int nr_pages;
+	int index;
+	int rc;
+
 	/*
-	 * After all the FPGA image has been written, do the device specific
-	 * steps to finish and set the FPGA into operating mode.
+	 * This is just a fast path if the caller has already created a
+	 * contiguous kernel buffer and the driver doesn't require SG, non-SG
+	 * drivers will still work on the slow path.
 	 */
-	mgr->state = FPGA_MGR_STATE_WRITE_COMPLETE;
-	ret = mgr->mops->write_complete(mgr, info);
-	if (ret) {
-		dev_err(dev, "Error after writing image data to FPGA\n");
-		mgr->state = FPGA_MGR_STATE_WRITE_COMPLETE_ERR;
-		return ret;
+	if (mgr->mops->write)
+		return fpga_mgr_buf_load_mapped(mgr, info, buf, count);
+
+	/*
+	 * Convert the linear kernel pointer into a sg_table of pages for use
+	 * by the driver.
+	 */
+	nr_pages = DIV_ROUND_UP((unsigned long)buf + count, PAGE_SIZE) -
+		   (unsigned long)buf / PAGE_SIZE;
+	pages = kmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	p = buf - offset_in_page(buf);
+	for (index = 0; index < nr_pages; index++) {
+		if (is_vmalloc_addr(p))
+			pages[index] = vmalloc_to_page(p);
+		else
+			pages[index] = kmap_to_page((void *)p);
+		if (!pages[index]) {
+			kfree(pages);
+			return -EFAULT;
+		}
+		p += PAGE_SIZE;
 	}
-	mgr->state = FPGA_MGR_STATE_OPERATING;
 
-	return 0;
+	/*
+	 * The temporary pages list is used to code share the merging algorithm
+	 * in sg_alloc_table_from_pages
+	 */
+	rc = sg_alloc_table_from_pages(&sgt, pages, index, offset_in_page(buf),
+				       count, GFP_KERNEL);
+	kfree(pages);
+	if (rc)
+		return rc;
+
+	rc = fpga_mgr_buf_load_sg(mgr, info, &sgt);
+	sg_free_table(&sgt);
+
+	return rc;
 }
 EXPORT_SYMBOL_GPL(fpga_mgr_buf_load);
 
+/**
+ * fpga_mgr_user_load - load fpga from an image in user memory
+ * @mgr:	fpga manager
+ * @info:	fpga image specific information
+ * @buf:	user buffer containing the fpga image, 4 byte aligned
+ * @count:	byte count of buf
+ *
+ * The user pages are pinned and passed to fpga_mgr_buf_load_sg(), so the image
+ * goes straight from user memory to the low level driver without being copied
+ * into a kernel buffer.  The buffer must be 4 byte aligned so that only the
+ * last fragment can end in a partial word.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_mgr_user_load(struct fpga_manager *mgr, struct fpga_image_info *info,
+		       const char __user *buf, size_t count)
+{
+	unsigned long start = (unsigned long)buf;
+	struct timeval start_time, end_time;
+	unsigned long elapsed_us;
+	struct page **pages;
+	struct sg_table sgt;
+	int nr_pages, pinned;
+	int ret, i;
+
+	if (!count || !IS_ALIGNED(start, sizeof(u32)))
+		return -EINVAL;
+
+	do_gettimeofday(&start_time);
+
+	nr_pages = DIV_ROUND_UP(offset_in_page(start) + count, PAGE_SIZE);
+	pages = vmalloc(nr_pages * sizeof(*pages));
+	if (!pages)
+		return -ENOMEM;
+
+	pinned = get_user_pages_fast(start & PAGE_MASK, nr_pages, 0, pages);
+	if (pinned != nr_pages) {
+		ret = pinned < 0 ? pinned : -EFAULT;
+		goto err_put_pages;
+	}
+
+	ret = sg_alloc_table_from_pages(&sgt, pages, nr_pages,
+					offset_in_page(start), count,
+					GFP_KERNEL);
+	if (ret)
+		goto err_put_pages;
+
+	ret = fpga_mgr_buf_load_sg(mgr, info, &sgt);
+	sg_free_table(&sgt);
+
+	if (!ret) {
+		do_gettimeofday(&end_time);
+		elapsed_us = (end_time.tv_sec - start_time.tv_sec) *
+			     USEC_PER_SEC +
+			     (end_time.tv_usec - start_time.tv_usec);
+		dev_info(&mgr->dev, "wrote %zu bytes from user pages in %lu us (%lu MB/s)\n",
+			 count, elapsed_us, count / max(elapsed_us, 1UL));
+	}
+
+err_put_pages:
+	for (i = 0; i < pinned; i++)
+		put_page(pages[i]);
+	vfree(pages);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_user_load);
+
+struct fpga_mgr_stream {
+	fpga_mgr_stream_read_t read;
+	void *src;
+	char *buf[2];
+	ssize_t len[2];
+	int fill;
+	struct work_struct work;
+	struct completion filled;
+};
+
+/*
+ * Fill a whole chunk, merging short reads from pipes and sockets, so that only
+ * the last chunk of an image can have a length that is not a multiple of 4.
+ */
+static ssize_t fpga_mgr_stream_fill(struct fpga_mgr_stream *stream, char *buf)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < FPGA_MGR_STREAM_CHUNK_SIZE) {
+		ret = stream->read(stream->src, buf + done,
+				   FPGA_MGR_STREAM_CHUNK_SIZE - done);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+		done += ret;
+	}
+
+	return done;
+}
+
+static void fpga_mgr_stream_work(struct work_struct *work)
+{
+	struct fpga_mgr_stream *stream =
+		container_of(work, struct fpga_mgr_stream, work);
+	int fill = stream->fill;
+
+	stream->len[fill] = fpga_mgr_stream_fill(stream, stream->buf[fill]);
+	complete(&stream->filled);
+}
+
+/**
+ * fpga_mgr_stream_load - load fpga from an image read in chunks
+ * @mgr:	fpga manager
+ * @info:	fpga image specific information
+ * @read:	reads the next bytes of the image, returns 0 at the end
+ * @src:	passed to @read
+ *
+ * The image is passed to the low level driver's write op in chunks of
+ * FPGA_MGR_STREAM_CHUNK_SIZE bytes.  Two chunk buffers are used: while one is
+ * written to the FPGA the next is read from @src on a workqueue, so fetching
+ * the image overlaps with writing it and memory use does not depend on the
+ * size of the image.  The first chunk is passed to write_init.  The buffers
+ * come from the manager's staging pool and the work runs on the NUMA node of
+ * the device, so the chunks are written from near memory when the caller runs
+ * on that node too.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_mgr_stream_load(struct fpga_manager *mgr,
+			 struct fpga_image_info *info,
+			 fpga_mgr_stream_read_t read, void *src)
+{
+	struct fpga_mgr_stream *stream;
+	ssize_t len;
+	int cur = 0;
+	int ret;
+
+	if (!mgr->mops->write)
+		return -EOPNOTSUPP;
+
+	stream = kzalloc_node(sizeof(*stream), GFP_KERNEL, fpga_mgr_node(mgr));
+	if (!stream)
+		return -ENOMEM;
+
+	stream->read = read;
+	stream->src = src;
+	INIT_WORK(&stream->work, fpga_mgr_stream_work);
+	init_completion(&stream->filled);
+
+	ret = -ENOMEM;
+	stream->buf[0] = fpga_mgr_pool_alloc(mgr, FPGA_MGR_STREAM_CHUNK_SIZE);
+	if (!stream->buf[0])
+		goto err_free;
+	stream->buf[1] = fpga_mgr_pool_alloc(mgr, FPGA_MGR_STREAM_CHUNK_SIZE);
+	if (!stream->buf[1])
+		goto err_free;
+
+	len = fpga_mgr_stream_fill(stream, stream->buf[0]);
+	if (len <= 0) {
+		ret = len ? len : -EINVAL;
+		dev_err(&mgr->dev, "Error reading start of image\n");
+		goto err_free;
+	}
+
+	ret = fpga_mgr_write_init_buf(mgr, info, stream->buf[0], len);
+	if (ret)
+		goto err_free;
+
+	mgr->state = FPGA_MGR_STATE_WRITE;
+	while (len > 0) {
+		/* Read the next chunk while this one is written */
+		stream->fill = !cur;
+		reinit_completion(&stream->filled);
+		queue_work(mgr->wq, &stream->work);
+
+		ret = mgr->mops->write(mgr, stream->buf[cur], len);
+
+		wait_for_completion(&stream->filled);
+		if (ret)
+			break;
+
+		cur = !cur;
+		len = stream->len[cur];
+		if (len < 0)
+			ret = len;
+	}
+
+	if (ret) {
+		dev_err(&mgr->dev, "Error while writing image data to FPGA\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
+		goto err_free;
+	}
+
+	ret = fpga_mgr_write_complete(mgr, info);
+
+err_free:
+	fpga_mgr_pool_free(mgr, stream->buf[1], FPGA_MGR_STREAM_CHUNK_SIZE);
+	fpga_mgr_pool_free(mgr, stream->buf[0], FPGA_MGR_STREAM_CHUNK_SIZE);
+	kfree(stream);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_stream_load);
+
+struct fpga_mgr_file_src {
+	struct file *fp;
+	loff_t pos;
+};
+
+static ssize_t fpga_mgr_file_read(void *src, char *buf, size_t count)
+{
+	struct fpga_mgr_file_src *file_src = src;
+	int ret;
+
+	ret = kernel_read(file_src->fp, file_src->pos, buf, count);
+	if (ret > 0)
+		file_src->pos += ret;
+
+	return ret;
+}
+
+/**
+ * fpga_mgr_file_load - stream an image from a file to the fpga
+ * @mgr:	fpga manager
+ * @info:	fpga image specific information
+ * @path:	path of the image file, which may also be a FIFO
+ *
+ * Unlike fpga_mgr_firmware_load(), the image is never resident in memory as a
+ * whole; see fpga_mgr_stream_load().
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_mgr_file_load(struct fpga_manager *mgr,
+		       struct fpga_image_info *info,
+		       const char *path)
+{
+	struct fpga_mgr_file_src file_src;
+	int ret;
+
+	dev_info(&mgr->dev, "streaming %s to %s\n", path, mgr->name);
+
+	file_src.fp = filp_open(path, O_RDONLY, 0);
+	if (IS_ERR(file_src.fp)) {
+		dev_err(&mgr->dev, "Error opening %s\n", path);
+		return PTR_ERR(file_src.fp);
+	}
+	file_src.pos = 0;
+
+	ret = fpga_mgr_stream_load(mgr, info, fpga_mgr_file_read, &file_src);
+
+	filp_close(file_src.fp, NULL);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_file_load);
+
 /**
  * fpga_mgr_firmware_load - request firmware and load to fpga
  * @mgr:	fpga manager
@@ -188,25 +633,25 @@ static int fpga_mgr_of_node_match(struct device *dev, const void *data)
 	return dev->of_node == data;
 }
 
-/**
- * of_fpga_mgr_get - get an exclusive reference to a fpga mgr
- * @node:	device node
- *
- * Given a device node, get an exclusive reference to a fpga mgr.
- *
- * Return: fpga manager struct or IS_ERR() condition containing error code.
- */
-struct fpga_manager *of_fpga_mgr_get(struct device_node *node)
+static int fpga_mgr_dev_match(struct device *dev, const void *data)
+{
+	return dev->parent == data;
+}
+
+/* Subdevices of fpga-pcie are not bound to a driver of their own */
+static struct module *fpga_mgr_owner(struct fpga_manager *mgr)
+{
+	struct device_driver *drv = mgr->dev.parent->driver;
+
+	return drv ? drv->owner : THIS_MODULE;
+}
+
+/* Takes over the reference to dev held by the caller */
+static struct fpga_manager *__fpga_mgr_get(struct device *dev)
 {
 	struct fpga_manager *mgr;
-	struct device *dev;
 	int ret = -ENODEV;
 
-	dev = class_find_device(fpga_mgr_class, NULL, node,
-				fpga_mgr_of_node_match);
-	if (!dev)
-		return ERR_PTR(-ENODEV);
-
 	mgr = to_fpga_manager(dev);
 	if (!mgr)
 		goto err_dev;
@@ -217,7 +662,7 @@ struct fpga_manager *of_fpga_mgr_get(struct device_node *node)
 		goto err_dev;
 	}
 
-	if (!try_module_get(dev->parent->driver->owner))
+	if (!try_module_get(fpga_mgr_owner(mgr)))
 		goto err_ll_mod;
 
 	return mgr;
@@ -228,6 +673,46 @@ err_dev:
 	put_device(dev);
 	return ERR_PTR(ret);
 }
+
+/**
+ * fpga_mgr_get - get an exclusive reference to a fpga mgr
+ * @dev:	device the fpga mgr was registered against
+ *
+ * Return: fpga manager struct or IS_ERR() condition containing error code,
+ * -EBUSY while someone else holds the manager.
+ */
+struct fpga_manager *fpga_mgr_get(struct device *dev)
+{
+	struct device *mgr_dev;
+
+	mgr_dev = class_find_device(fpga_mgr_class, NULL, dev,
+				    fpga_mgr_dev_match);
+	if (!mgr_dev)
+		return ERR_PTR(-ENODEV);
+
+	return __fpga_mgr_get(mgr_dev);
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_get);
+
+/**
+ * of_fpga_mgr_get - get an exclusive reference to a fpga mgr
+ * @node:	device node
+ *
+ * Given a device node, get an exclusive reference to a fpga mgr.
+ *
+ * Return: fpga manager struct or IS_ERR() condition containing error code.
+ */
+struct fpga_manager *of_fpga_mgr_get(struct device_node *node)
+{
+	struct device *dev;
+
+	dev = class_find_device(fpga_mgr_class, NULL, node,
+				fpga_mgr_of_node_match);
+	if (!dev)
+		return ERR_PTR(-ENODEV);
+
+	return __fpga_mgr_get(dev);
+}
 EXPORT_SYMBOL_GPL(of_fpga_mgr_get);
 
 /**
@@ -236,12 +721,38 @@ EXPORT_SYMBOL_GPL(of_fpga_mgr_get);
  */
 void fpga_mgr_put(struct fpga_manager *mgr)
 {
-	module_put(mgr->dev.parent->driver->owner);
+	module_put(fpga_mgr_owner(mgr));
 	mutex_unlock(&mgr->ref_mutex);
 	put_device(&mgr->dev);
 }
 EXPORT_SYMBOL_GPL(fpga_mgr_put);
 
+/*
+ * The manager's work runs on the CPUs of its device's node.  Without NUMA
+ * information the queue is left to run anywhere.
+ */
+static struct workqueue_struct *fpga_mgr_alloc_wq(struct device *dev, int id)
+{
+	struct workqueue_attrs *attrs;
+	struct workqueue_struct *wq;
+	int node = dev_to_node(dev);
+
+	wq = alloc_workqueue("fpga_mgr%d", WQ_UNBOUND, 0, id);
+	if (!wq || node == NUMA_NO_NODE)
+		return wq;
+
+	attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!attrs)
+		return wq;
+
+	cpumask_and(attrs->cpumask, cpumask_of_node(node), cpu_online_mask);
+	if (!cpumask_empty(attrs->cpumask) && apply_workqueue_attrs(wq, attrs))
+		dev_warn(dev, "cannot keep load work on node %d\n", node);
+	free_workqueue_attrs(attrs);
+
+	return wq;
+}
+
 /**
  * fpga_mgr_register - register a low level fpga manager driver
  * @dev:	fpga manager device from pdev
@@ -258,7 +769,7 @@ int fpga_mgr_register(struct device *dev, const char *name,
 	struct fpga_manager *mgr;
 	int id, ret;
 
-	if (!mops || !mops->write_init || !mops->write ||
+	if (!mops || !mops->write_init || (!mops->write && !mops->write_sg) ||
 	    !mops->write_complete || !mops->state) {
 		dev_err(dev, "Attempt to register without fpga_manager_ops\n");
 		return -EINVAL;
@@ -269,7 +780,7 @@ int fpga_mgr_register(struct device *dev, const char *name,
 		return -EINVAL;
 	}
 
-	mgr = kzalloc(sizeof(*mgr), GFP_KERNEL);
+	mgr = kzalloc_node(sizeof(*mgr), GFP_KERNEL, dev_to_node(dev));
 	if (!mgr)
 		return -ENOMEM;
 
@@ -279,6 +790,12 @@ int fpga_mgr_register(struct device *dev, const char *name,
 		goto error_kfree;
 	}
 
+	mgr->wq = fpga_mgr_alloc_wq(dev, id);
+	if (!mgr->wq) {
+		ret = -ENOMEM;
+		goto error_ida;
+	}
+
 	mutex_init(&mgr->ref_mutex);
 
 	mgr->name = name;
@@ -299,6 +816,10 @@ int fpga_mgr_register(struct device *dev, const char *name,
 	mgr->dev.id = id;
 	dev_set_drvdata(dev, mgr);
 
+	ret = fpga_mgr_pool_init(mgr, dev_to_node(dev));
+	if (ret)
+		goto error_device;
+
 	ret = dev_set_name(&mgr->dev, name);
 	if (ret)
 		goto error_device;
@@ -314,6 +835,9 @@ int fpga_mgr_register(struct device *dev, const char *name,
 	return 0;
 
 error_device:
+	fpga_mgr_pool_uninit(mgr);
+	destroy_workqueue(mgr->wq);
+error_ida:
 	ida_simple_remove(&fpga_mgr_ida, id);
 error_kfree:
 	kfree(mgr);
@@ -349,17 +873,31 @@ static void fpga_mgr_dev_release(struct device *dev)
 {
 	struct fpga_manager *mgr = to_fpga_manager(dev);
 
+	fpga_mgr_pool_uninit(mgr);
+	destroy_workqueue(mgr->wq);
 	ida_simple_remove(&fpga_mgr_ida, mgr->dev.id);
 	kfree(mgr);
 }
 
 static int __init fpga_mgr_class_init(void)
 {
+	int ret;
+
 	pr_info("FPGA manager framework\n");
 
+	ret = fpga_bridge_class_init();
+	if (ret)
+		return ret;
+
+	ret = fpga_region_class_init();
+	if (ret)
+		goto err_bridge;
+
 	fpga_mgr_class = class_create(THIS_MODULE, "fpga_manager");
-	if (IS_ERR(fpga_mgr_class))
-		return PTR_ERR(fpga_mgr_class);
+	if (IS_ERR(fpga_mgr_class)) {
+		ret = PTR_ERR(fpga_mgr_class);
+		goto err_region;
+	}
 
 	fpga_mgr_class->dev_groups = fpga_mgr_groups;
 	fpga_mgr_class->dev_release = fpga_mgr_dev_release;
@@ -367,6 +905,12 @@ static int __init fpga_mgr_class_init(void)
 	fpga_mgr_debugfs_init();
 
 	return 0;
+
+err_region:
+	fpga_region_class_exit();
+err_bridge:
+	fpga_bridge_class_exit();
+	return ret;
 }
 
 static void __exit fpga_mgr_class_exit(void)
@@ -374,6 +918,8 @@ static void __exit fpga_mgr_class_exit(void)
 	fpga_mgr_debugfs_uninit();
 	class_destroy(fpga_mgr_class);
 	ida_destroy(&fpga_mgr_ida);
+	fpga_region_class_exit();
+	fpga_bridge_class_exit();
 }
 
 MODULE_AUTHOR("Alan Tull <atull@opensource.altera.com>");
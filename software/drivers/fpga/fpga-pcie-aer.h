@@ -0,0 +1,60 @@
+/*
+ * Upstream AER quiesce and restore for FPGA cards
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FPGA_PCIE_AER_H
+#define _FPGA_PCIE_AER_H
+
+#include <linux/pci.h>
+
+/* Deepest switch hierarchy between a card and its root port we handle */
+#define FPGA_PCIE_AER_MAX_PORTS		8
+
+/* Uncorrectable errors the link going down during CvP is expected to raise */
+#define FPGA_PCIE_AER_UNCOR_QUIESCE	(PCI_ERR_UNC_SURPDN | \
+					 PCI_ERR_UNC_COMP_TIME | \
+					 PCI_ERR_UNC_UNSUP)
+
+/**
+ * struct fpga_pcie_aer_port - error reporting state of one bridge
+ * @dev: the bridge, referenced while the snapshot is held
+ * @aer_pos: offset of its AER capability, 0 if it has none
+ * @uncor_mask: saved Uncorrectable Error Mask register
+ * @uncor_sever: saved Uncorrectable Error Severity register
+ * @devctl: saved Device Control register of its PCIe capability
+ */
+struct fpga_pcie_aer_port {
+	struct pci_dev *dev;
+	int aer_pos;
+	u32 uncor_mask;
+	u32 uncor_sever;
+	u16 devctl;
+};
+
+/**
+ * struct fpga_pcie_aer - error reporting state of the path above a card
+ * @ports: bridges from the card's upstream port up to the root port
+ * @num_ports: number of valid entries in @ports
+ */
+struct fpga_pcie_aer {
+	struct fpga_pcie_aer_port ports[FPGA_PCIE_AER_MAX_PORTS];
+	int num_ports;
+};
+
+int fpga_pcie_aer_quiesce(struct pci_dev *dev, struct fpga_pcie_aer *aer);
+void fpga_pcie_aer_restore(struct pci_dev *dev, struct fpga_pcie_aer *aer);
+
+#endif /* _FPGA_PCIE_AER_H */
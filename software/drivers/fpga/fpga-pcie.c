@@ -15,12 +15,19 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "altera-cvp.h"
+#include "altera-freeze-bridge.h"
 #include "altera-pr-ip-core.h"
+#include "fpga-pcie-aer.h"
+#include "fpga-pcie-link.h"
 #include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/fpga/fpga-region.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/uio_driver.h>
+#include <linux/version.h>
 #include "libfdt.h"
 
 #define DRIVER_NAME "fpga-pcie"
@@ -36,6 +43,34 @@ static const const char* DRIVER_VERSION  = "1.0";
 #define ALTR_PCI_CONFIG_ROM_LEN 0x400
 #define ALTR_PCI_REGION_CONTROLLER_ROM_OFFSET 0x04
 #define ALTR_PCI_CVP_PR_ROM_OFFSET 0x08
+#define ALTR_PCI_CVP_DATA_BAR 0
+
+/*
+ * How a BAR is mapped, in the kernel and through UIO.  BARs the driver
+ * knows are register banks or FIFO ports, where reads have side effects or
+ * writes go to the same address, and are always uncached.  Others are
+ * write-combined if they are prefetchable, or when listed in wc_bars.
+ */
+enum fpga_pcie_bar_attr {
+	FPGA_PCIE_BAR_UC,
+	FPGA_PCIE_BAR_WC,
+};
+
+static const char * const fpga_pcie_bar_attr_names[] = {
+	[FPGA_PCIE_BAR_UC] = "uc",
+	[FPGA_PCIE_BAR_WC] = "wc",
+};
+
+static const bool fpga_pcie_csr_bars[ALTR_PCI_CVP_NUM_BARS] = {
+	[ALTR_PCI_CVP_DATA_BAR] = true,
+	[ALTR_PCI_CVP_CONFIG_BAR] = true,
+	[ALTR_PCI_CVP_PR_BAR] = true,
+};
+
+static unsigned int wc_bars;
+module_param(wc_bars, uint, 0444);
+MODULE_PARM_DESC(wc_bars,
+		 "Bit mask of BARs to map write-combined, e.g. 0x10 for a PR region that is a memory window");
 
 /* Define the PCIe device settings to match to */
 #define ALTR_PCI_CVP_VENDOR_ID 0x1172
@@ -44,8 +79,6 @@ static const const char* DRIVER_VERSION  = "1.0";
 #define ALTR_PCI_CVP_SUB_VENDOR_ID 0x1172
 #define ALTR_PCI_CVP_SUB_DEVICE_ID 0x0001
 
-#define DEV_LINK_WIDTH 8
-
 /* Forward declarations */
 static struct pci_driver fpga_pcie_driver;
 static int fpga_pcie_register_driver(void);
@@ -56,6 +89,11 @@ static void dump_dtb(struct device *dev, const void *fdt);
 static struct dentry *fpga_pcie_debugfs_root;
 static const struct file_operations fpga_pcie_state_fops;
 static const struct file_operations fpga_pcie_base_dtb_fops;
+static const struct file_operations fpga_pcie_link_fops;
+static const struct file_operations fpga_pcie_cvp_image_fops;
+static const struct file_operations fpga_pcie_cvp_stats_fops;
+static const struct file_operations fpga_pcie_recovery_fops;
+static const struct file_operations fpga_pcie_bars_fops;
 
 /* Register the device identification for the PCIe bus subsystem */
 static struct pci_device_id fpga_pcie_pci_ids[] = {
@@ -69,29 +107,103 @@ MODULE_DEVICE_TABLE(pci, fpga_pcie_pci_ids);
 static const char *ST_IDLE = "Idle\n";
 static const char *ST_AER_DISABLED = "Upstream AER disabled\n";
 static const char *ST_BASE_PROBED = "Base probed\n";
+static const char *ST_OFFLINE = "Offline\n";
+
+/* Time allowed for the core to enter user mode after a CvP update */
+#define FPGA_PCIE_CVP_USERMODE_TIMEOUT_US 10000000
+
+/* Phases of a full chip configuration through CvP, timed separately */
+enum fpga_pcie_cvp_phase {
+	CVP_PHASE_QUIESCE,
+	CVP_PHASE_MASK_AER,
+	CVP_PHASE_PROGRAM,
+	CVP_PHASE_RESTORE,
+	CVP_PHASE_REPROBE,
+	CVP_NUM_PHASES
+};
+
+static const char * const cvp_phase_names[] = {
+	[CVP_PHASE_QUIESCE] = "quiesce",
+	[CVP_PHASE_MASK_AER] = "mask_aer",
+	[CVP_PHASE_PROGRAM] = "program",
+	[CVP_PHASE_RESTORE] = "restore",
+	[CVP_PHASE_REPROBE] = "reprobe",
+};
+
+/*
+ * State of kernel driven CvP updates.  image is the last core image loaded
+ * successfully, which a failed update rolls back to.
+ */
+struct fpga_pcie_cvp {
+	char *image;
+	unsigned long phase_us[CVP_NUM_PHASES];
+	unsigned long total_us;
+	unsigned long rollback_us;
+	int last_err;
+	unsigned long updates;
+	unsigned long failures;
+	unsigned long rollbacks;
+};
+
+/*
+ * State of error recovery, FLR and suspend.  prev_state is the state the
+ * card was in when it went offline, which tells what to bring back.
+ */
+struct fpga_pcie_recovery {
+	ktime_t start;
+	const char *prev_state;
+	unsigned long last_us;
+	unsigned long errors;
+	unsigned long resets;
+	unsigned long recoveries;
+	unsigned long failures;
+};
 
+/*
+ * lock serialises everything that changes the state of the card: probing and
+ * removing the subdrivers, full chip configuration, error recovery, resets
+ * and suspend.
+ */
 struct fpga_pcie_priv {
+	struct mutex lock;
 	void __iomem *bar_addrs[ALTR_PCI_CVP_NUM_BARS];
+	enum fpga_pcie_bar_attr bar_attrs[ALTR_PCI_CVP_NUM_BARS];
+	struct mutex bar_lock;
+	int uio_bars[MAX_UIO_MAPS];
 	struct dentry *debugfs_root;
 	struct pci_dev *pci_dev;
 	struct pci_dev *pci_upstream_dev;
-	u32 aer_uerr_mask_reg;
+	struct fpga_pcie_aer aer;
 	const char *state;
 	struct uio_info uio_info;
 	struct list_head fdev_list;
 	spinlock_t fdev_list_lock;
+	struct list_head region_list;
+	struct fpga_pcie_link link;
+	struct fdev *cvp_fdev;
+	struct fpga_pcie_cvp cvp;
+	struct fpga_pcie_recovery recovery;
 };
 
 static int fpga_pcie_probe_all_subdrivers(struct fpga_pcie_priv *priv,
 					  const void *fdt);
 static int fpga_pcie_remove_all_subdrivers(struct fpga_pcie_priv *priv);
+static void fpga_pcie_probe_cvp(struct fpga_pcie_priv *priv);
 
 struct fdev {
 	struct list_head list;
+	u32 phandle;
 	int (*remove)(struct device *dev);
 	struct device dev;
 };
 
+static int fpga_pcie_remove_one(struct fpga_pcie_priv *priv, struct fdev *fdev);
+
+struct fregion {
+	struct list_head list;
+	struct fpga_region *region;
+};
+
 struct fpga_drv_entry {
 	const char *id;
 	const char *prefix;
@@ -106,9 +218,23 @@ struct fpga_drv_entry fpga_drv_tab[] = {
 		.probe = alt_pr_probe,
 		.remove = alt_pr_remove,
 	}, 
+	{
+		.id = "altr,freeze-bridge-controller",
+		.prefix = "freeze-",
+		.probe = alt_freeze_br_probe,
+		.remove = alt_freeze_br_remove,
+	},
 	{}
 };
 
+/* Not listed in the config ROM, CvP belongs to the PCIe hard IP */
+static struct fpga_drv_entry fpga_cvp_drv = {
+	.id = "altr,cvp",
+	.prefix = "cvp-",
+	.probe = alt_cvp_probe,
+	.remove = alt_cvp_remove,
+};
+
 static struct fpga_drv_entry *fpga_drv_lookup(const char *id)
 {
 	struct fpga_drv_entry *p;
@@ -120,173 +246,121 @@ static struct fpga_drv_entry *fpga_drv_lookup(const char *id)
 	return NULL;
 }
 
-static u32 get_aer_uerr_mask_reg(struct pci_dev *dev)
+/*
+ * BARs are only mapped into the kernel when something in the kernel first
+ * uses them, so probe does not pay for mapping large windows that only
+ * user space touches.  Returns NULL if the BAR is unused or can't be mapped.
+ */
+static void __iomem *fpga_pcie_bar(struct fpga_pcie_priv *priv, int bar)
 {
-	u32 reg = 0;
-	int pos;
-
-	pos = pci_find_ext_capability(dev, PCI_EXT_CAP_ID_ERR);
+	struct pci_dev *dev = priv->pci_dev;
+	void __iomem *p;
 
-	if (!pos) {
-		dev_err(&dev->dev, "failed to find AER extended capability\n");
-		return -EIO;
+	if (bar < 0 || bar >= ALTR_PCI_CVP_NUM_BARS ||
+	    !pci_resource_len(dev, bar))
+		return NULL;
+
+	mutex_lock(&priv->bar_lock);
+
+	if (!priv->bar_addrs[bar]) {
+		if (priv->bar_attrs[bar] == FPGA_PCIE_BAR_WC)
+			priv->bar_addrs[bar] =
+				ioremap_wc(pci_resource_start(dev, bar),
+					   pci_resource_len(dev, bar));
+		else
+			priv->bar_addrs[bar] = pci_ioremap_bar(dev, bar);
+
+		if (priv->bar_addrs[bar])
+			dev_info(&dev->dev, "BAR[%d] mapped %s\n", bar,
+				 fpga_pcie_bar_attr_names[priv->bar_attrs[bar]]);
+		else
+			dev_err(&dev->dev, "Failed to remap BAR[%d]\n", bar);
 	}
 
-	pci_read_config_dword(dev, pos+PCI_EXP_DEVCAP, &reg);
+	p = priv->bar_addrs[bar];
 
-	pci_read_config_dword(dev, pos+PCI_EXP_DEVCTL, &reg);
+	mutex_unlock(&priv->bar_lock);
 
-	return reg;
+	return p;
 }
 
-static void set_aer_uerr_mask_reg(struct pci_dev *dev, u32 val)
+static void __iomem *fpga_pcie_rom(struct fpga_pcie_priv *priv)
 {
-	int pos;
-
-	pos = pci_find_ext_capability(dev, PCI_EXT_CAP_ID_ERR);
-
-	if (!pos) {
-		dev_err(&dev->dev, "failed to find AER extended capability\n");
-		return;
-	}
-
+	void __iomem *p = fpga_pcie_bar(priv, ALTR_PCI_CVP_CONFIG_BAR);
 
-	pci_write_config_dword(dev, pos+PCI_EXP_DEVCAP, PCI_ERR_UNC_SURPDN | PCI_ERR_UNC_COMP_TIME | PCI_ERR_UNC_UNSUP);
-
-	pci_write_config_dword(dev, pos+PCI_EXP_DEVCTL, val);
+	return p ? p + ALTR_PCI_CONFIG_ROM_OFFSET : NULL;
 }
 
-static u32 disable_upstream_aer(struct pci_dev *dev,
-				struct pci_dev *upstream_dev)
+/*
+ * UIO maps BARs uncached; write-combined BARs need their own mmap.  The map
+ * number is passed in the page offset.
+ */
+static int fpga_pcie_uio_mmap(struct uio_info *info,
+			      struct vm_area_struct *vma)
 {
-	u32 reg = 0;
+	struct fpga_pcie_priv *priv =
+		container_of(info, struct fpga_pcie_priv, uio_info);
+	unsigned long mi = vma->vm_pgoff;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct uio_mem *mem;
 
-	if (dev == NULL) {
-		pr_err("%s NULL dev\n", __func__);
-		return -EINVAL;
-	} else if (upstream_dev == NULL) {
-		
-		dev_err(&dev->dev, "%s NULL upstream_dev\n", __func__);
+	if (mi >= MAX_UIO_MAPS || !info->mem[mi].size)
 		return -EINVAL;
-	}
 
-	reg = get_aer_uerr_mask_reg(upstream_dev);
+	mem = &info->mem[mi];
+	if (size > PAGE_ALIGN(mem->size))
+		return -EINVAL;
 
-	set_aer_uerr_mask_reg(upstream_dev, reg | PCI_ERR_UNC_SURPDN | PCI_ERR_UNC_COMP_TIME | PCI_ERR_UNC_UNSUP);
+	if (priv->bar_attrs[priv->uio_bars[mi]] == FPGA_PCIE_BAR_WC)
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+	else
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
 
-	return reg;
+	return io_remap_pfn_range(vma, vma->vm_start, mem->addr >> PAGE_SHIFT,
+				  size, vma->vm_page_prot);
 }
+
 /*
- * USed for after full chip configuration, to ensure the correct speed is reported, and if not,
- * re initialize
+ * Every BAR in use gets its own UIO map.  The PR region BAR stays map 0,
+ * where existing host programs expect it; the others follow in BAR order.
  */
-static void retrain_device_speed(struct pci_dev *dev, struct pci_dev *upstream)
+static int fpga_pcie_register_uio(struct fpga_pcie_priv *priv)
 {
-	u16 linkstat, speed, width;
-	int pos, upos;
-	u16 status_reg, control_reg, link_cap_reg;
-	u16 status, control;
-	u32 link_cap;
-	int training, timeout;
+	static const char * const map_names[ALTR_PCI_CVP_NUM_BARS] = {
+		"bar0", "bar1", "bar2", "bar3", "bar4", "bar5",
+	};
+	struct pci_dev *dev = priv->pci_dev;
+	struct uio_mem *mem;
+	int i, bar, n = 0;
 
-	pos = pci_find_capability(dev, PCI_CAP_ID_EXP);
+	for (i = -1; i < ALTR_PCI_CVP_NUM_BARS && n < MAX_UIO_MAPS; i++) {
+		bar = i < 0 ? ALTR_PCI_CVP_PR_BAR : i;
+		if (i == ALTR_PCI_CVP_PR_BAR || !pci_resource_len(dev, bar))
+			continue;
 
-	if (!pos) {
-		dev_err(&dev->dev, "Can't find PCI Express capability!\n");
-		return;
+		priv->uio_bars[n] = bar;
+		mem = &priv->uio_info.mem[n++];
+		mem->name = map_names[bar];
+		mem->addr = pci_resource_start(dev, bar);
+		mem->memtype = UIO_MEM_PHYS;
+		mem->size = pci_resource_len(dev, bar);
 	}
 
-	upos = pci_find_capability(upstream, PCI_CAP_ID_EXP);
-	status_reg = upos + PCI_EXP_LNKSTA;
-	control_reg = upos + PCI_EXP_LNKCTL;
-	link_cap_reg = upos + PCI_EXP_LNKCAP;
-	pci_read_config_word(upstream, status_reg, &status);
-	pci_read_config_word(upstream, control_reg, &control);
-	pci_read_config_dword(upstream, link_cap_reg, &link_cap);
-	
-	
-	pci_read_config_word(dev, pos + PCI_EXP_LNKSTA, &linkstat);
-	pci_read_config_dword(upstream, link_cap_reg, &link_cap);
-	speed = linkstat & PCI_EXP_LNKSTA_CLS;
-	width = (linkstat & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-	
-	if (speed == PCI_EXP_LNKSTA_CLS_2_5GB) {
-		dev_info(&dev->dev, "Link speed is 2.5 GT/s with %d lanes.\n",
-			 width);
-		dev_info(&dev->dev, "Need to retrain.");
-	} else if (speed == PCI_EXP_LNKSTA_CLS_5_0GB) {
-		dev_info(&dev->dev, "Link speed is 5.0 GT/s with %d lanes.\n",
-			 width);
-		if (width == DEV_LINK_WIDTH) {
-			dev_info(&dev->dev, "  All is good!\n");
-			return;
-		} else {
-			dev_info(&dev->dev, "  Need to retrain.\n");
-		}
-	} else if (speed == PCI_EXP_LNKSTA_CLS_8_0GB) {
-		dev_info(&dev->dev, "Link speed is 8.0 GT/s with %d lanes.\n",
-			 width);
-		if (width == DEV_LINK_WIDTH) {
-			dev_info(&dev->dev, "  All is good!\n");
-			return;
-		} else {
-			dev_info(&dev->dev, "  Need to retrain.\n");
-		}
-	} else {
-		dev_warn(&dev->dev, "Not sure what's going on. Retraining.\n");
-	}
-	
-		  
-	/* Perform the training. */
-	training = 1;
-	timeout = 0;
-	pci_read_config_word(upstream, control_reg, &control);
-	pci_write_config_word(upstream, control_reg,
-			      control | PCI_EXP_LNKCTL_RL);
-	
-	while (training && timeout < 50)
-	{
-		pci_read_config_word (upstream, status_reg, &status);
-		training = (status & PCI_EXP_LNKSTA_LT);
-		msleep (1); /* 1 ms */
-		++timeout;
-	}
-	if(training)
-	{
-		 dev_info(&dev->dev, "Error: Link training timed out.\n");
-		 dev_info(&dev->dev, "PCIe link not established.\n");
-	}
-	else
-	{
-		 dev_info(&dev->dev, "Link training completed in %d ms.\n",
-			  timeout);
-	}
-	 
+	if (!n)
+		return 0;
 
-	/* Verify that it's a 8 GT/s link now */
-	pci_read_config_word(dev, pos + PCI_EXP_LNKSTA, &linkstat);
-	pci_read_config_dword(upstream, link_cap_reg, &link_cap);
-	speed = linkstat & PCI_EXP_LNKSTA_CLS;
-	width = (linkstat & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-	
-	if(speed == PCI_EXP_LNKSTA_CLS_8_0GB)
-	{
-		dev_info(&dev->dev, "Link operating at 8 GT/s with %d lanes\n",
-			 width);
-	}
-	else if(speed == PCI_EXP_LNKSTA_CLS_5_0GB)
-	{
-		dev_info(&dev->dev, "Link operating at 5 GT/s with %d lanes\n",
-			 width);
-	}
-	else
-	{
-		dev_warn(&dev->dev, "** WARNING: Link training failed.\n");
-		dev_warn(&dev->dev, "Link speed is 2.5 GT/s with %d lanes.\n",
-			 width);
+	priv->uio_info.name = dev_name(&dev->dev);
+	priv->uio_info.version = DRIVER_VERSION;
+	priv->uio_info.mmap = fpga_pcie_uio_mmap;
+
+	if (uio_register_device(&dev->dev, &priv->uio_info)) {
+		dev_err(&dev->dev, "uio_register_device failed\n");
+		priv->uio_info.mem[0].size = 0;
+		return -EIO;
 	}
-}
 
+	return 0;
+}
 
 static void fpga_pcie_shutdown_pci(struct pci_dev *dev,
 				   struct fpga_pcie_priv *priv)
@@ -299,8 +373,10 @@ static void fpga_pcie_shutdown_pci(struct pci_dev *dev,
 	}
 
 	for (i = 0; i < ALTR_PCI_CVP_NUM_BARS; i++) {
-		if (priv->bar_addrs[i])
+		if (priv->bar_addrs[i]) {
 			iounmap(priv->bar_addrs[i]);
+			priv->bar_addrs[i] = NULL;
+		}
 	}
 	pci_release_regions(dev);
 	pci_disable_device(dev);
@@ -312,9 +388,8 @@ static void fpga_pcie_shutdown_pci(struct pci_dev *dev,
 static int fpga_pcie_setup_pci(struct pci_dev *dev, struct fpga_pcie_priv *priv)
 {
 	static const const char *bar_fmt =
-		"BAR[%d] 0x%08lx-0x%08lx (%lu bytes) flags 0x%08lx\n";
+		"BAR[%d] 0x%08lx-0x%08lx (%lu bytes) flags 0x%08lx %s\n";
 	int i, err;
-	int pos = 0;
 
 
 	pci_set_drvdata(dev, priv);
@@ -337,38 +412,14 @@ static int fpga_pcie_setup_pci(struct pci_dev *dev, struct fpga_pcie_priv *priv)
 	/* Make sure that the card is set as a bus master. */
 	pci_set_master(dev);
 
-	/* Get some info on the PCI Express (PCI_CAP_ID_EXP) capabilities */
-	pos = pci_find_capability(dev, PCI_CAP_ID_EXP);
-
-	/* Read the link status */
-	if (pos) {
-		unsigned short linkstat = 0;
-		int link_speed = 0;
-		int link_width = 0;
-
-		pci_read_config_word(dev, pos + PCI_EXP_LNKSTA, &linkstat);
-
-		link_speed = linkstat & PCI_EXP_LNKSTA_CLS;
-		link_width =
-		    (linkstat & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-
-		if (link_speed == PCI_EXP_LNKSTA_CLS_2_5GB) {
-			dev_info(
-			    &dev->dev,
-			    "Link speed is 2.5 GT/s with %d lanes.\n",
-			    link_width);
-		} else if (link_speed == PCI_EXP_LNKSTA_CLS_5_0GB) {
-			dev_info(
-			    &dev->dev,
-			    "Link speed is 5.0 GT/s with %d lanes.\n",
-			    link_width);
-		} else if (link_speed == PCI_EXP_LNKSTA_CLS_8_0GB) {
-			dev_info(
-			    &dev->dev,
-			    "Link speed is 8.0 GT/s with %d lanes.\n",
-			    link_width);
-		}
-	}
+	/* Read the link status, and what it should be, to report it */
+	fpga_pcie_link_update(dev, priv->pci_upstream_dev, &priv->link);
+
+	dev_info(&dev->dev,
+		 "Link speed is %s GT/s with %d lanes (capable of %s GT/s with %d lanes).\n",
+		 fpga_pcie_link_speed_name(priv->link.speed), priv->link.width,
+		 fpga_pcie_link_speed_name(priv->link.target_speed),
+		 priv->link.target_width);
 
 	if (pci_request_regions(dev, DRIVER_NAME)) {
 		dev_err(&dev->dev, "Failed to request regions");
@@ -386,40 +437,29 @@ static int fpga_pcie_setup_pci(struct pci_dev *dev, struct fpga_pcie_priv *priv)
 			unsigned long bar_flags =
 			    pci_resource_flags(dev, i);
 
+			if ((wc_bars & BIT(i)) ||
+			    (!fpga_pcie_csr_bars[i] &&
+			     (bar_flags & IORESOURCE_PREFETCH)))
+				priv->bar_attrs[i] = FPGA_PCIE_BAR_WC;
+			else
+				priv->bar_attrs[i] = FPGA_PCIE_BAR_UC;
+
 			dev_info(&dev->dev, bar_fmt,
 				 i, bar_start, bar_end,
-				 (bar_end - bar_start + 1), bar_flags);
-			priv->bar_addrs[i] = pci_ioremap_bar(dev, i);
-			if (!priv->bar_addrs[i]) {
-				dev_err(&dev->dev,
-					"Failed to remap BAR[%d]\n", i);
-				err = -EIO;
-				goto fail_pci_enable_device;
-			}
-
-			if (i == ALTR_PCI_CVP_PR_BAR) {
-				priv->uio_info.name = dev_name(&dev->dev);
-				priv->uio_info.version = DRIVER_VERSION;
-				priv->uio_info.mem[0].addr = bar_start;
-				priv->uio_info.mem[0].internal_addr =
-					priv->bar_addrs[i];
-				priv->uio_info.mem[0].memtype = UIO_MEM_PHYS;
-				priv->uio_info.mem[0].size =
-					bar_end - bar_start + 1;
-				if (uio_register_device(&dev->dev,
-							&(priv->uio_info))) {
-					dev_err(&dev->dev,
-						"uio_register_device failed\n");
-					priv->uio_info.mem[0].size = 0;
-					err = -EIO;
-					goto fail_pci_enable_device;
-				}
-			}
+				 (bar_end - bar_start + 1), bar_flags,
+				 fpga_pcie_bar_attr_names[priv->bar_attrs[i]]);
 		} else {
 			dev_info(&dev->dev, "BAR[%d] UNUSED\n", i);
 		}
 	}
 
+	err = fpga_pcie_register_uio(priv);
+	if (err)
+		goto fail_pci_enable_device;
+
+	/* what slot_reset() puts back after the link has been reset */
+	pci_save_state(dev);
+
 	return 0;
 
 fail_pci_enable_device:
@@ -436,7 +476,15 @@ static void fpga_pcie_remove(struct pci_dev *dev)
 
 	dev_info(&dev->dev, "%s\n", __func__);
 
+	mutex_lock(&priv->lock);
 	fpga_pcie_remove_all_subdrivers(priv);
+	mutex_unlock(&priv->lock);
+
+	if (priv->cvp_fdev)
+		fpga_pcie_remove_one(priv, priv->cvp_fdev);
+	kfree(priv->cvp.image);
+
+	fpga_pcie_aer_restore(dev, &priv->aer);
 
 	fpga_pcie_shutdown_pci(dev, priv);
 
@@ -476,8 +524,11 @@ static int fpga_pcie_probe(struct pci_dev *dev,
 	priv->state = ST_IDLE;
 
 	INIT_LIST_HEAD(&priv->fdev_list);
+	INIT_LIST_HEAD(&priv->region_list);
 
 	spin_lock_init(&priv->fdev_list_lock);
+	mutex_init(&priv->lock);
+	mutex_init(&priv->bar_lock);
 
 	priv->debugfs_root = debugfs_create_dir(dev_name(&dev->dev),
 						fpga_pcie_debugfs_root);
@@ -502,6 +553,41 @@ static int fpga_pcie_probe(struct pci_dev *dev,
 		return -EIO;
 	}
 
+	if (!debugfs_create_file("link", 0440,
+				 priv->debugfs_root, priv,
+				 &fpga_pcie_link_fops)) {
+		dev_err(&dev->dev, "failed to create link debugfs file\n");
+		debugfs_remove_recursive(priv->debugfs_root);
+		return -EIO;
+	}
+
+	if (!debugfs_create_file("cvp_image", 0660,
+				 priv->debugfs_root, priv,
+				 &fpga_pcie_cvp_image_fops) ||
+	    !debugfs_create_file("cvp_stats", 0440,
+				 priv->debugfs_root, priv,
+				 &fpga_pcie_cvp_stats_fops)) {
+		dev_err(&dev->dev, "failed to create cvp debugfs files\n");
+		debugfs_remove_recursive(priv->debugfs_root);
+		return -EIO;
+	}
+
+	if (!debugfs_create_file("recovery", 0440,
+				 priv->debugfs_root, priv,
+				 &fpga_pcie_recovery_fops)) {
+		dev_err(&dev->dev, "failed to create recovery debugfs file\n");
+		debugfs_remove_recursive(priv->debugfs_root);
+		return -EIO;
+	}
+
+	if (!debugfs_create_file("bars", 0440,
+				 priv->debugfs_root, priv,
+				 &fpga_pcie_bars_fops)) {
+		dev_err(&dev->dev, "failed to create bars debugfs file\n");
+		debugfs_remove_recursive(priv->debugfs_root);
+		return -EIO;
+	}
+
 	err = fpga_pcie_setup_pci(dev, priv);
 
 	if (err) {
@@ -509,6 +595,8 @@ static int fpga_pcie_probe(struct pci_dev *dev,
 		return err;
 	}
 
+	fpga_pcie_probe_cvp(priv);
+
 	return 0;
 }
 
@@ -525,9 +613,15 @@ static void fpga_pcie_unregister_driver(void)
 static void fpga_pcie_print_rom(struct fpga_pcie_priv *priv)
 {
 	struct pci_dev *dev = priv->pci_dev;
-	void __iomem *rom_base_addr = priv->bar_addrs[ALTR_PCI_CVP_CONFIG_BAR] +
-		    		      ALTR_PCI_CONFIG_ROM_OFFSET;
-	int i = fdt_check_header(rom_base_addr);
+	void __iomem *rom_base_addr = fpga_pcie_rom(priv);
+	int i;
+
+	if (!rom_base_addr) {
+		dev_err(&dev->dev, "config ROM not mapped\n");
+		return;
+	}
+
+	i = fdt_check_header(rom_base_addr);
 
 	if (i)
 		dev_err(&dev->dev, "failed to check device tree %d\n", i);
@@ -559,6 +653,7 @@ static ssize_t fpga_pcie_state_write_file(struct file *file,
 	struct device *dev = &(priv->pci_dev->dev);
 	char *buf;
 	ssize_t ret = count;
+	int err;
 
 	buf = devm_kzalloc(dev, count, GFP_KERNEL);
 	if (!buf)
@@ -569,18 +664,25 @@ static ssize_t fpga_pcie_state_write_file(struct file *file,
 		goto error;
 	}
 
+	mutex_lock(&priv->lock);
+
+	if (priv->state == ST_OFFLINE && *buf != '5') {
+		dev_err(dev, "card is offline\n");
+		ret = -EIO;
+		goto unlock;
+	}
+
 	if (*buf == '1'){
 		if (priv->state == ST_AER_DISABLED) {
 			dev_info(dev, "Upstream AER already disabled\n");
 		} else {
 			fpga_pcie_remove_all_subdrivers(priv);
-				
-			priv->aer_uerr_mask_reg = 
-				disable_upstream_aer(priv->pci_dev,
-						     priv->pci_upstream_dev);
 
-			dev_info(dev, "%s aer is %x\n", __func__,
-				 priv->aer_uerr_mask_reg);
+			err = fpga_pcie_aer_quiesce(priv->pci_dev, &priv->aer);
+			if (err) {
+				ret = err;
+				goto unlock;
+			}
 
 			pci_save_state(priv->pci_dev);
 
@@ -589,15 +691,12 @@ static ssize_t fpga_pcie_state_write_file(struct file *file,
 	} else if (*buf == '0'){
 		if (priv->state == ST_AER_DISABLED) {
 			pci_restore_state(priv->pci_dev);
-			dev_info(dev, "%s setting aer to %x\n",
-				 __func__, priv->aer_uerr_mask_reg);
-
-			set_aer_uerr_mask_reg(priv->pci_upstream_dev,
-					      priv->/*
-* USed for after full chip configuration, to ensure the correct speed is reported, and if not,
-* re initialize
-					       */aer_uerr_mask_reg);
-			retrain_device_speed(priv->pci_dev, priv->pci_upstream_dev);
+
+			/* retrain before unmasking so link flaps are not reported */
+			fpga_pcie_link_recover(priv->pci_dev,
+					       priv->pci_upstream_dev,
+					       &priv->link);
+			fpga_pcie_aer_restore(priv->pci_dev, &priv->aer);
 			priv->state = ST_IDLE;
 		} else if (priv->state == ST_IDLE) {
 			dev_info(dev, "PR subsystem already idle\n");
@@ -609,8 +708,7 @@ static ssize_t fpga_pcie_state_write_file(struct file *file,
 	} else if (*buf == '3') {
 		if (priv->state == ST_IDLE) {
 			fpga_pcie_probe_all_subdrivers(priv,
-				priv->bar_addrs[ALTR_PCI_CVP_CONFIG_BAR] +
-				ALTR_PCI_CONFIG_ROM_OFFSET);
+				fpga_pcie_rom(priv));
 		} else if (priv->state == ST_BASE_PROBED) {
 			dev_info(dev, "PR subsystem already probed\n");
 		} else {
@@ -637,6 +735,8 @@ static ssize_t fpga_pcie_state_write_file(struct file *file,
 		ret = -EINVAL;
 	}
 
+unlock:
+	mutex_unlock(&priv->lock);
 error:
 	devm_kfree(dev, buf);
 	dev_info(dev, "Write to file %zu\n", ret);
@@ -720,24 +820,42 @@ static void dump_dtb(struct device *dev, const void *fdt)
 			 regs[0], regs[1], regs[2]);
 	}
 }
+
+static int fpga_pcie_match_name(struct device *dev, void *name)
+{
+	return !strcmp(dev_name(dev), name);
+}
+
+static bool fpga_pcie_has_child(struct device *dev, const char *name)
+{
+	struct device *child;
+
+	child = device_find_child(dev, (void *)name, fpga_pcie_match_name);
+	if (!child)
+		return false;
+
+	put_device(child);
+	return true;
+}
+
 /*
  * Allows us to have a multi card machine setup, by probing each device,
  */
-static int fpga_pcie_probe_one(struct fpga_pcie_priv *priv,
-			struct fpga_drv_entry *drv, void __iomem *regs)
+static struct fdev *fpga_pcie_new_fdev(struct fpga_pcie_priv *priv,
+				       struct fpga_drv_entry *drv,
+				       void __iomem *regs, u32 reg_offset)
 {
 	struct device *dev = &(priv->pci_dev->dev);
 	struct device *new_dev;
 	struct fdev *fdev;
 	int err;
-	unsigned long flags;
 
 	dev_info(dev, "%s 0x%p\n", __func__, regs);
 	fdev = devm_kzalloc(dev, sizeof(*fdev), GFP_KERNEL);
 
 	if (!fdev) {
 		dev_err(dev, "zalloc failed in %s\n", __func__);
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 	}
 
 	new_dev = &fdev->dev;
@@ -746,7 +864,17 @@ static int fpga_pcie_probe_one(struct fpga_pcie_priv *priv,
 	
 	new_dev->parent = dev;
 
-	err = dev_set_name(new_dev, "%s%s", drv->prefix, dev_name(dev));
+	/*
+	 * The first manager keeps the name of the card so existing scripts can
+	 * find it; anything else may appear more than once and gets its offset.
+	 * Every PR IP gets a manager of its own, so regions behind different
+	 * PR IPs can be loaded at the same time.
+	 */
+	if (strlen(drv->prefix) || fpga_pcie_has_child(dev, dev_name(dev)))
+		err = dev_set_name(new_dev, "%s%s.%x", drv->prefix,
+				   dev_name(dev), reg_offset);
+	else
+		err = dev_set_name(new_dev, "%s", dev_name(dev));
 
 	if (err) {
 		dev_err(dev, "dev_set_name failed in %s\n", __func__);
@@ -770,15 +898,197 @@ static int fpga_pcie_probe_one(struct fpga_pcie_priv *priv,
 
 	fdev->remove = drv->remove;
 
+	return fdev;
+
+error:
+	devm_kfree(dev, fdev);
+	return ERR_PTR(err);
+}
+
+static int fpga_pcie_probe_one(struct fpga_pcie_priv *priv,
+			struct fpga_drv_entry *drv, void __iomem *regs,
+			u32 reg_offset, u32 phandle)
+{
+	struct fdev *fdev;
+	unsigned long flags;
+
+	fdev = fpga_pcie_new_fdev(priv, drv, regs, reg_offset);
+	if (IS_ERR(fdev))
+		return PTR_ERR(fdev);
+
+	fdev->phandle = phandle;
+
 	spin_lock_irqsave(&priv->fdev_list_lock, flags);
 	list_add(&fdev->list, &priv->fdev_list);
 	spin_unlock_irqrestore(&priv->fdev_list_lock, flags);
 	return 0;
+}
 
-error:
-	devm_kfree(dev, fdev);
-	return err;
+static struct fdev *fpga_pcie_find_fdev(struct fpga_pcie_priv *priv,
+					u32 phandle)
+{
+	struct fdev *fdev;
+
+	if (!phandle)
+		return NULL;
+
+	list_for_each_entry(fdev, &priv->fdev_list, list) {
+		if (fdev->phandle == phandle)
+			return fdev;
+	}
+
+	return NULL;
+}
+
+static void __iomem *fpga_pcie_region_base(struct fpga_pcie_priv *priv,
+					   const void *fdt, int offset)
+{
+	const u32 *reg;
+	u32 bar, bar_offset;
+	void __iomem *p;
+	int len;
+
+	reg = fdt_getprop(fdt, offset, "reg", &len);
+	if (!reg || len != NUM_REGS*sizeof(*reg))
+		return NULL;
+
+	bar = fdt32_to_cpu(reg[0]);
+	bar_offset = fdt32_to_cpu(reg[1]);
+
+	p = fpga_pcie_bar(priv, bar);
+
+	return p ? p + bar_offset : NULL;
+}
+
+/*
+ * Register a region for every "fpga-region" node, tying together its
+ * manager, its bridges and the persona registers at the base of the region.
+ * Regions that kept their persona, over a driver reload or a host reboot,
+ * come up warm (see the resident attribute of the region) and need not be
+ * loaded again.
+ */
+static void fpga_pcie_register_regions(struct fpga_pcie_priv *priv,
+				       const void *fdt)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	struct fdev *mgr_fdev, *br_fdev;
+	struct fpga_region *region;
+	struct fregion *fregion;
+	const u32 *br_phandles;
+	const u32 *mgr_phandle;
+	const char *name;
+	char *region_name;
+	int offset, len, i, err;
+	int nr_regions = 0, nr_warm = 0;
+
+	for (offset = fdt_node_offset_by_compatible(fdt, -1, "fpga-region");
+	     offset >= 0;
+	     offset = fdt_node_offset_by_compatible(fdt, offset,
+						    "fpga-region")) {
+
+		name = fdt_get_name(fdt, offset, NULL);
+
+		mgr_phandle = fdt_getprop(fdt, offset, "fpga-mgr", &len);
+		if (!mgr_phandle || len != sizeof(*mgr_phandle)) {
+			dev_err(dev, "no fpga-mgr for region %s\n", name);
+			continue;
+		}
+
+		mgr_fdev = fpga_pcie_find_fdev(priv,
+					       fdt32_to_cpu(*mgr_phandle));
+		if (!mgr_fdev) {
+			dev_err(dev, "fpga-mgr for region %s not probed\n",
+				name);
+			continue;
+		}
+
+		/*
+		 * A region is only loadable with all of its bridges, e.g. the
+		 * children of a HPR parent are only there with the parent
+		 * persona loaded.
+		 */
+		br_phandles = fdt_getprop(fdt, offset, "fpga-bridges", &len);
+		if (!br_phandles)
+			len = 0;
+
+		for (i = 0; i < len / sizeof(*br_phandles); i++)
+			if (!fpga_pcie_find_fdev(priv,
+					fdt32_to_cpu(br_phandles[i])))
+				break;
+
+		if (i < len / sizeof(*br_phandles)) {
+			dev_info(dev, "bridge %d for region %s not probed, region skipped\n",
+				 i, name);
+			continue;
+		}
+
+		fregion = devm_kzalloc(dev, sizeof(*fregion), GFP_KERNEL);
+		if (!fregion) {
+			dev_err(dev, "zalloc failed in %s\n", __func__);
+			return;
+		}
+
+		region_name = kasprintf(GFP_KERNEL, "%s.%s", dev_name(dev), name);
+		if (!region_name) {
+			devm_kfree(dev, fregion);
+			return;
+		}
+
+		region = fpga_region_register(dev, region_name, &mgr_fdev->dev,
+					fpga_pcie_region_base(priv, fdt, offset));
+		kfree(region_name);
+
+		if (IS_ERR(region)) {
+			dev_err(dev, "failed to register region %s with %ld\n",
+				name, PTR_ERR(region));
+			devm_kfree(dev, fregion);
+			continue;
+		}
+
+		fregion->region = region;
+		list_add(&fregion->list, &priv->region_list);
+
+		for (i = 0; i < len / sizeof(*br_phandles); i++) {
+			br_fdev = fpga_pcie_find_fdev(priv,
+					fdt32_to_cpu(br_phandles[i]));
+
+			err = fpga_region_attach_bridge(region, &br_fdev->dev);
+			if (err) {
+				dev_err(dev, "failed to attach %s to %s with %d\n",
+					dev_name(&br_fdev->dev), name, err);
+				list_del(&fregion->list);
+				fpga_region_unregister(region);
+				devm_kfree(dev, fregion);
+				break;
+			}
+		}
+	}
+
+	list_for_each_entry(fregion, &priv->region_list, list) {
+		nr_regions++;
+		if (fregion->region->resident == FPGA_REGION_RESIDENT_WARM)
+			nr_warm++;
+	}
+
+	dev_info(dev, "%d of %d regions hold a persona\n", nr_warm, nr_regions);
+}
+
+/*
+ * Regions hold references to the manager and bridge subdevices, so they are
+ * unregistered before any subdevice is removed.
+ */
+static void fpga_pcie_unregister_regions(struct fpga_pcie_priv *priv)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	struct fregion *fregion, *next;
+
+	list_for_each_entry_safe(fregion, next, &priv->region_list, list) {
+		list_del(&fregion->list);
+		fpga_region_unregister(fregion->region);
+		devm_kfree(dev, fregion);
+	}
 }
+
 /*
  * Called after reconfiguration, enumerates the fpga, deploying drivers for all necessary
  * components as defined within the config ROM
@@ -795,6 +1105,11 @@ static int fpga_pcie_probe_all_subdrivers(struct fpga_pcie_priv *priv,
 	u32 regs[NUM_REGS];
 	void __iomem *p;
 
+	if (!fdt) {
+		dev_err(dev, "no device tree in %s\n", __func__);
+		return -ENODEV;
+	}
+
 	i = fdt_check_header(fdt);
 
 	if (i) {
@@ -844,13 +1159,14 @@ static int fpga_pcie_probe_all_subdrivers(struct fpga_pcie_priv *priv,
 
 		dev_info(dev, "%s compatible %s %x %x %x\n", name, compat,
 			 regs[0], regs[1], regs[2]);
-		if ((regs[0] < ALTR_PCI_CVP_NUM_BARS) &&
-		    priv->bar_addrs[regs[0]]) {
-			p = priv->bar_addrs[regs[0]] + regs[1];
-			fpga_pcie_probe_one(priv, drv, p);
-		}
+		p = fpga_pcie_bar(priv, regs[0]);
+		if (p)
+			fpga_pcie_probe_one(priv, drv, p + regs[1], regs[1],
+					    fdt_get_phandle(fdt, offset));
 	}
 
+	fpga_pcie_register_regions(priv, fdt);
+
 	priv->state = ST_BASE_PROBED;
 
 	return 0;
@@ -879,6 +1195,8 @@ static int fpga_pcie_remove_all_subdrivers(struct fpga_pcie_priv *priv)
 	struct list_head *node, *next;
 	struct fdev *fdev;
 
+	fpga_pcie_unregister_regions(priv);
+
 	list_for_each_safe(node, next, &priv->fdev_list) {
 		fdev = list_entry(node, struct fdev, list);
 
@@ -893,6 +1211,191 @@ static int fpga_pcie_remove_all_subdrivers(struct fpga_pcie_priv *priv)
 
 	return 0;
 }
+
+/*
+ * The CvP manager belongs to the PCIe hard IP rather than to the design in
+ * the core, so it lives as long as the card does.
+ */
+static void fpga_pcie_probe_cvp(struct fpga_pcie_priv *priv)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	struct fdev *fdev;
+
+	fdev = fpga_pcie_new_fdev(priv, &fpga_cvp_drv,
+				  fpga_pcie_bar(priv, ALTR_PCI_CVP_DATA_BAR), 0);
+	if (IS_ERR(fdev)) {
+		dev_info(dev, "CvP updates not available (%ld)\n",
+			 PTR_ERR(fdev));
+		return;
+	}
+
+	priv->cvp_fdev = fdev;
+}
+
+static void fpga_pcie_cvp_phase_done(unsigned long *phase_us,
+				     enum fpga_pcie_cvp_phase phase,
+				     ktime_t *t)
+{
+	ktime_t now = ktime_get();
+
+	phase_us[phase] = ktime_us_delta(now, *t);
+	*t = now;
+}
+
+static int fpga_pcie_cvp_mask_aer(struct fpga_pcie_priv *priv,
+				  unsigned long *phase_us)
+{
+	ktime_t t = ktime_get();
+	int ret;
+
+	ret = fpga_pcie_aer_quiesce(priv->pci_dev, &priv->aer);
+	if (ret)
+		return ret;
+
+	pci_save_state(priv->pci_dev);
+
+	fpga_pcie_cvp_phase_done(phase_us, CVP_PHASE_MASK_AER, &t);
+
+	return 0;
+}
+
+/*
+ * Writes image through CvP with upstream AER masked, brings the link and
+ * AER back whether or not that worked, then probes the design described by
+ * the new config ROM.  A core that did not come up, or whose ROM is not
+ * valid, is reported as an error.
+ */
+static int fpga_pcie_cvp_load(struct fpga_pcie_priv *priv, const char *image,
+			      unsigned long *phase_us)
+{
+	struct fpga_image_info info = {
+		.config_complete_timeout_us = FPGA_PCIE_CVP_USERMODE_TIMEOUT_US,
+	};
+	struct fpga_manager *mgr;
+	ktime_t t = ktime_get();
+	int ret;
+
+	mgr = fpga_mgr_get(&priv->cvp_fdev->dev);
+	if (IS_ERR(mgr)) {
+		ret = PTR_ERR(mgr);
+	} else {
+		ret = fpga_mgr_firmware_load(mgr, &info, image);
+		fpga_mgr_put(mgr);
+	}
+	fpga_pcie_cvp_phase_done(phase_us, CVP_PHASE_PROGRAM, &t);
+
+	pci_restore_state(priv->pci_dev);
+	fpga_pcie_link_recover(priv->pci_dev, priv->pci_upstream_dev,
+			       &priv->link);
+	fpga_pcie_aer_restore(priv->pci_dev, &priv->aer);
+	fpga_pcie_cvp_phase_done(phase_us, CVP_PHASE_RESTORE, &t);
+
+	if (ret)
+		return ret;
+
+	ret = fpga_pcie_probe_all_subdrivers(priv, fpga_pcie_rom(priv));
+	fpga_pcie_cvp_phase_done(phase_us, CVP_PHASE_REPROBE, &t);
+
+	return ret;
+}
+
+/*
+ * Full chip configuration in one step, replacing writing 1 to the state
+ * file, running an external programmer, writing 0 and then 3.  If the new
+ * image does not come up, the last image loaded through here is put back.
+ */
+static int fpga_pcie_cvp_update(struct fpga_pcie_priv *priv,
+				const char *image)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	struct fpga_pcie_cvp *cvp = &priv->cvp;
+	unsigned long rollback_phase_us[CVP_NUM_PHASES];
+	ktime_t start, t;
+	char *name;
+	int ret, err;
+
+	if (!priv->cvp_fdev)
+		return -ENODEV;
+
+	name = kstrdup(image, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	mutex_lock(&priv->lock);
+
+	if (priv->state == ST_AER_DISABLED) {
+		dev_err(dev, "full chip configuration already in progress\n");
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (priv->state == ST_OFFLINE) {
+		dev_err(dev, "card is offline\n");
+		ret = -EIO;
+		goto out;
+	}
+
+	memset(cvp->phase_us, 0, sizeof(cvp->phase_us));
+	cvp->rollback_us = 0;
+	cvp->updates++;
+
+	start = t = ktime_get();
+
+	fpga_pcie_remove_all_subdrivers(priv);
+	fpga_pcie_cvp_phase_done(cvp->phase_us, CVP_PHASE_QUIESCE, &t);
+
+	ret = fpga_pcie_cvp_mask_aer(priv, cvp->phase_us);
+	if (ret) {
+		/* nothing was changed, put the current design back */
+		fpga_pcie_probe_all_subdrivers(priv, fpga_pcie_rom(priv));
+	} else {
+		ret = fpga_pcie_cvp_load(priv, name, cvp->phase_us);
+	}
+
+	cvp->total_us = ktime_us_delta(ktime_get(), start);
+	cvp->last_err = ret;
+
+	if (!ret) {
+		dev_info(dev, "CvP update to %s done in %lu us\n", name,
+			 cvp->total_us);
+		kfree(cvp->image);
+		cvp->image = name;
+		name = NULL;
+		goto out;
+	}
+
+	cvp->failures++;
+	dev_err(dev, "CvP update to %s failed with %d\n", name, ret);
+
+	if (!cvp->image || priv->state == ST_BASE_PROBED)
+		goto out;
+
+	dev_warn(dev, "rolling back to %s\n", cvp->image);
+	cvp->rollbacks++;
+	t = ktime_get();
+
+	fpga_pcie_remove_all_subdrivers(priv);
+
+	err = fpga_pcie_cvp_mask_aer(priv, rollback_phase_us);
+	if (!err)
+		err = fpga_pcie_cvp_load(priv, cvp->image, rollback_phase_us);
+
+	cvp->rollback_us = ktime_us_delta(ktime_get(), t);
+
+	if (err)
+		dev_err(dev, "rollback to %s failed with %d\n", cvp->image,
+			err);
+	else
+		dev_info(dev, "rolled back to %s in %lu us\n", cvp->image,
+			 cvp->rollback_us);
+
+out:
+	mutex_unlock(&priv->lock);
+	kfree(name);
+
+	return ret;
+}
+
 /*
  * Update the device tree without having to change the rom, used in the event of the rom having 
  * incorrect offsets.
@@ -917,9 +1420,18 @@ static ssize_t fpga_pcie_base_dtb_write_file(struct file *file,
 		goto error;
 	}
 
-	fpga_pcie_remove_all_subdrivers(priv);
+	mutex_lock(&priv->lock);
+
+	if (priv->state == ST_OFFLINE) {
+		dev_err(dev, "card is offline\n");
+		ret = -EIO;
+	} else {
+		fpga_pcie_remove_all_subdrivers(priv);
+
+		fpga_pcie_probe_all_subdrivers(priv, buf);
+	}
 
-	fpga_pcie_probe_all_subdrivers(priv, buf);
+	mutex_unlock(&priv->lock);
 
 error:
 	devm_kfree(dev, buf);
@@ -932,6 +1444,437 @@ static const struct file_operations fpga_pcie_base_dtb_fops = {
 	.llseek = default_llseek,
 } ;
 
+/*
+ * FOP for the link file, reports the link as negotiated and the outcome of
+ * the last link recovery after a full chip configuration.
+ */
+static ssize_t fpga_pcie_link_read_file(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct fpga_pcie_priv *priv = file->private_data;
+	struct fpga_pcie_link *link = &priv->link;
+	char *buf;
+	int ret;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = scnprintf(buf, PAGE_SIZE,
+			"speed: %s GT/s\n"
+			"width: %u\n"
+			"target_speed: %s GT/s\n"
+			"target_width: %u\n"
+			"last_up_us: %lu\n"
+			"last_retrains: %u\n"
+			"recoveries: %lu\n"
+			"retrains: %lu\n"
+			"failures: %lu\n",
+			fpga_pcie_link_speed_name(link->speed), link->width,
+			fpga_pcie_link_speed_name(link->target_speed),
+			link->target_width, link->last_up_us,
+			link->last_retrains, link->recoveries, link->retrains,
+			link->failures);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, ret);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations fpga_pcie_link_fops = {
+	.open = simple_open,
+	.read = fpga_pcie_link_read_file,
+	.llseek = default_llseek,
+};
+
+/*
+ * FOPs for the cvp_image file.  Writing the name of a core image in
+ * /lib/firmware performs a full chip configuration with it; reading gives
+ * the last image loaded that way.
+ */
+static ssize_t fpga_pcie_cvp_image_write_file(struct file *file,
+					      const char __user *user_buf,
+					      size_t count, loff_t *ppos)
+{
+	struct fpga_pcie_priv *priv = file->private_data;
+	char *name;
+	int ret;
+
+	name = memdup_user_nul(user_buf, count);
+	if (IS_ERR(name))
+		return PTR_ERR(name);
+
+	strim(name);
+
+	ret = fpga_pcie_cvp_update(priv, name);
+
+	kfree(name);
+
+	return ret ? ret : count;
+}
+
+static ssize_t fpga_pcie_cvp_image_read_file(struct file *file,
+					     char __user *user_buf,
+					     size_t count, loff_t *ppos)
+{
+	struct fpga_pcie_priv *priv = file->private_data;
+	char *buf;
+	int ret;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&priv->lock);
+	ret = scnprintf(buf, PAGE_SIZE, "%s\n",
+			priv->cvp.image ? priv->cvp.image : "");
+	mutex_unlock(&priv->lock);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, ret);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations fpga_pcie_cvp_image_fops = {
+	.open = simple_open,
+	.read = fpga_pcie_cvp_image_read_file,
+	.write = fpga_pcie_cvp_image_write_file,
+	.llseek = default_llseek,
+};
+
+/*
+ * FOP for the cvp_stats file, the time taken by each phase of the last CvP
+ * update and the outcome of all updates.
+ */
+static ssize_t fpga_pcie_cvp_stats_read_file(struct file *file,
+					     char __user *user_buf,
+					     size_t count, loff_t *ppos)
+{
+	struct fpga_pcie_priv *priv = file->private_data;
+	struct fpga_pcie_cvp *cvp = &priv->cvp;
+	char *buf;
+	int i, ret = 0;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&priv->lock);
+
+	for (i = 0; i < CVP_NUM_PHASES; i++)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%s_us: %lu\n",
+				 cvp_phase_names[i], cvp->phase_us[i]);
+
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+			 "total_us: %lu\n"
+			 "rollback_us: %lu\n"
+			 "last_err: %d\n"
+			 "updates: %lu\n"
+			 "failures: %lu\n"
+			 "rollbacks: %lu\n",
+			 cvp->total_us, cvp->rollback_us, cvp->last_err,
+			 cvp->updates, cvp->failures, cvp->rollbacks);
+
+	mutex_unlock(&priv->lock);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, ret);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations fpga_pcie_cvp_stats_fops = {
+	.open = simple_open,
+	.read = fpga_pcie_cvp_stats_read_file,
+	.llseek = default_llseek,
+};
+
+/*
+ * Takes the card offline for error recovery, a reset or suspend.  Removing
+ * the subdrivers waits for region loads in flight, and taking the card lock
+ * for a full chip configuration or state file write in flight, so nothing
+ * touches the card while it is away.  The CvP manager only holds the BAR
+ * mapping, which stays valid across a reset, and is kept.
+ */
+static void fpga_pcie_go_offline(struct fpga_pcie_priv *priv)
+{
+	struct fpga_pcie_recovery *rec = &priv->recovery;
+
+	mutex_lock(&priv->lock);
+
+	if (priv->state != ST_OFFLINE) {
+		rec->start = ktime_get();
+		rec->prev_state = priv->state;
+
+		if (priv->state == ST_BASE_PROBED)
+			fpga_pcie_remove_all_subdrivers(priv);
+
+		priv->state = ST_OFFLINE;
+	}
+
+	mutex_unlock(&priv->lock);
+}
+
+/*
+ * Brings the card back after fpga_pcie_go_offline(), once its config space
+ * has been restored.  Only what was there before is brought back: the
+ * subdrivers are probed again from the config ROM if they were probed, and
+ * a card that was in the middle of a full chip configuration is left with
+ * upstream AER masked for the user to finish it.
+ */
+static int fpga_pcie_go_online(struct fpga_pcie_priv *priv)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	struct fpga_pcie_recovery *rec = &priv->recovery;
+	int ret = 0;
+
+	mutex_lock(&priv->lock);
+
+	if (priv->state != ST_OFFLINE)
+		goto out;
+
+	if (rec->prev_state != ST_AER_DISABLED)
+		fpga_pcie_link_recover(priv->pci_dev, priv->pci_upstream_dev,
+				       &priv->link);
+
+	if (rec->prev_state == ST_BASE_PROBED) {
+		priv->state = ST_IDLE;
+		ret = fpga_pcie_probe_all_subdrivers(priv, fpga_pcie_rom(priv));
+	} else {
+		priv->state = rec->prev_state;
+	}
+
+	rec->last_us = ktime_us_delta(ktime_get(), rec->start);
+
+	if (ret) {
+		rec->failures++;
+		dev_err(dev, "failed to probe subdrivers after %lu us with %d\n",
+			rec->last_us, ret);
+	} else {
+		rec->recoveries++;
+		dev_info(dev, "back online in %lu us\n", rec->last_us);
+	}
+
+out:
+	mutex_unlock(&priv->lock);
+
+	return ret;
+}
+
+/*
+ * A fatal error leaves the link frozen until it is reset; nothing is read
+ * from the card until then.  A non fatal error only needs the subdrivers
+ * restarted.
+ */
+static pci_ers_result_t fpga_pcie_error_detected(struct pci_dev *dev,
+						 pci_channel_state_t state)
+{
+	struct fpga_pcie_priv *priv = pci_get_drvdata(dev);
+
+	dev_err(&dev->dev, "PCI error detected, channel state %d\n", state);
+
+	priv->recovery.errors++;
+
+	if (state == pci_channel_io_perm_failure) {
+		priv->recovery.failures++;
+		return PCI_ERS_RESULT_DISCONNECT;
+	}
+
+	fpga_pcie_go_offline(priv);
+
+	if (state == pci_channel_io_normal)
+		return PCI_ERS_RESULT_CAN_RECOVER;
+
+	pci_disable_device(dev);
+
+	return PCI_ERS_RESULT_NEED_RESET;
+}
+
+static pci_ers_result_t fpga_pcie_slot_reset(struct pci_dev *dev)
+{
+	struct fpga_pcie_priv *priv = pci_get_drvdata(dev);
+
+	dev_info(&dev->dev, "%s\n", __func__);
+
+	priv->recovery.resets++;
+
+	if (pci_enable_device(dev)) {
+		dev_err(&dev->dev, "pci_enable_device() failed after reset\n");
+		priv->recovery.failures++;
+		return PCI_ERS_RESULT_DISCONNECT;
+	}
+
+	pci_restore_state(dev);
+	/* restoring consumes the saved state on some kernels */
+	pci_save_state(dev);
+	pci_set_master(dev);
+
+	return PCI_ERS_RESULT_RECOVERED;
+}
+
+static void fpga_pcie_error_resume(struct pci_dev *dev)
+{
+	fpga_pcie_go_online(pci_get_drvdata(dev));
+}
+
+/*
+ * A function level reset, e.g. through the reset file in sysfs.  The PCI
+ * core saves and restores config space around it.
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0))
+static void fpga_pcie_reset_prepare(struct pci_dev *dev)
+{
+	fpga_pcie_go_offline(pci_get_drvdata(dev));
+}
+
+static void fpga_pcie_reset_done(struct pci_dev *dev)
+{
+	struct fpga_pcie_priv *priv = pci_get_drvdata(dev);
+
+	priv->recovery.resets++;
+	fpga_pcie_go_online(priv);
+}
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0))
+static void fpga_pcie_reset_notify(struct pci_dev *dev, bool prepare)
+{
+	struct fpga_pcie_priv *priv = pci_get_drvdata(dev);
+
+	if (prepare) {
+		fpga_pcie_go_offline(priv);
+	} else {
+		priv->recovery.resets++;
+		fpga_pcie_go_online(priv);
+	}
+}
+#endif
+
+static const struct pci_error_handlers fpga_pcie_err_handler = {
+	.error_detected = fpga_pcie_error_detected,
+	.slot_reset = fpga_pcie_slot_reset,
+	.resume = fpga_pcie_error_resume,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0))
+	.reset_prepare = fpga_pcie_reset_prepare,
+	.reset_done = fpga_pcie_reset_done,
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0))
+	.reset_notify = fpga_pcie_reset_notify,
+#endif
+};
+
+/*
+ * System sleep.  The PCI core saves config space and powers the card down
+ * after suspend, and powers it up and restores config space before resume.
+ */
+static int __maybe_unused fpga_pcie_suspend(struct device *dev)
+{
+	fpga_pcie_go_offline(dev_get_drvdata(dev));
+
+	return 0;
+}
+
+static int __maybe_unused fpga_pcie_resume(struct device *dev)
+{
+	fpga_pcie_go_online(dev_get_drvdata(dev));
+
+	/* the card is usable without its subdrivers, don't fail resume */
+	return 0;
+}
+
+static SIMPLE_DEV_PM_OPS(fpga_pcie_pm_ops, fpga_pcie_suspend, fpga_pcie_resume);
+
+/*
+ * FOP for the recovery file, the number of errors, resets and recoveries
+ * and how long the card was offline for the last time.
+ */
+static ssize_t fpga_pcie_recovery_read_file(struct file *file,
+					    char __user *user_buf,
+					    size_t count, loff_t *ppos)
+{
+	struct fpga_pcie_priv *priv = file->private_data;
+	struct fpga_pcie_recovery *rec = &priv->recovery;
+	char *buf;
+	int ret;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = scnprintf(buf, PAGE_SIZE,
+			"last_us: %lu\n"
+			"errors: %lu\n"
+			"resets: %lu\n"
+			"recoveries: %lu\n"
+			"failures: %lu\n",
+			rec->last_us, rec->errors, rec->resets,
+			rec->recoveries, rec->failures);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, ret);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations fpga_pcie_recovery_fops = {
+	.open = simple_open,
+	.read = fpga_pcie_recovery_read_file,
+	.llseek = default_llseek,
+};
+
+/*
+ * FOP for the bars file, how each BAR is mapped, whether the kernel has
+ * mapped it yet and which UIO map it is.
+ */
+static ssize_t fpga_pcie_bars_read_file(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct fpga_pcie_priv *priv = file->private_data;
+	struct pci_dev *dev = priv->pci_dev;
+	char *buf;
+	int i, map, ret = 0;
+
+	buf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&priv->bar_lock);
+
+	for (i = 0; i < ALTR_PCI_CVP_NUM_BARS; i++) {
+		if (!pci_resource_len(dev, i))
+			continue;
+
+		for (map = 0; map < MAX_UIO_MAPS; map++) {
+			if (priv->uio_info.mem[map].size &&
+			    priv->uio_bars[map] == i)
+				break;
+		}
+
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+				 "bar%d: size 0x%llx prefetch %d %s mapped %d uio_map %d\n",
+				 i, (unsigned long long)pci_resource_len(dev, i),
+				 !!(pci_resource_flags(dev, i) &
+				    IORESOURCE_PREFETCH),
+				 fpga_pcie_bar_attr_names[priv->bar_attrs[i]],
+				 !!priv->bar_addrs[i],
+				 map < MAX_UIO_MAPS ? map : -1);
+	}
+
+	mutex_unlock(&priv->bar_lock);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, ret);
+	kfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations fpga_pcie_bars_fops = {
+	.open = simple_open,
+	.read = fpga_pcie_bars_read_file,
+	.llseek = default_llseek,
+};
+
 /*
  * Initialize the driver module (but not any device) and register
  * the module with the kernel PCI subsystem. This is called only 
@@ -995,7 +1938,8 @@ static struct pci_driver fpga_pcie_driver = {
 	.id_table = fpga_pcie_pci_ids,
 	.probe = fpga_pcie_probe,
 	.remove = fpga_pcie_remove,
-	/* resume and suspend are optional */
+	.err_handler = &fpga_pcie_err_handler,
+	.driver.pm = &fpga_pcie_pm_ops,
 };
 
 MODULE_AUTHOR("Kalen Brunham <kbrunham@intel.com>");
@@ -0,0 +1,510 @@
+/*
+ * FPGA Region - a PR region programmed by a manager behind its bridges
+ *
+ *  Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <linux/fpga/fpga-bridge.h>
+#include <linux/fpga/fpga-region.h>
+#include <linux/idr.h>
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static DEFINE_IDA(fpga_region_ida);
+static struct class *fpga_region_class;
+
+/* Same defaults program-fpga-pcie writes to the manager's debugfs */
+#define FPGA_REGION_DEFAULT_FLAGS		FPGA_MGR_PARTIAL_RECONFIG
+#define FPGA_REGION_DEFAULT_CONFIG_TO		10
+
+static const char * const fpga_region_resident_names[] = {
+	[FPGA_REGION_RESIDENT_NONE] = "none",
+	[FPGA_REGION_RESIDENT_WARM] = "warm",
+	[FPGA_REGION_RESIDENT_LOADED] = "loaded",
+};
+
+const char *fpga_region_resident_name(enum fpga_region_resident resident)
+{
+	return fpga_region_resident_names[resident];
+}
+EXPORT_SYMBOL_GPL(fpga_region_resident_name);
+
+static u32 fpga_region_read_persona(struct fpga_region *region)
+{
+	if (!region->persona_base)
+		return FPGA_REGION_PERSONA_NONE;
+
+	return readl(region->persona_base + FPGA_REGION_PERSONA_ID_OFFSET);
+}
+
+/*
+ * A card keeps its configuration over a driver reload or a host reboot, so
+ * a region may already hold a persona when it is registered.  The persona
+ * ID it reports is only trusted when the region's PR IP is idle after a
+ * successful load, or has not loaded anything since the chip was
+ * configured.  A PR IP that failed or was interrupted does not say which of
+ * its regions it was loading, so then all of them have to be loaded again.
+ */
+static void fpga_region_attach_resident(struct fpga_region *region)
+{
+	region->persona_id = fpga_region_read_persona(region);
+	region->resident = FPGA_REGION_RESIDENT_NONE;
+
+	if (region->persona_id == FPGA_REGION_PERSONA_NONE)
+		return;
+
+	switch (region->mgr->state) {
+	case FPGA_MGR_STATE_RESET:
+	case FPGA_MGR_STATE_OPERATING:
+		region->resident = FPGA_REGION_RESIDENT_WARM;
+		break;
+	default:
+		region->persona_id = FPGA_REGION_PERSONA_NONE;
+		break;
+	}
+}
+
+/*
+ * Disables the region's bridges, has the manager load the image and enables
+ * the bridges again.  On success the persona ID is read back from the region
+ * and the load statistics are updated.  If loading fails the bridges are left
+ * disabled and the persona is reported as FPGA_REGION_PERSONA_NONE.  The
+ * manager is taken exclusively for the load, so a region whose manager is
+ * loading another region, or is used through debugfs, gets -EBUSY.
+ *
+ * With stream set, image_name is a path that is streamed through
+ * fpga_mgr_file_load() instead of being requested as firmware.
+ */
+static int fpga_region_load(struct fpga_region *region,
+			    const char *image_name, bool stream)
+{
+	struct device *dev = &region->dev;
+	struct fpga_manager *mgr = region->mgr;
+	struct timeval start_time, end_time;
+	int ret;
+
+	mutex_lock(&region->mutex);
+
+	/* Refused with -EBUSY while another load holds the manager */
+	mgr = fpga_mgr_get(mgr->dev.parent);
+	if (IS_ERR(mgr)) {
+		ret = PTR_ERR(mgr);
+		dev_err(dev, "failed to get fpga manager with %d\n", ret);
+		goto err_unlock;
+	}
+
+	do_gettimeofday(&start_time);
+
+	ret = fpga_bridges_disable(&region->bridge_list);
+	if (ret) {
+		dev_err(dev, "failed to disable region bridges\n");
+		goto err_put;
+	}
+
+	region->persona_id = FPGA_REGION_PERSONA_NONE;
+	region->resident = FPGA_REGION_RESIDENT_NONE;
+
+	if (stream)
+		ret = fpga_mgr_file_load(mgr, &region->info, image_name);
+	else
+		ret = fpga_mgr_firmware_load(mgr, &region->info, image_name);
+	if (ret) {
+		dev_err(dev, "failed to load %s\n", image_name);
+		goto err_put;
+	}
+
+	ret = fpga_bridges_enable(&region->bridge_list);
+	if (ret) {
+		dev_err(dev, "failed to enable region bridges\n");
+		goto err_put;
+	}
+
+	do_gettimeofday(&end_time);
+
+	region->persona_id = fpga_region_read_persona(region);
+	region->resident = FPGA_REGION_RESIDENT_LOADED;
+	region->load_count++;
+	region->last_load = end_time;
+	region->last_load_us = (end_time.tv_sec - start_time.tv_sec) *
+			       USEC_PER_SEC +
+			       (end_time.tv_usec - start_time.tv_usec);
+
+	dev_info(dev, "loaded %s, persona 0x%x in %lu us\n", image_name,
+		 region->persona_id, region->last_load_us);
+
+err_put:
+	fpga_mgr_put(mgr);
+err_unlock:
+	mutex_unlock(&region->mutex);
+
+	return ret;
+}
+
+/**
+ * fpga_region_program_fpga - load an image into a region
+ * @region:	FPGA region
+ * @image_name:	name of the image file in the firmware search path
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_region_program_fpga(struct fpga_region *region,
+			     const char *image_name)
+{
+	return fpga_region_load(region, image_name, false);
+}
+EXPORT_SYMBOL_GPL(fpga_region_program_fpga);
+
+/**
+ * fpga_region_program_file - stream an image from a file into a region
+ * @region:	FPGA region
+ * @path:	path of the image file, which may also be a FIFO
+ *
+ * Like fpga_region_program_fpga(), but the image is streamed in chunks, so it
+ * can come from a decompressor writing into a FIFO.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_region_program_file(struct fpga_region *region, const char *path)
+{
+	return fpga_region_load(region, path, true);
+}
+EXPORT_SYMBOL_GPL(fpga_region_program_file);
+
+static int fpga_region_name_match(struct device *dev, const void *data)
+{
+	return !strcmp(dev_name(dev), data);
+}
+
+/**
+ * fpga_region_load_by_name - load an image into a region found by name
+ * @region_name:	name of the region device
+ * @image_name:		name of the image file in the firmware search path
+ *
+ * Return: 0 on success, -ENODEV if no region has that name, or the error
+ * from fpga_region_program_fpga().
+ */
+int fpga_region_load_by_name(const char *region_name, const char *image_name)
+{
+	struct device *dev;
+	int ret;
+
+	dev = class_find_device(fpga_region_class, NULL, region_name,
+				fpga_region_name_match);
+	if (!dev)
+		return -ENODEV;
+
+	ret = fpga_region_program_fpga(to_fpga_region(dev), image_name);
+
+	put_device(dev);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_region_load_by_name);
+
+/**
+ * fpga_region_attach_bridge - add a bridge to a region
+ * @region:	FPGA region
+ * @br_dev:	device the bridge was registered against
+ *
+ * Takes an exclusive reference to the bridge until the region is
+ * unregistered.  A warm region whose bridge is disabled was left frozen by
+ * a load that did not finish, so its persona is dropped.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_region_attach_bridge(struct fpga_region *region,
+			      struct device *br_dev)
+{
+	struct fpga_bridge *bridge;
+	int ret;
+
+	mutex_lock(&region->mutex);
+	ret = fpga_bridge_get_to_list(br_dev, &region->info,
+				      &region->bridge_list);
+	if (!ret && region->resident == FPGA_REGION_RESIDENT_WARM) {
+		bridge = list_first_entry(&region->bridge_list,
+					  struct fpga_bridge, node);
+		if (bridge->br_ops && bridge->br_ops->enable_show &&
+		    !bridge->br_ops->enable_show(bridge)) {
+			region->persona_id = FPGA_REGION_PERSONA_NONE;
+			region->resident = FPGA_REGION_RESIDENT_NONE;
+		}
+	}
+	mutex_unlock(&region->mutex);
+
+	if (!ret)
+		dev_info(&region->dev, "attached bridge %s\n",
+			 dev_name(br_dev));
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_region_attach_bridge);
+
+static ssize_t persona_id_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+
+	return sprintf(buf, "0x%x\n", region->persona_id);
+}
+
+static ssize_t resident_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+	ssize_t ret;
+
+	mutex_lock(&region->mutex);
+	ret = sprintf(buf, "0x%x %s\n", region->persona_id,
+		      fpga_region_resident_name(region->resident));
+	mutex_unlock(&region->mutex);
+
+	return ret;
+}
+
+static ssize_t load_count_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+
+	return sprintf(buf, "%lu\n", region->load_count);
+}
+
+static ssize_t last_load_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+	ssize_t ret;
+
+	mutex_lock(&region->mutex);
+	ret = sprintf(buf, "%ld.%06ld %lu\n", region->last_load.tv_sec,
+		      region->last_load.tv_usec, region->last_load_us);
+	mutex_unlock(&region->mutex);
+
+	return ret;
+}
+
+static ssize_t manager_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+
+	return sprintf(buf, "%s\n", dev_name(region->mgr->dev.parent));
+}
+
+/* One line per bridge, the name of the device it was registered against */
+static ssize_t bridges_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+	struct fpga_bridge *bridge;
+	ssize_t ret = 0;
+
+	mutex_lock(&region->mutex);
+	list_for_each_entry(bridge, &region->bridge_list, node)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%s\n",
+				 dev_name(bridge->dev.parent));
+	mutex_unlock(&region->mutex);
+
+	return ret;
+}
+
+static ssize_t firmware_name_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+	char *image_name;
+	int ret;
+
+	image_name = kstrndup(buf, count, GFP_KERNEL);
+	if (!image_name)
+		return -ENOMEM;
+
+	/* Remove any whitespace, e.g. the newline added by echo */
+	strim(image_name);
+
+	ret = fpga_region_program_fpga(region, image_name);
+
+	kfree(image_name);
+
+	return ret ? ret : count;
+}
+
+static ssize_t image_file_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+	char *path;
+	int ret;
+
+	path = kstrndup(buf, count, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+
+	strim(path);
+
+	ret = fpga_region_program_file(region, path);
+
+	kfree(path);
+
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RO(persona_id);
+static DEVICE_ATTR_RO(resident);
+static DEVICE_ATTR_RO(load_count);
+static DEVICE_ATTR_RO(last_load);
+static DEVICE_ATTR_RO(manager);
+static DEVICE_ATTR_RO(bridges);
+static DEVICE_ATTR_WO(firmware_name);
+static DEVICE_ATTR_WO(image_file);
+
+static struct attribute *fpga_region_attrs[] = {
+	&dev_attr_persona_id.attr,
+	&dev_attr_resident.attr,
+	&dev_attr_load_count.attr,
+	&dev_attr_last_load.attr,
+	&dev_attr_manager.attr,
+	&dev_attr_bridges.attr,
+	&dev_attr_firmware_name.attr,
+	&dev_attr_image_file.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(fpga_region);
+
+/**
+ * fpga_region_register - register a FPGA region
+ * @dev:		device that owns the region
+ * @name:		name of the region device, unique across the system
+ * @mgr_dev:		device the region's fpga manager was registered against
+ * @persona_base:	mapped base of the region, or NULL if not mapped
+ *
+ * Return: fpga_region struct or IS_ERR() condition containing error code.
+ */
+struct fpga_region *fpga_region_register(struct device *dev, const char *name,
+					 struct device *mgr_dev,
+					 void __iomem *persona_base)
+{
+	struct fpga_manager *mgr = dev_get_drvdata(mgr_dev);
+	struct fpga_region *region;
+	int id, ret;
+
+	if (!mgr) {
+		dev_err(dev, "no fpga manager registered for %s\n",
+			dev_name(mgr_dev));
+		return ERR_PTR(-ENODEV);
+	}
+
+	region = kzalloc(sizeof(*region), GFP_KERNEL);
+	if (!region)
+		return ERR_PTR(-ENOMEM);
+
+	id = ida_simple_get(&fpga_region_ida, 0, 0, GFP_KERNEL);
+	if (id < 0) {
+		ret = id;
+		goto error_kfree;
+	}
+
+	mutex_init(&region->mutex);
+	INIT_LIST_HEAD(&region->bridge_list);
+
+	region->mgr = mgr;
+	region->persona_base = persona_base;
+	region->info.flags = FPGA_REGION_DEFAULT_FLAGS;
+	region->info.config_complete_timeout_us = FPGA_REGION_DEFAULT_CONFIG_TO;
+	fpga_region_attach_resident(region);
+
+	device_initialize(&region->dev);
+	region->dev.class = fpga_region_class;
+	region->dev.parent = dev;
+	region->dev.id = id;
+
+	ret = dev_set_name(&region->dev, "%s", name);
+	if (ret)
+		goto error_device;
+
+	get_device(&mgr->dev);
+
+	ret = device_add(&region->dev);
+	if (ret) {
+		put_device(&mgr->dev);
+		goto error_device;
+	}
+
+	dev_info(dev, "fpga region [%s] registered, persona 0x%x %s\n",
+		 name, region->persona_id,
+		 fpga_region_resident_name(region->resident));
+
+	return region;
+
+error_device:
+	ida_simple_remove(&fpga_region_ida, id);
+error_kfree:
+	kfree(region);
+
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(fpga_region_register);
+
+/**
+ * fpga_region_unregister - unregister a FPGA region
+ * @region: FPGA region
+ *
+ * Releases the region's bridges and its reference to the manager.  The
+ * region device is deleted first: that removes its attributes and waits for
+ * stores in progress, so no load can start without bridges or manager.
+ */
+void fpga_region_unregister(struct fpga_region *region)
+{
+	device_del(&region->dev);
+
+	mutex_lock(&region->mutex);
+	fpga_bridges_put(&region->bridge_list);
+	mutex_unlock(&region->mutex);
+
+	put_device(&region->mgr->dev);
+
+	put_device(&region->dev);
+}
+EXPORT_SYMBOL_GPL(fpga_region_unregister);
+
+static void fpga_region_dev_release(struct device *dev)
+{
+	struct fpga_region *region = to_fpga_region(dev);
+
+	ida_simple_remove(&fpga_region_ida, region->dev.id);
+	kfree(region);
+}
+
+int fpga_region_class_init(void)
+{
+	fpga_region_class = class_create(THIS_MODULE, "fpga_region");
+	if (IS_ERR(fpga_region_class))
+		return PTR_ERR(fpga_region_class);
+
+	fpga_region_class->dev_groups = fpga_region_groups;
+	fpga_region_class->dev_release = fpga_region_dev_release;
+
+	return 0;
+}
+
+void fpga_region_class_exit(void)
+{
+	class_destroy(fpga_region_class);
+	ida_destroy(&fpga_region_ida);
+}
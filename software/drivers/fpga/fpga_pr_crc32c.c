@@ -0,0 +1,171 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "fpga_pr_crc32c.h"
+
+#if defined(__x86_64__)
+#define PR_CRC_HAVE_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+/* The CRC32C polynomial, bit reversed */
+#define PR_CRC_POLY		0x82f63b78u
+
+/*
+ * The hardware loop runs three CRCs over neighbouring lanes of
+ * PR_CRC_LANE bytes, so the latency of the crc32 instruction is hidden,
+ * and joins them with PR_CRC_LANE_SHIFT, x^(8 * PR_CRC_LANE) mod P.
+ */
+#define PR_CRC_LANE		8192
+#define PR_CRC_LANE_SHIFT	0x28461564
+
+static uint32_t crc_table[256];
+static int crc_hardware;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static int crc_have_sse42(void);
+
+static void crc_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = crc & 1 ? (crc >> 1) ^ PR_CRC_POLY : crc >> 1;
+		crc_table[i] = crc;
+	}
+
+	crc_hardware = crc_have_sse42();
+}
+
+static uint32_t crc_bytes(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len--)
+		crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#ifdef PR_CRC_HAVE_SSE42
+
+/* a * b mod P, both bit reversed */
+static uint32_t crc_multiply(uint32_t a, uint32_t b)
+{
+	uint32_t product = 0;
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		if (a & (0x80000000u >> i))
+			product ^= b;
+		b = b & 1 ? (b >> 1) ^ PR_CRC_POLY : b >> 1;
+	}
+
+	return product;
+}
+
+static uint64_t load64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint64_t c0, c1, c2;
+	size_t i;
+
+	while (len && ((uintptr_t)p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+
+	while (len >= 3 * PR_CRC_LANE) {
+		c0 = crc;
+		c1 = 0;
+		c2 = 0;
+		for (i = 0; i < PR_CRC_LANE; i += 8) {
+			c0 = _mm_crc32_u64(c0, load64(p + i));
+			c1 = _mm_crc32_u64(c1, load64(p + PR_CRC_LANE + i));
+			c2 = _mm_crc32_u64(c2, load64(p + 2 * PR_CRC_LANE + i));
+		}
+		crc = crc_multiply((uint32_t)c0, PR_CRC_LANE_SHIFT) ^ (uint32_t)c1;
+		crc = crc_multiply(crc, PR_CRC_LANE_SHIFT) ^ (uint32_t)c2;
+		p += 3 * PR_CRC_LANE;
+		len -= 3 * PR_CRC_LANE;
+	}
+
+	c0 = crc;
+	for (; len >= 8; p += 8, len -= 8)
+		c0 = _mm_crc32_u64(c0, load64(p));
+	crc = (uint32_t)c0;
+
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+
+	return crc;
+}
+
+static int crc_have_sse42(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+
+#else
+
+static int crc_have_sse42(void)
+{
+	return 0;
+}
+
+static uint32_t crc_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+	return crc_bytes(crc, p, len);
+}
+
+#endif
+
+uint32_t fpga_pr_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	pthread_once(&crc_once, crc_init);
+
+	if (crc_hardware)
+		return ~crc_sse42(~crc, buf, len);
+
+	return ~crc_bytes(~crc, buf, len);
+}
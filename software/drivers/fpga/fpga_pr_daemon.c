@@ -0,0 +1,2150 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Long running reconfiguration service.  It owns the FPGA regions of all
+ * cards in the host, keeps every bitstream it has been asked for open and
+ * as many as fit in --stage-mb staged in memory, and loads them on request
+ * from clients of a Unix socket (see fpga_pr_daemon.h), instead of a
+ * program-fpga-pcie run per load.
+ *
+ * Each card has a worker thread, since the regions of a card share its PR
+ * IP.  A card here is the device of a region's manager, so a board with
+ * several PR IPs is several cards, named after the board and, but for the
+ * first, the offset of the PR IP, and its PR IPs load in parallel.
+ * Requests wait in per region queues, one per priority class, and the
+ * worker picks the next one (see pick_request()).  A request identical to
+ * one that is queued or being loaded is answered by that load, and a load
+ * is skipped when the region already holds the persona of the image.
+ * Regions the driver found warm at startup count as holding their persona.
+ *
+ * An image is checked when it is staged, before its region is taken down:
+ * its POF ID must match the card's (unless --no-pof-check), and if it has a
+ * digest sidecar, the image must match it.  A mismatch is remembered until
+ * the image or its sidecar changes, so it is not read again per request.
+ *
+ * When a card is reset or reprobed its regions are registered again, and
+ * the attributes of a region are reopened when they fail with ENODEV or
+ * ENOENT.
+ *
+ * When a load starts, the region's model of its load history (see
+ * fpga_pr_predict.h) names the personas likely to follow, and a prefetch
+ * thread stages their images, so the next load does not wait for them.
+ *
+ * A broadcast loads one image into a region of each of several cards.  The
+ * image is staged once, and the card workers, each running on the NUMA
+ * node of its card, load it from the same pages at the same time.
+ *
+ * With --sim the regions are simulated, so the daemon and its clients can
+ * be measured without cards.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fpga_pr_crc32c.h"
+#include "fpga_pr_daemon.h"
+#include "fpga_pr_predict.h"
+
+#define FPGA_REGION_CLASS	"/sys/class/fpga_region"
+#define NAME_MAX_LEN		64
+#define MAX_CLIENTS		256
+#define MAX_TARGETS		64
+
+/* Where the PR IP finds the POF ID in an RBF, see altera-pr-ip-core.c */
+#define ALT_PR_RBF_ID_OFST	(71 * sizeof(uint32_t))
+
+/* Holds the CRC32C of the image as loaded, decompressed, in hex */
+#define PR_DIGEST_SUFFIX	".crc32c"
+
+enum pr_class {
+	PR_CLASS_LOW,
+	PR_CLASS_NORMAL,
+	PR_CLASS_HIGH,
+	PR_CLASSES
+};
+
+static const char * const pr_class_names[PR_CLASSES] = {
+	[PR_CLASS_LOW] = "low",
+	[PR_CLASS_NORMAL] = "normal",
+	[PR_CLASS_HIGH] = "high",
+};
+
+/* Where the card workers run; far is only there to measure local against */
+enum pr_numa {
+	PR_NUMA_LOCAL,
+	PR_NUMA_FAR,
+	PR_NUMA_OFF,
+	PR_NUMA_PLACEMENTS
+};
+
+static const char * const pr_numa_names[PR_NUMA_PLACEMENTS] = {
+	[PR_NUMA_LOCAL] = "local",
+	[PR_NUMA_FAR] = "far",
+	[PR_NUMA_OFF] = "off",
+};
+
+/*
+ * An image is staged while it is mapped, locked and validated.  Staging
+ * is what a cold load waits for; prefetch marks an image the prefetch
+ * thread is to stage, prefetched one it staged that no load used yet.
+ * A compressed image is decompressed into data_fd when it is staged,
+ * otherwise data_fd is fd.  corrupt is set when the last staging found
+ * the image did not match its digest, and corrupt_key says which versions
+ * of the image and its sidecar did not match.
+ */
+struct pr_digest_key {
+	off_t size;
+	struct timespec mtime;
+	off_t sidecar_size;
+	struct timespec sidecar_mtime;
+};
+
+struct pr_image {
+	char *path;
+	int fd;
+	const char *decompress;
+	int data_fd;
+	void *data;
+	size_t size;
+	uint32_t persona_id;
+	uint32_t pof_id;
+	int staged;
+	int staging;
+	int prefetch;
+	int prefetched;
+	int corrupt;
+	struct pr_digest_key corrupt_key;
+	unsigned int users;
+	uint64_t stage_ns;
+	uint64_t used_ns;
+	struct pr_image *next;
+};
+
+/* Where a broadcast stands for one of its regions */
+struct pr_target {
+	struct pr_region *region;
+	const char *how;
+	uint32_t persona_id;
+	int err;
+	uint64_t wait_ns;
+	uint64_t started_ns;
+	uint64_t load_ns;
+	uint64_t done_ns;
+};
+
+/*
+ * A broadcast is answered, by the main thread, once the last of its
+ * targets is done.
+ */
+struct pr_broadcast {
+	int client;
+	char tag[NAME_MAX_LEN];
+	struct pr_image *image;
+	uint64_t received_ns;
+	unsigned int pending;
+	unsigned int nr_targets;
+	struct pr_target targets[];
+};
+
+struct pr_waiter {
+	int client;
+	char tag[NAME_MAX_LEN];
+	uint64_t received_ns;
+	struct pr_broadcast *broadcast;
+	struct pr_target *target;
+	struct pr_waiter *next;
+};
+
+struct pr_request {
+	struct pr_region *region;
+	struct pr_image *image;
+	struct pr_waiter *waiters;
+	enum pr_class class;
+	uint64_t queued_ns;
+	uint64_t started_ns;
+	uint64_t load_ns;
+	uint64_t done_ns;
+	uint32_t persona_id;
+	int skipped;
+	int err;
+	struct pr_request *next;
+};
+
+struct pr_card {
+	char name[NAME_MAX_LEN];
+	int numa_node;
+	pthread_t worker;
+	pthread_cond_t cond;
+	struct pr_request *running;
+	struct pr_card *next;
+};
+
+/* Queue metrics of one priority class of a region */
+struct pr_class_stats {
+	unsigned int depth;
+	unsigned int max_depth;
+	unsigned long served;
+	unsigned long rejected;
+	/* queueing time of every request answered, coalesced ones included */
+	unsigned long waits;
+	uint64_t wait_ns;
+	uint64_t max_wait_ns;
+};
+
+struct pr_region {
+	char name[NAME_MAX_LEN];
+	struct pr_card *card;
+	int persona_fd;
+	int image_fd;
+	uint32_t sim_persona_id;
+	struct pr_request *queue[PR_CLASSES];
+	unsigned int queued;
+	/* the persona in the region, when and by which class it was loaded */
+	uint32_t resident_id;
+	uint64_t resident_ns;
+	enum pr_class resident_class;
+	struct pr_class_stats class_stats[PR_CLASSES];
+	/* POF ID of the last image loaded, 0 if unknown */
+	uint32_t pof_id;
+	struct pr_predict predict;
+	struct pr_region *next;
+};
+
+struct pr_backend {
+	const char *name;
+	int (*read_persona)(struct pr_region *region, uint32_t *persona_id);
+	int (*load)(struct pr_region *region, struct pr_image *image);
+};
+
+struct pr_stats {
+	unsigned long requests;
+	unsigned long loads;
+	unsigned long skipped;
+	unsigned long coalesced;
+	unsigned long rejected;
+	unsigned long errors;
+	uint64_t load_ns;
+	uint64_t wait_ns;
+	unsigned long prefetched;
+	unsigned long prefetch_hits;
+	unsigned long cold;
+	uint64_t cold_ns;
+	uint64_t saved_ns;
+	unsigned long evicted;
+	unsigned long pof_rejected;
+	unsigned long broadcasts;
+	unsigned long corrupt;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pr_card *cards;
+static struct pr_region *regions;
+static struct pr_image *images;
+static struct pr_request *done;
+static struct pr_stats stats;
+static const struct pr_backend *backend;
+static int notify_pipe[2];
+static volatile sig_atomic_t stopping;
+static pthread_cond_t stage_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t prefetcher;
+static size_t staged_bytes;
+static FILE *trace;
+
+static unsigned int sim_load_us = 100000;
+static uint64_t min_residency_ns = 100000000;
+static unsigned int max_queue = 64;
+static size_t stage_budget = (size_t)256 << 20;
+static unsigned int prefetch_depth = 2;
+static int pof_check = 1;
+static enum pr_numa numa = PR_NUMA_LOCAL;
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/* Regions under /sys/class/fpga_region, loaded through image_file */
+
+static int open_region_attr(const char *region, const char *attr, int flags);
+
+static int sysfs_open_region(struct pr_region *region)
+{
+	if (region->persona_fd >= 0)
+		close(region->persona_fd);
+	if (region->image_fd >= 0)
+		close(region->image_fd);
+
+	region->persona_fd = open_region_attr(region->name, "persona_id",
+					      O_RDONLY);
+	region->image_fd = open_region_attr(region->name, "image_file",
+					    O_WRONLY);
+	if (region->persona_fd < 0 || region->image_fd < 0)
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * A CvP update, error recovery or a base_dtb write registers the regions of
+ * a card again, and attributes opened before then fail with ENODEV.  They
+ * are opened again by name, which fails with ENOENT while the region is
+ * away; the next request for the region tries again.
+ */
+static int sysfs_reopen_region(struct pr_region *region, int err)
+{
+	if (err != ENODEV && err != ENOENT)
+		return -err;
+
+	printf("region %s was registered again, reopening it\n", region->name);
+	return sysfs_open_region(region);
+}
+
+static int sysfs_read_persona(struct pr_region *region, uint32_t *persona_id)
+{
+	char buf[32];
+	ssize_t len;
+	int ret;
+
+	len = pread(region->persona_fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0) {
+		ret = sysfs_reopen_region(region, errno);
+		if (ret)
+			return ret;
+		len = pread(region->persona_fd, buf, sizeof(buf) - 1, 0);
+	}
+	if (len <= 0)
+		return len ? -errno : -EIO;
+
+	buf[len] = '\0';
+	*persona_id = strtoul(buf, NULL, 16);
+	return 0;
+}
+
+/*
+ * The region opens the image by path; handing it the descriptor the
+ * daemon holds through /proc means the image that was validated and made
+ * resident is the one loaded, even if the file was replaced since.
+ */
+static int sysfs_load(struct pr_region *region, struct pr_image *image)
+{
+	char path[64];
+	int len;
+	int ret;
+
+	/* a compressed image that could not be decompressed */
+	if (image->data_fd < 0)
+		return -EIO;
+
+	len = snprintf(path, sizeof(path), "/proc/%d/fd/%d", getpid(),
+		       image->data_fd);
+
+	if (pwrite(region->image_fd, path, len, 0) == len)
+		return 0;
+
+	ret = sysfs_reopen_region(region, errno);
+	if (ret)
+		return ret;
+
+	if (pwrite(region->image_fd, path, len, 0) != len)
+		return -errno;
+
+	return 0;
+}
+
+static const struct pr_backend sysfs_backend = {
+	.name = "sysfs",
+	.read_persona = sysfs_read_persona,
+	.load = sysfs_load,
+};
+
+/*
+ * Simulated regions take sim_load_us per load and come up with the persona
+ * given for the image or, failing that, one made up from its path.
+ */
+
+static uint32_t sim_persona_of(struct pr_image *image)
+{
+	uint32_t hash = 2166136261u;
+	const char *p;
+
+	if (image->persona_id != FPGA_PR_PERSONA_UNKNOWN)
+		return image->persona_id;
+
+	for (p = image->path; *p; p++)
+		hash = (hash ^ (unsigned char)*p) * 16777619u;
+
+	return hash & 0x7fffffff;
+}
+
+static int sim_read_persona(struct pr_region *region, uint32_t *persona_id)
+{
+	*persona_id = region->sim_persona_id;
+	return 0;
+}
+
+static int sim_load(struct pr_region *region, struct pr_image *image)
+{
+	usleep(sim_load_us);
+	region->sim_persona_id = sim_persona_of(image);
+	return 0;
+}
+
+static const struct pr_backend sim_backend = {
+	.name = "sim",
+	.read_persona = sim_read_persona,
+	.load = sim_load,
+};
+
+static struct pr_card *get_card(const char *name)
+{
+	pthread_condattr_t attr;
+	struct pr_card *card;
+
+	for (card = cards; card; card = card->next)
+		if (!strcmp(card->name, name))
+			return card;
+
+	card = calloc(1, sizeof(*card));
+	if (!card)
+		return NULL;
+
+	snprintf(card->name, sizeof(card->name), "%s", name);
+	card->numa_node = -1;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&card->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	card->next = cards;
+	cards = card;
+	return card;
+}
+
+static int add_region(const char *name, const char *card_name)
+{
+	struct pr_region *region, **tail;
+
+	region = calloc(1, sizeof(*region));
+	if (!region)
+		return -ENOMEM;
+
+	snprintf(region->name, sizeof(region->name), "%s", name);
+	region->persona_fd = -1;
+	region->image_fd = -1;
+	region->sim_persona_id = FPGA_PR_PERSONA_UNKNOWN;
+	region->resident_id = FPGA_PR_PERSONA_UNKNOWN;
+	pr_predict_init(&region->predict);
+	region->card = get_card(card_name);
+	if (!region->card) {
+		free(region);
+		return -ENOMEM;
+	}
+
+	/* keep discovery order, so a card stands for its first region */
+	for (tail = &regions; *tail; tail = &(*tail)->next)
+		;
+	*tail = region;
+	return 0;
+}
+
+static int open_region_attr(const char *region, const char *attr, int flags)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), FPGA_REGION_CLASS "/%s/%s", region, attr);
+	return open(path, flags);
+}
+
+/*
+ * The NUMA node of a region, from the numa_node attribute of the closest
+ * device above it in sysfs, which is the PCIe device of its card; -1 if
+ * there is none or the device is not tied to a node.
+ */
+static int region_numa_node(const char *region)
+{
+	char path[PATH_MAX + 16];
+	char real[PATH_MAX];
+	char buf[16];
+	char *slash;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), FPGA_REGION_CLASS "/%s", region);
+	if (!realpath(path, real))
+		return -1;
+
+	while ((slash = strrchr(real, '/')) && slash != real) {
+		snprintf(path, sizeof(path), "%s/numa_node", real);
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			len = read(fd, buf, sizeof(buf) - 1);
+			close(fd);
+			if (len <= 0)
+				return -1;
+			buf[len] = '\0';
+			return atoi(buf);
+		}
+		*slash = '\0';
+	}
+
+	return -1;
+}
+
+/* Run thread on the CPUs of node, as listed in its cpulist */
+static int pin_to_node(pthread_t thread, int node)
+{
+	char path[64];
+	char list[1024];
+	unsigned int first, last, cpu;
+	cpu_set_t cpus;
+	char *p = list;
+	ssize_t len;
+	int fd;
+	int n;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+		 node);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	len = read(fd, list, sizeof(list) - 1);
+	close(fd);
+	if (len <= 0)
+		return -EIO;
+	list[len] = '\0';
+
+	CPU_ZERO(&cpus);
+	while (sscanf(p, "%u%n", &first, &n) == 1) {
+		p += n;
+		last = first;
+		if (*p == '-' && sscanf(p + 1, "%u%n", &last, &n) == 1)
+			p += n + 1;
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &cpus);
+		if (*p != ',')
+			break;
+		p++;
+	}
+	if (!CPU_COUNT(&cpus))
+		return -EINVAL;
+
+	return -pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+}
+
+/*
+ * Run the worker of card on the node --numa asks for: the card's own, or
+ * the first other node with CPUs.  Returns the node, or -1 if the worker
+ * is left to run anywhere.
+ */
+static int place_worker(struct pr_card *card)
+{
+	int node;
+
+	if (card->numa_node < 0 || numa == PR_NUMA_OFF)
+		return -1;
+
+	if (numa == PR_NUMA_LOCAL)
+		return pin_to_node(card->worker, card->numa_node) ?
+		       -1 : card->numa_node;
+
+	for (node = 0; node < CPU_SETSIZE; node++)
+		if (node != card->numa_node &&
+		    !pin_to_node(card->worker, node))
+			return node;
+
+	return -1;
+}
+
+/* The card of a region is the device its manager belongs to */
+static int scan_sysfs_regions(void)
+{
+	struct pr_region *region;
+	struct dirent *entry;
+	char card[NAME_MAX_LEN];
+	ssize_t len;
+	DIR *dir;
+	int fd;
+	int ret;
+
+	dir = opendir(FPGA_REGION_CLASS);
+	if (!dir) {
+		printf("cannot open %s\n", FPGA_REGION_CLASS);
+		return -errno;
+	}
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		fd = open_region_attr(entry->d_name, "manager", O_RDONLY);
+		if (fd < 0)
+			continue;
+		len = read(fd, card, sizeof(card) - 1);
+		close(fd);
+		if (len <= 0)
+			continue;
+		card[len] = '\0';
+		card[strcspn(card, "\n")] = '\0';
+
+		ret = add_region(entry->d_name, card);
+		if (ret) {
+			closedir(dir);
+			return ret;
+		}
+	}
+	closedir(dir);
+
+	for (region = regions; region; region = region->next) {
+		ret = sysfs_open_region(region);
+		if (ret) {
+			printf("cannot open the attributes of region %s\n",
+			       region->name);
+			return ret;
+		}
+		if (region->card->numa_node < 0)
+			region->card->numa_node = region_numa_node(region->name);
+		printf("region %s on card %s\n", region->name,
+		       region->card->name);
+	}
+
+	return regions ? 0 : -ENODEV;
+}
+
+static int add_sim_regions(unsigned int nr_cards, unsigned int nr_regions)
+{
+	char card[NAME_MAX_LEN];
+	char name[NAME_MAX_LEN];
+	unsigned int c, r;
+	int ret;
+
+	for (c = 0; c < nr_cards; c++) {
+		snprintf(card, sizeof(card), "sim%u", c);
+		for (r = 0; r < nr_regions; r++) {
+			snprintf(name, sizeof(name), "sim%u.%u", c, r);
+			ret = add_region(name, card);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static struct pr_region *find_region(const char *name)
+{
+	struct pr_region *region;
+
+	for (region = regions; region; region = region->next)
+		if (!strcmp(region->name, name))
+			return region;
+
+	for (region = regions; region; region = region->next)
+		if (!strcmp(region->card->name, name))
+			return region;
+
+	return NULL;
+}
+
+/* The decompressor of an image, as chosen by program-fpga-pcie, or NULL */
+static const char *image_decompressor(const char *path)
+{
+	size_t len = strlen(path);
+
+	if (len > 4 && !strcmp(path + len - 4, ".zst"))
+		return "zstd";
+	if (len > 4 && !strcmp(path + len - 4, ".lz4"))
+		return "lz4";
+
+	return NULL;
+}
+
+/*
+ * Decompress image into an anonymous file, which is then what is staged
+ * and loaded; its size is only known from here on.  Called without lock,
+ * by the thread staging the image.
+ */
+static int decompress_image(struct pr_image *image)
+{
+	char *argv[] = { (char *)image->decompress, "-dcq", NULL };
+	posix_spawn_file_actions_t actions;
+	struct stat st;
+	pid_t pid;
+	int status;
+	int fd;
+	int err;
+
+	fd = memfd_create(image->path, MFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, image->fd, STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, fd, STDOUT_FILENO);
+	lseek(image->fd, 0, SEEK_SET);
+	err = posix_spawnp(&pid, image->decompress, &actions, NULL, argv,
+			   environ);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (!err && (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+		     WEXITSTATUS(status)))
+		err = EIO;
+	if (!err && (fstat(fd, &st) || !st.st_size))
+		err = EIO;
+	if (err) {
+		close(fd);
+		return -err;
+	}
+
+	image->data_fd = fd;
+	image->size = st.st_size;
+	return 0;
+}
+
+/*
+ * Images are opened once and stay open, so a load never waits on the
+ * path lookup; staging is left to stage_image().  Simulated regions accept
+ * images that do not exist.  The list of images is only changed by the
+ * main thread, under lock since the workers look up predicted personas in
+ * it; persona_id is under lock.
+ */
+static struct pr_image *get_image(const char *path, int *err)
+{
+	struct pr_image *image;
+	struct stat st;
+
+	for (image = images; image; image = image->next)
+		if (!strcmp(image->path, path))
+			return image;
+
+	image = calloc(1, sizeof(*image));
+	if (!image) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	image->path = strdup(path);
+	image->persona_id = FPGA_PR_PERSONA_UNKNOWN;
+	image->decompress = image_decompressor(path);
+	image->fd = open(path, O_RDONLY | O_CLOEXEC);
+	image->data_fd = image->decompress ? -1 : image->fd;
+
+	if (image->fd >= 0 && !fstat(image->fd, &st) && st.st_size > 0) {
+		image->size = st.st_size;
+	} else if (backend != &sim_backend) {
+		*err = image->fd < 0 ? -errno : -EINVAL;
+		if (image->fd >= 0)
+			close(image->fd);
+		free(image->path);
+		free(image);
+		return NULL;
+	} else if (image->fd >= 0) {
+		close(image->fd);
+		image->fd = -1;
+		image->data_fd = -1;
+	}
+
+	pthread_mutex_lock(&lock);
+	image->next = images;
+	images = image;
+	pthread_mutex_unlock(&lock);
+	return image;
+}
+
+/*
+ * Unstage the least recently used images no load holds until size more
+ * bytes fit in the budget.  An image bigger than the whole budget is still
+ * staged.  Called with lock held.
+ */
+static void make_room(size_t size)
+{
+	struct pr_image *image, *victim;
+
+	while (staged_bytes + size > stage_budget) {
+		victim = NULL;
+		for (image = images; image; image = image->next)
+			if (image->staged && !image->users &&
+			    (!victim || image->used_ns < victim->used_ns))
+				victim = image;
+		if (!victim)
+			return;
+
+		munlock(victim->data, victim->size);
+		munmap(victim->data, victim->size);
+		victim->data = NULL;
+		if (victim->decompress) {
+			close(victim->data_fd);
+			victim->data_fd = -1;
+		}
+		victim->staged = 0;
+		victim->prefetched = 0;
+		staged_bytes -= victim->size;
+		stats.evicted++;
+	}
+}
+
+/* The digest in the sidecar of the image at path */
+static int read_digest(const char *path, uint32_t *digest)
+{
+	char name[PATH_MAX];
+	FILE *f;
+	int ret;
+
+	if (snprintf(name, sizeof(name), "%s%s", path, PR_DIGEST_SUFFIX) >=
+	    (int)sizeof(name))
+		return -ENAMETOOLONG;
+
+	f = fopen(name, "re");
+	if (!f)
+		return -errno;
+	ret = fscanf(f, "%8x", digest) == 1 ? 0 : -EINVAL;
+	fclose(f);
+
+	return ret;
+}
+
+/*
+ * Size and modification time of the image and its sidecar, so a mismatch
+ * is checked again only once one of them changed.
+ */
+static int read_digest_key(struct pr_image *image, struct pr_digest_key *key)
+{
+	char name[PATH_MAX];
+	struct stat st;
+
+	memset(key, 0, sizeof(*key));
+
+	if (fstat(image->fd, &st))
+		return -errno;
+	key->size = st.st_size;
+	key->mtime = st.st_mtim;
+
+	snprintf(name, sizeof(name), "%s%s", image->path, PR_DIGEST_SUFFIX);
+	if (stat(name, &st))
+		return -errno;
+	key->sidecar_size = st.st_size;
+	key->sidecar_mtime = st.st_mtim;
+
+	return 0;
+}
+
+/*
+ * Map, populate and lock image and read the POF ID it carries, unless it
+ * is staged already or being staged by another thread, which is waited
+ * for.  An image with a digest is populated by taking its CRC32C as it is
+ * read in, rather than by MAP_POPULATE, so checking it costs no pass over
+ * the image of its own; one that does not match is not staged and marked
+ * corrupt, and is not read again until it or its sidecar changes.
+ * for_load is set by the workers, whose waits count as cold
+ * loads, and clear for the prefetch thread.  Returns 1 for a cold load.
+ * Called without lock.
+ */
+static int stage_image(struct pr_image *image, int for_load)
+{
+	int cold = 0;
+	uint64_t start = now_ns();
+	uint64_t spent;
+	uint32_t pof_id = 0;
+	uint32_t digest, crc;
+	struct pr_digest_key key;
+	int has_digest = 0;
+	int corrupt = 0;
+	void *data;
+
+	pthread_mutex_lock(&lock);
+	while (image->staging)
+		pthread_cond_wait(&stage_cond, &lock);
+
+	if (image->staged || image->fd < 0) {
+		spent = now_ns() - start;
+		if (for_load && image->prefetched) {
+			stats.prefetch_hits++;
+			if (image->stage_ns > spent)
+				stats.saved_ns += image->stage_ns - spent;
+		} else if (for_load && spent > image->stage_ns / 2) {
+			/* caught the prefetch thread half way */
+			stats.cold++;
+			stats.cold_ns += spent;
+			cold = 1;
+		}
+		image->prefetched = 0;
+		pthread_mutex_unlock(&lock);
+		return cold;
+	}
+
+	/* still the image that did not match, check_digest() refuses it */
+	if (image->corrupt && !read_digest_key(image, &key) &&
+	    !memcmp(&key, &image->corrupt_key, sizeof(key))) {
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+
+	image->staging = 1;
+	pthread_mutex_unlock(&lock);
+
+	data = MAP_FAILED;
+	if (!image->decompress || !decompress_image(image)) {
+		pthread_mutex_lock(&lock);
+		make_room(image->size);
+		pthread_mutex_unlock(&lock);
+		has_digest = !read_digest(image->path, &digest);
+		if (has_digest)
+			read_digest_key(image, &key);
+		data = mmap(NULL, image->size, PROT_READ,
+			    MAP_SHARED | (has_digest ? 0 : MAP_POPULATE),
+			    image->data_fd, 0);
+	}
+	if (data != MAP_FAILED && has_digest) {
+		madvise(data, image->size, MADV_SEQUENTIAL);
+		madvise(data, image->size, MADV_WILLNEED);
+		crc = fpga_pr_crc32c(0, data, image->size);
+		if (crc != digest) {
+			printf("%s: CRC32C %08x, expected %08x\n",
+			       image->path, crc, digest);
+			munmap(data, image->size);
+			data = MAP_FAILED;
+			corrupt = 1;
+		}
+	}
+	if (data != MAP_FAILED) {
+		mlock(data, image->size);
+		if (image->size >= ALT_PR_RBF_ID_OFST + sizeof(pof_id))
+			memcpy(&pof_id, (char *)data + ALT_PR_RBF_ID_OFST,
+			       sizeof(pof_id));
+	}
+
+	pthread_mutex_lock(&lock);
+	image->staging = 0;
+	image->corrupt = corrupt;
+	if (corrupt) {
+		image->corrupt_key = key;
+		stats.corrupt++;
+	}
+	if (data != MAP_FAILED) {
+		image->data = data;
+		image->pof_id = pof_id;
+		image->staged = 1;
+		image->prefetched = !for_load;
+		image->stage_ns = now_ns() - start;
+		image->used_ns = now_ns();
+		staged_bytes += image->size;
+		if (for_load) {
+			stats.cold++;
+			stats.cold_ns += image->stage_ns;
+			cold = 1;
+		} else {
+			stats.prefetched++;
+		}
+	} else if (image->decompress && image->data_fd >= 0) {
+		close(image->data_fd);
+		image->data_fd = -1;
+	}
+	pthread_cond_broadcast(&stage_cond);
+	pthread_mutex_unlock(&lock);
+
+	return cold;
+}
+
+/*
+ * A corrupt image is refused before the region is touched, instead of
+ * leaving the PR IP to find CRC errors half way through the load.
+ */
+static int check_digest(struct pr_image *image)
+{
+	int err;
+
+	pthread_mutex_lock(&lock);
+	err = image->corrupt ? -EBADMSG : 0;
+	pthread_mutex_unlock(&lock);
+
+	return err;
+}
+
+/*
+ * The PR IP refuses an RBF whose POF ID differs from its own, but only
+ * once the region has been taken down for the load.  Once a load showed
+ * which POF ID a region takes, such an image is refused up front.  An ID
+ * of 0 means the check is disabled, as in the PR IP.
+ */
+static int check_pof_id(struct pr_region *region, struct pr_image *image)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&lock);
+	if (pof_check && region->pof_id && image->pof_id &&
+	    region->pof_id != image->pof_id) {
+		stats.pof_rejected++;
+		err = -EINVAL;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return err;
+}
+
+static void *prefetch_worker(void *arg __attribute__((unused)))
+{
+	struct pr_image *image;
+
+	pthread_mutex_lock(&lock);
+	while (!stopping) {
+		for (image = images; image; image = image->next)
+			if (image->prefetch)
+				break;
+		if (!image) {
+			pthread_cond_wait(&stage_cond, &lock);
+			continue;
+		}
+
+		image->prefetch = 0;
+		if (image->staged || image->staging)
+			continue;
+		pthread_mutex_unlock(&lock);
+		stage_image(image, 0);
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
+}
+
+/*
+ * Learn that persona_id was loaded into region and have the images of the
+ * personas the model expects next staged.  Called with lock held.
+ */
+static void predict_next(struct pr_region *region, uint32_t persona_id)
+{
+	uint32_t next[PR_PREDICT_MAX];
+	struct pr_image *image;
+	unsigned int i, n;
+
+	pr_predict_update(&region->predict, persona_id);
+	if (!prefetch_depth)
+		return;
+
+	n = pr_predict_next(&region->predict, next, prefetch_depth);
+	for (i = 0; i < n; i++)
+		for (image = images; image; image = image->next)
+			if (image->persona_id == next[i] && !image->staged &&
+			    !image->staging) {
+				image->prefetch = 1;
+				pthread_cond_broadcast(&stage_cond);
+				break;
+			}
+}
+
+/* Called with lock held */
+static void complete_request(struct pr_request *req)
+{
+	req->next = done;
+	done = req;
+	if (write(notify_pipe[1], "", 1) < 0 && errno != EAGAIN)
+		perror("notify");
+}
+
+/* Called with lock held */
+static void unlink_request(struct pr_request *req)
+{
+	struct pr_region *region = req->region;
+	struct pr_request **p;
+
+	for (p = &region->queue[req->class]; *p != req; p = &(*p)->next)
+		;
+	*p = req->next;
+	req->next = NULL;
+	region->queued--;
+	region->class_stats[req->class].depth--;
+}
+
+/* Called with lock held; keeps the queue in order of arrival */
+static void link_request(struct pr_request *req)
+{
+	struct pr_region *region = req->region;
+	struct pr_class_stats *cs = &region->class_stats[req->class];
+	struct pr_request **p;
+
+	for (p = &region->queue[req->class]; *p; p = &(*p)->next)
+		if ((*p)->queued_ns > req->queued_ns)
+			break;
+	req->next = *p;
+	*p = req;
+	region->queued++;
+	if (++cs->depth > cs->max_depth)
+		cs->max_depth = cs->depth;
+}
+
+/*
+ * The next request for a card, or NULL with *wake_ns set to when a
+ * deferred request becomes eligible (0 if none is waiting).  Called with
+ * lock held.
+ *
+ * Classes are served highest first.  Within a class a request for the
+ * persona a region already holds goes first, since it costs no load, so
+ * requests for one persona are served as a batch before the region is
+ * switched; otherwise the oldest head of the regions' queues wins.  A
+ * region keeps a persona for at least min_residency_ns, unless a class
+ * higher than the one that loaded it asks for a different persona.
+ */
+static struct pr_request *pick_request(struct pr_card *card, uint64_t *wake_ns)
+{
+	struct pr_request *req, *best;
+	struct pr_region *region;
+	uint64_t now = now_ns();
+	uint64_t until;
+	int class;
+
+	*wake_ns = 0;
+
+	for (class = PR_CLASS_HIGH; class >= PR_CLASS_LOW; class--) {
+		best = NULL;
+
+		for (region = regions; region; region = region->next) {
+			if (region->card != card || !region->queue[class])
+				continue;
+
+			for (req = region->queue[class]; req; req = req->next)
+				if (req->image->persona_id != FPGA_PR_PERSONA_UNKNOWN &&
+				    req->image->persona_id == region->resident_id)
+					break;
+			if (req) {
+				best = req;
+				break;
+			}
+
+			req = region->queue[class];
+			until = region->resident_ns + min_residency_ns;
+			if (region->resident_ns && until > now &&
+			    class <= (int)region->resident_class) {
+				if (!*wake_ns || until < *wake_ns)
+					*wake_ns = until;
+				continue;
+			}
+
+			if (!best || req->queued_ns < best->queued_ns)
+				best = req;
+		}
+
+		if (best) {
+			unlink_request(best);
+			return best;
+		}
+	}
+
+	return NULL;
+}
+
+static void *card_worker(void *arg)
+{
+	struct pr_card *card = arg;
+	struct pr_class_stats *cs;
+	struct pr_request *req;
+	struct pr_region *region;
+	struct pr_waiter *waiter;
+	struct timespec wake;
+	uint32_t persona_id;
+	uint32_t expected;
+	uint64_t wake_ns;
+	uint64_t wait;
+	uint64_t start;
+	int attempted;
+	int predicted;
+	int cold;
+
+	pthread_mutex_lock(&lock);
+	while (!stopping) {
+		req = pick_request(card, &wake_ns);
+		if (!req && wake_ns) {
+			wake.tv_sec = wake_ns / 1000000000ull;
+			wake.tv_nsec = wake_ns % 1000000000ull;
+			pthread_cond_timedwait(&card->cond, &lock, &wake);
+			continue;
+		} else if (!req) {
+			pthread_cond_wait(&card->cond, &lock);
+			continue;
+		}
+
+		card->running = req;
+		region = req->region;
+		req->started_ns = now_ns();
+		expected = req->image->persona_id;
+
+		req->image->users++;
+
+		/* when the persona is known, learn the load now and stage
+		 * the personas that follow it while it runs */
+		predicted = expected != FPGA_PR_PERSONA_UNKNOWN &&
+			    expected != region->resident_id;
+		if (predicted)
+			predict_next(region, expected);
+
+		cs = &region->class_stats[req->class];
+		cs->served++;
+		for (waiter = req->waiters; waiter; waiter = waiter->next) {
+			wait = req->started_ns - waiter->received_ns;
+			cs->waits++;
+			cs->wait_ns += wait;
+			if (wait > cs->max_wait_ns)
+				cs->max_wait_ns = wait;
+		}
+		pthread_mutex_unlock(&lock);
+
+		persona_id = FPGA_PR_PERSONA_UNKNOWN;
+		attempted = 0;
+		cold = 0;
+
+		/* the persona is read back at the last moment, it may have
+		 * been loaded by a request that was ahead in the queue */
+		req->err = backend->read_persona(region, &persona_id);
+		if (!req->err && persona_id != FPGA_PR_PERSONA_UNKNOWN &&
+		    persona_id == expected) {
+			req->skipped = 1;
+		} else if (!req->err) {
+			cold = stage_image(req->image, 1);
+			req->err = check_digest(req->image);
+			if (!req->err)
+				req->err = check_pof_id(region, req->image);
+		}
+		if (!req->err && !req->skipped) {
+			attempted = 1;
+			start = now_ns();
+			req->err = backend->load(region, req->image);
+			req->load_ns = now_ns() - start;
+			if (!req->err)
+				req->err = backend->read_persona(region,
+								 &persona_id);
+		}
+		req->persona_id = persona_id;
+
+		pthread_mutex_lock(&lock);
+		req->image->users--;
+		req->image->used_ns = now_ns();
+		if (!req->err && !req->skipped) {
+			if (trace)
+				fprintf(trace, "%ju %s 0x%x %ju %d\n",
+					(uintmax_t)req->started_ns / 1000,
+					region->name, persona_id,
+					(uintmax_t)req->image->stage_ns / 1000,
+					cold);
+			if (req->image->pof_id)
+				region->pof_id = req->image->pof_id;
+			if (!predicted)
+				predict_next(region, persona_id);
+			req->image->persona_id = persona_id;
+			region->resident_id = persona_id;
+			region->resident_ns = now_ns();
+			region->resident_class = req->class;
+			stats.loads++;
+			stats.load_ns += req->load_ns;
+		} else if (req->skipped) {
+			region->resident_id = persona_id;
+			stats.skipped++;
+		} else {
+			if (attempted)
+				region->resident_id = FPGA_PR_PERSONA_UNKNOWN;
+			stats.errors++;
+		}
+		req->done_ns = now_ns();
+		card->running = NULL;
+		complete_request(req);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
+}
+
+static void reply(int client, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void reply(int client, const char *fmt, ...)
+{
+	char line[FPGA_PR_DAEMON_LINE_MAX];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	/* a client that went away is noticed by the poll loop */
+	if (send(client, line, len, MSG_NOSIGNAL) < 0)
+		return;
+}
+
+static void answer_broadcast(struct pr_broadcast *b)
+{
+	struct pr_target *target;
+	uint64_t first = 0, last = 0;
+	unsigned int failed = 0;
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < b->nr_targets; i++) {
+		target = &b->targets[i];
+		if (target->err) {
+			reply(b->client, "card %s %s error %d %s\n", b->tag,
+			      target->region->name, -target->err,
+			      target->err == -EBUSY ? "queue full" :
+			      strerror(-target->err));
+			if (!failed++)
+				err = target->err;
+			continue;
+		}
+
+		reply(b->client, "card %s %s 0x%x %s %ju %ju %.1f\n", b->tag,
+		      target->region->name, target->persona_id, target->how,
+		      (uintmax_t)target->wait_ns / 1000,
+		      (uintmax_t)target->load_ns / 1000,
+		      target->load_ns ?
+		      b->image->size * 1e3 / target->load_ns : 0.0);
+
+		if (!target->load_ns)
+			continue;
+		if (!first || target->started_ns < first)
+			first = target->started_ns;
+		if (target->done_ns > last)
+			last = target->done_ns;
+	}
+
+	if (failed)
+		reply(b->client, "error %s %d %u of %u cards failed\n", b->tag,
+		      -err, failed, b->nr_targets);
+	else
+		reply(b->client, "ok %s %u %zu %ju %.1f\n", b->tag,
+		      b->nr_targets, b->image->size,
+		      (uintmax_t)(now_ns() - b->received_ns) / 1000,
+		      last > first ? b->image->size * 1e3 *
+		      (b->nr_targets - failed) / (last - first) : 0.0);
+	free(b);
+}
+
+/* A broadcast target is answered with the broadcast, when it is complete */
+static void complete_target(struct pr_waiter *waiter, struct pr_request *req,
+			    const char *how, uint64_t wait)
+{
+	struct pr_target *target = waiter->target;
+
+	target->err = req->err;
+	target->how = how;
+	target->persona_id = req->persona_id;
+	target->wait_ns = wait;
+	target->started_ns = req->started_ns;
+	target->load_ns = req->load_ns;
+	target->done_ns = req->done_ns;
+
+	if (!--waiter->broadcast->pending)
+		answer_broadcast(waiter->broadcast);
+}
+
+static void answer_done(void)
+{
+	struct pr_request *req, *next;
+	struct pr_waiter *waiter, *next_waiter;
+	uint64_t now = now_ns();
+	uint64_t wait;
+	const char *how;
+	char c[64];
+
+	while (read(notify_pipe[0], c, sizeof(c)) > 0)
+		;
+
+	pthread_mutex_lock(&lock);
+	req = done;
+	done = NULL;
+	pthread_mutex_unlock(&lock);
+
+	for (; req; req = next) {
+		next = req->next;
+		for (waiter = req->waiters; waiter; waiter = next_waiter) {
+			next_waiter = waiter->next;
+			/* a request joining a running load did not wait */
+			wait = req->started_ns > waiter->received_ns ?
+			       req->started_ns - waiter->received_ns : 0;
+			how = waiter != req->waiters ? "coalesced" :
+			      req->skipped ? "skipped" : "loaded";
+			if (waiter->broadcast)
+				complete_target(waiter, req, how, wait);
+			else if (req->err)
+				reply(waiter->client, "error %s %d %s\n",
+				      waiter->tag, -req->err,
+				      strerror(-req->err));
+			else
+				reply(waiter->client, "ok %s 0x%x %s %ju %ju\n",
+				      waiter->tag, req->persona_id, how,
+				      (uintmax_t)wait / 1000,
+				      (uintmax_t)req->load_ns / 1000);
+			pthread_mutex_lock(&lock);
+			stats.wait_ns += now - waiter->received_ns;
+			pthread_mutex_unlock(&lock);
+			free(waiter);
+		}
+		free(req);
+	}
+}
+
+static struct pr_waiter *new_waiter(int client, const char *tag)
+{
+	struct pr_waiter *waiter;
+
+	waiter = calloc(1, sizeof(*waiter));
+	if (!waiter)
+		return NULL;
+
+	waiter->client = client;
+	waiter->received_ns = now_ns();
+	snprintf(waiter->tag, sizeof(waiter->tag), "%s", tag);
+	return waiter;
+}
+
+/*
+ * Queue a load for waiter, or attach it to an identical one that is queued
+ * or running.  Waiters are kept in arrival order, the first one is the
+ * request that caused the load.  An identical request queued in a lower
+ * class is moved up to the class of the new one.
+ *
+ * A region takes at most max_queue requests, low priority ones only while
+ * it holds fewer than half of that; -EBUSY beyond.  On error the waiter is
+ * left to the caller.
+ */
+static int queue_load(struct pr_waiter *waiter, struct pr_region *region,
+		      struct pr_image *image, enum pr_class class)
+{
+	struct pr_card *card = region->card;
+	struct pr_request *req = NULL;
+	struct pr_waiter **wtail;
+	int c;
+
+	pthread_mutex_lock(&lock);
+	stats.requests++;
+
+	if (card->running && card->running->region == region &&
+	    card->running->image == image)
+		req = card->running;
+	for (c = 0; c < PR_CLASSES && !req; c++)
+		for (req = region->queue[c]; req; req = req->next)
+			if (req->image == image)
+				break;
+
+	if (req) {
+		stats.coalesced++;
+		if (req != card->running && req->class < class) {
+			unlink_request(req);
+			req->class = class;
+			link_request(req);
+			pthread_cond_signal(&card->cond);
+		}
+	} else if (region->queued >= max_queue ||
+		   (class == PR_CLASS_LOW && region->queued >= max_queue / 2)) {
+		region->class_stats[class].rejected++;
+		stats.rejected++;
+		pthread_mutex_unlock(&lock);
+		return -EBUSY;
+	} else {
+		req = calloc(1, sizeof(*req));
+		if (!req) {
+			pthread_mutex_unlock(&lock);
+			return -ENOMEM;
+		}
+		req->region = region;
+		req->image = image;
+		req->class = class;
+		req->queued_ns = waiter->received_ns;
+		link_request(req);
+		pthread_cond_signal(&card->cond);
+	}
+
+	for (wtail = &req->waiters; *wtail; wtail = &(*wtail)->next)
+		;
+	*wtail = waiter;
+	pthread_mutex_unlock(&lock);
+	return 0;
+}
+
+static void reply_error(int client, const char *tag, int err)
+{
+	reply(client, "error %s %d %s\n", tag, -err,
+	      err == -EBUSY ? "queue full" : strerror(-err));
+}
+
+/*
+ * The regions of a broadcast are given as a comma separated list, each a
+ * region or a card as for load, or as "all", which is the first region of
+ * every card.
+ */
+static unsigned int broadcast_regions(char *list, struct pr_region **targets,
+				      unsigned int max)
+{
+	struct pr_region *region;
+	struct pr_card *card;
+	unsigned int n = 0;
+	char *save;
+	char *name;
+
+	if (!strcmp(list, "all")) {
+		for (card = cards; card && n < max; card = card->next)
+			targets[n++] = find_region(card->name);
+		return n;
+	}
+
+	for (name = strtok_r(list, ",", &save); name;
+	     name = strtok_r(NULL, ",", &save)) {
+		region = find_region(name);
+		if (!region || n == max)
+			return 0;
+		targets[n++] = region;
+	}
+
+	return n;
+}
+
+/*
+ * Queue a load of image for each target.  The waiters all point to one
+ * pr_broadcast, which answer_done() fills in and answers once its last
+ * target is done.
+ */
+static void queue_broadcast(int client, const char *tag, char *list,
+			    struct pr_image *image, enum pr_class class)
+{
+	struct pr_region *targets[MAX_TARGETS];
+	struct pr_waiter *waiter;
+	struct pr_broadcast *b;
+	unsigned int n, i;
+	int err;
+
+	n = broadcast_regions(list, targets, MAX_TARGETS);
+	if (!n) {
+		reply(client, "error %s %d no regions %s\n", tag, ENODEV, list);
+		return;
+	}
+
+	b = calloc(1, sizeof(*b) + n * sizeof(b->targets[0]));
+	if (!b) {
+		reply_error(client, tag, -ENOMEM);
+		return;
+	}
+	b->client = client;
+	snprintf(b->tag, sizeof(b->tag), "%s", tag);
+	b->image = image;
+	b->received_ns = now_ns();
+	b->nr_targets = n;
+	/* held until every target is queued, so none answers it early */
+	b->pending = 1;
+
+	pthread_mutex_lock(&lock);
+	stats.broadcasts++;
+	pthread_mutex_unlock(&lock);
+
+	for (i = 0; i < n; i++) {
+		b->targets[i].region = targets[i];
+		waiter = new_waiter(client, tag);
+		err = waiter ? 0 : -ENOMEM;
+		if (waiter) {
+			waiter->broadcast = b;
+			waiter->target = &b->targets[i];
+			b->pending++;
+			err = queue_load(waiter, targets[i], image, class);
+			if (err) {
+				b->pending--;
+				free(waiter);
+			}
+		}
+		b->targets[i].err = err;
+	}
+
+	if (!--b->pending)
+		answer_broadcast(b);
+}
+
+static void fpga_pr_daemon_stats(int client)
+{
+	unsigned long hits = 0, misses = 0;
+	struct pr_region *region;
+	struct pr_stats s;
+	size_t staged;
+
+	pthread_mutex_lock(&lock);
+	s = stats;
+	staged = staged_bytes;
+	for (region = regions; region; region = region->next) {
+		hits += region->predict.hits;
+		misses += region->predict.misses;
+	}
+	pthread_mutex_unlock(&lock);
+
+	reply(client, "stats requests %lu loads %lu skipped %lu coalesced %lu "
+	      "rejected %lu errors %lu load_us %ju wait_us %ju "
+	      "predicted %lu mispredicted %lu prefetched %lu prefetch_hits %lu "
+	      "cold %lu cold_us %ju saved_us %ju evicted %lu staged_kb %zu "
+	      "pof_rejected %lu broadcasts %lu corrupt %lu\n",
+	      s.requests, s.loads, s.skipped, s.coalesced, s.rejected, s.errors,
+	      (uintmax_t)(s.loads ? s.load_ns / s.loads / 1000 : 0),
+	      (uintmax_t)(s.requests ? s.wait_ns / s.requests / 1000 : 0),
+	      hits, misses, s.prefetched, s.prefetch_hits, s.cold,
+	      (uintmax_t)(s.cold ? s.cold_ns / s.cold / 1000 : 0),
+	      (uintmax_t)s.saved_ns / 1000, s.evicted, staged >> 10,
+	      s.pof_rejected, s.broadcasts, s.corrupt);
+}
+
+/* One line per region and class, then "end" */
+static void fpga_pr_daemon_queues(int client)
+{
+	struct pr_class_stats cs[PR_CLASSES];
+	struct pr_region *region;
+	int c;
+
+	for (region = regions; region; region = region->next) {
+		pthread_mutex_lock(&lock);
+		memcpy(cs, region->class_stats, sizeof(cs));
+		pthread_mutex_unlock(&lock);
+
+		for (c = PR_CLASS_HIGH; c >= PR_CLASS_LOW; c--)
+			reply(client, "queue %s %s depth %u max %u served %lu "
+			      "rejected %lu wait_us %ju max_wait_us %ju\n",
+			      region->name, pr_class_names[c], cs[c].depth,
+			      cs[c].max_depth, cs[c].served, cs[c].rejected,
+			      (uintmax_t)(cs[c].waits ?
+					  cs[c].wait_ns / cs[c].waits / 1000 : 0),
+			      (uintmax_t)cs[c].max_wait_ns / 1000);
+	}
+	reply(client, "end\n");
+}
+
+static int parse_class(const char *name)
+{
+	int c;
+
+	for (c = 0; c < PR_CLASSES; c++)
+		if (!strcmp(name, pr_class_names[c]))
+			return c;
+
+	return -1;
+}
+
+static void handle_line(int client, char *line)
+{
+	enum pr_class class = PR_CLASS_NORMAL;
+	uint32_t persona_id = FPGA_PR_PERSONA_UNKNOWN;
+	struct pr_region *region = NULL;
+	struct pr_waiter *waiter;
+	struct pr_image *image;
+	int broadcast;
+	char *argv[7];
+	int argc = 0;
+	int err = 0;
+	char *save;
+	char *tok;
+	int i;
+
+	for (tok = strtok_r(line, " \t", &save); tok && argc < 7;
+	     tok = strtok_r(NULL, " \t", &save))
+		argv[argc++] = tok;
+
+	if (argc == 1 && !strcmp(argv[0], "stats")) {
+		fpga_pr_daemon_stats(client);
+		return;
+	}
+
+	if (argc == 1 && !strcmp(argv[0], "queues")) {
+		fpga_pr_daemon_queues(client);
+		return;
+	}
+
+	for (i = 4; i < argc && !err; i++) {
+		if (parse_class(argv[i]) >= 0)
+			class = parse_class(argv[i]);
+		else if (persona_id == FPGA_PR_PERSONA_UNKNOWN)
+			persona_id = strtoul(argv[i], NULL, 0);
+		else
+			err = -EINVAL;
+	}
+
+	broadcast = argc > 0 && !strcmp(argv[0], "broadcast");
+	if (argc < 4 || argc > 6 || err ||
+	    (strcmp(argv[0], "load") && !broadcast)) {
+		reply(client, "error %s %d bad request\n",
+		      argc > 1 ? argv[1] : "-", EINVAL);
+		return;
+	}
+
+	/* load <tag> <region> <image>, broadcast <tag> <image> <regions> */
+	if (!broadcast) {
+		region = find_region(argv[2]);
+		if (!region) {
+			reply(client, "error %s %d no region %s\n", argv[1],
+			      ENODEV, argv[2]);
+			return;
+		}
+	}
+
+	image = get_image(argv[broadcast ? 2 : 3], &err);
+	if (!image) {
+		reply(client, "error %s %d %s\n", argv[1], -err, strerror(-err));
+		return;
+	}
+
+	if (persona_id != FPGA_PR_PERSONA_UNKNOWN) {
+		pthread_mutex_lock(&lock);
+		image->persona_id = persona_id;
+		pthread_mutex_unlock(&lock);
+	}
+
+	if (broadcast) {
+		queue_broadcast(client, argv[1], argv[3], image, class);
+		return;
+	}
+
+	waiter = new_waiter(client, argv[1]);
+	err = waiter ? queue_load(waiter, region, image, class) : -ENOMEM;
+	if (err) {
+		free(waiter);
+		reply_error(client, argv[1], err);
+	}
+}
+
+struct pr_client {
+	int fd;
+	int closed;
+	size_t len;
+	char buf[FPGA_PR_DAEMON_LINE_MAX];
+};
+
+/* Returns -1 once the client has gone away */
+static int read_client(struct pr_client *client)
+{
+	char *line, *end;
+	ssize_t len;
+
+	len = read(client->fd, client->buf + client->len,
+		   sizeof(client->buf) - 1 - client->len);
+	if (len <= 0)
+		return -1;
+	client->len += len;
+	client->buf[client->len] = '\0';
+
+	line = client->buf;
+	while ((end = strchr(line, '\n'))) {
+		*end = '\0';
+		if (end > line && end[-1] == '\r')
+			end[-1] = '\0';
+		handle_line(client->fd, line);
+		line = end + 1;
+	}
+
+	client->len -= line - client->buf;
+	memmove(client->buf, line, client->len);
+
+	/* a line that does not fit is dropped */
+	if (client->len == sizeof(client->buf) - 1)
+		client->len = 0;
+
+	return 0;
+}
+
+/*
+ * A client that disconnects with requests outstanding leaves them to run;
+ * its descriptor is only closed once nothing refers to it any more.
+ */
+static int client_busy(int fd)
+{
+	struct pr_region *region;
+	struct pr_request *req;
+	struct pr_waiter *waiter;
+	struct pr_card *card;
+	int busy = 0;
+	int c;
+
+	pthread_mutex_lock(&lock);
+	for (card = cards; card && !busy; card = card->next)
+		if (card->running)
+			for (waiter = card->running->waiters; waiter;
+			     waiter = waiter->next)
+				busy |= waiter->client == fd;
+	for (region = regions; region && !busy; region = region->next)
+		for (c = 0; c < PR_CLASSES; c++)
+			for (req = region->queue[c]; req && !busy; req = req->next)
+				for (waiter = req->waiters; waiter;
+				     waiter = waiter->next)
+					busy |= waiter->client == fd;
+	for (req = done; req && !busy; req = req->next)
+		for (waiter = req->waiters; waiter; waiter = waiter->next)
+			busy |= waiter->client == fd;
+	pthread_mutex_unlock(&lock);
+
+	return busy;
+}
+
+static void stop(int sig __attribute__((unused)))
+{
+	stopping = 1;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, 64)) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+/*
+ * Write the digest sidecar of each image in paths, over the data as it is
+ * loaded, so a compressed image has the digest of its decompressed data.
+ */
+static int write_digests(int count, char **paths)
+{
+	struct pr_image *image;
+	char name[PATH_MAX];
+	uint32_t crc;
+	void *data;
+	FILE *f;
+	int failed = 0;
+	int err;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		err = 0;
+		image = get_image(paths[i], &err);
+		if (image && image->decompress)
+			err = decompress_image(image);
+		if (err) {
+			printf("%s: %s\n", paths[i], strerror(-err));
+			failed = 1;
+			continue;
+		}
+
+		data = mmap(NULL, image->size, PROT_READ, MAP_SHARED,
+			    image->data_fd, 0);
+		if (data == MAP_FAILED) {
+			printf("%s: %s\n", paths[i], strerror(errno));
+			failed = 1;
+			continue;
+		}
+		madvise(data, image->size, MADV_SEQUENTIAL);
+		crc = fpga_pr_crc32c(0, data, image->size);
+		munmap(data, image->size);
+
+		snprintf(name, sizeof(name), "%s%s", paths[i],
+			 PR_DIGEST_SUFFIX);
+		f = fopen(name, "we");
+		if (!f || fprintf(f, "%08x\n", crc) < 0 || fclose(f)) {
+			printf("%s: %s\n", name, strerror(errno));
+			failed = 1;
+			continue;
+		}
+		printf("%08x  %s\n", crc, paths[i]);
+	}
+
+	return failed;
+}
+
+static void usage(const char *prog_name)
+{
+	printf("\nUsage: %s [options]\n", prog_name);
+	printf("       %s --write-digest <image>...\n\n", prog_name);
+	printf("\t-s, --socket=<path>: socket to listen on (default %s)\n",
+	       FPGA_PR_DAEMON_SOCKET);
+	printf("\t--sim=<cards>x<regions>: simulate the regions instead of using %s\n",
+	       FPGA_REGION_CLASS);
+	printf("\t--sim-load-us=<us>: time a simulated load takes (default %u)\n",
+	       sim_load_us);
+	printf("\t--min-residency-ms=<ms>: time a persona stays before a request of\n"
+	       "\t\tthe same or a lower class may replace it (default %ju)\n",
+	       (uintmax_t)min_residency_ns / 1000000);
+	printf("\t--max-queue=<n>: requests queued per region (default %u)\n",
+	       max_queue);
+	printf("\t--stage-mb=<mb>: memory for staged images (default %zu)\n",
+	       stage_budget >> 20);
+	printf("\t--prefetch=<n>: predicted personas to stage as each load starts,\n"
+	       "\t\t0 to 4 (default %u)\n", prefetch_depth);
+	printf("\t--no-pof-check: load images whatever POF ID they carry\n");
+	printf("\t--trace=<file>: append a line per load for fpga_pr_replay\n");
+	printf("\t--numa=<local|far|off>: run each card's loads on the CPUs of its\n"
+	       "\t\tNUMA node, of another node, or anywhere (default local)\n");
+	printf("\t--write-digest: write <image>%s, the CRC32C an image is checked\n"
+	       "\t\tagainst when it is staged, for each image given, and exit\n",
+	       PR_DIGEST_SUFFIX);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *socket_path = FPGA_PR_DAEMON_SOCKET;
+	struct pr_client *clients[MAX_CLIENTS] = { NULL };
+	struct pollfd fds[MAX_CLIENTS + 2];
+	unsigned int sim_cards = 0, sim_regions = 0;
+	int write_digest = 0;
+	struct pr_region *region;
+	struct pr_card *card;
+	int listen_fd;
+	int nfds;
+	int opt;
+	int ret;
+	int i;
+
+	static struct option long_options[] = {
+		{"socket", required_argument, 0, 's'},
+		{"sim", required_argument, 0, 'S'},
+		{"sim-load-us", required_argument, 0, 'L'},
+		{"min-residency-ms", required_argument, 0, 'R'},
+		{"max-queue", required_argument, 0, 'Q'},
+		{"stage-mb", required_argument, 0, 'M'},
+		{"prefetch", required_argument, 0, 'P'},
+		{"no-pof-check", no_argument, 0, 'N'},
+		{"trace", required_argument, 0, 'T'},
+		{"numa", required_argument, 0, 'U'},
+		{"write-digest", no_argument, 0, 'D'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while ((opt = getopt_long(argc, argv, "s:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'S':
+			if (sscanf(optarg, "%ux%u", &sim_cards, &sim_regions) != 2 ||
+			    !sim_cards || !sim_regions)
+				usage(argv[0]);
+			break;
+		case 'L':
+			sim_load_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			min_residency_ns = strtoull(optarg, NULL, 0) * 1000000;
+			break;
+		case 'Q':
+			max_queue = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			stage_budget = (size_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'P':
+			prefetch_depth = strtoul(optarg, NULL, 0);
+			if (prefetch_depth > PR_PREDICT_MAX)
+				usage(argv[0]);
+			break;
+		case 'N':
+			pof_check = 0;
+			break;
+		case 'T':
+			trace = fopen(optarg, "a");
+			if (!trace) {
+				perror(optarg);
+				return 1;
+			}
+			setvbuf(trace, NULL, _IOLBF, 0);
+			break;
+		case 'U':
+			for (numa = 0; numa < PR_NUMA_PLACEMENTS; numa++)
+				if (!strcmp(optarg, pr_numa_names[numa]))
+					break;
+			if (numa == PR_NUMA_PLACEMENTS)
+				usage(argv[0]);
+			break;
+		case 'D':
+			write_digest = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (write_digest) {
+		if (optind == argc)
+			usage(argv[0]);
+		return write_digests(argc - optind, argv + optind);
+	}
+
+	if (sim_cards) {
+		backend = &sim_backend;
+		ret = add_sim_regions(sim_cards, sim_regions);
+	} else {
+		backend = &sysfs_backend;
+		ret = scan_sysfs_regions();
+	}
+	if (ret) {
+		printf("no fpga regions: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	/*
+	 * The driver only reports a persona for a region it can vouch for,
+	 * so a region that kept its persona over a restart is warm and a
+	 * request for that persona is skipped.
+	 */
+	for (region = regions; region; region = region->next) {
+		if (backend->read_persona(region, &region->resident_id))
+			region->resident_id = FPGA_PR_PERSONA_UNKNOWN;
+		if (region->resident_id != FPGA_PR_PERSONA_UNKNOWN)
+			printf("region %s holds persona 0x%x\n", region->name,
+			       region->resident_id);
+	}
+
+	if (pipe2(notify_pipe, O_NONBLOCK | O_CLOEXEC)) {
+		perror("pipe");
+		return 1;
+	}
+
+	listen_fd = listen_on(socket_path);
+	if (listen_fd < 0) {
+		printf("cannot listen on %s: %s\n", socket_path,
+		       strerror(-listen_fd));
+		return 1;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (card = cards; card; card = card->next) {
+		pthread_create(&card->worker, NULL, card_worker, card);
+		i = place_worker(card);
+		if (i >= 0)
+			printf("card %s on node %d, worker on node %d\n",
+			       card->name, card->numa_node, i);
+	}
+	pthread_create(&prefetcher, NULL, prefetch_worker, NULL);
+
+	printf("%s: %s regions, listening on %s\n", argv[0], backend->name,
+	       socket_path);
+
+	while (!stopping) {
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = notify_pipe[0];
+		fds[1].events = POLLIN;
+		nfds = 2;
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			if (!clients[i] || clients[i]->closed)
+				continue;
+			fds[nfds].fd = clients[i]->fd;
+			fds[nfds].events = POLLIN;
+			nfds++;
+		}
+
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		if (fds[1].revents)
+			answer_done();
+
+		for (i = 2; i < nfds; i++) {
+			int j;
+
+			if (!fds[i].revents)
+				continue;
+			for (j = 0; j < MAX_CLIENTS; j++)
+				if (clients[j] && clients[j]->fd == fds[i].fd)
+					break;
+			if (read_client(clients[j]) < 0)
+				clients[j]->closed = 1;
+		}
+
+		/* reap clients that are gone and have nothing outstanding */
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			if (!clients[i] || !clients[i]->closed ||
+			    client_busy(clients[i]->fd))
+				continue;
+			close(clients[i]->fd);
+			free(clients[i]);
+			clients[i] = NULL;
+		}
+
+		if (fds[0].revents) {
+			int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+			for (i = 0; fd >= 0 && i < MAX_CLIENTS; i++)
+				if (!clients[i])
+					break;
+			if (fd >= 0 && i == MAX_CLIENTS) {
+				close(fd);
+			} else if (fd >= 0) {
+				clients[i] = calloc(1, sizeof(*clients[i]));
+				if (clients[i])
+					clients[i]->fd = fd;
+				else
+					close(fd);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&lock);
+	for (card = cards; card; card = card->next)
+		pthread_cond_signal(&card->cond);
+	pthread_cond_broadcast(&stage_cond);
+	pthread_mutex_unlock(&lock);
+	for (card = cards; card; card = card->next)
+		pthread_join(card->worker, NULL);
+	pthread_join(prefetcher, NULL);
+	if (trace)
+		fclose(trace);
+
+	unlink(socket_path);
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Protocol spoken by fpga_pr_daemon on its Unix socket.
+ *
+ * Requests and replies are single lines of text.  A client may send any
+ * number of requests on one connection; replies come back in the order the
+ * requests complete, which for requests to different cards is not the
+ * order they were sent in, so each reply repeats the tag of its request.
+ *
+ *   load <tag> <region> <image> [persona id] [high|normal|low]
+ *	Load image, a path to an rbf, into region.  region is the name of
+ *	the region under /sys/class/fpga_region, or the PCI id of a card,
+ *	which stands for the first region of the card.  If the persona id
+ *	the image carries is given it is remembered for the image; otherwise
+ *	it is learned from the region after the first load.  The priority
+ *	class defaults to normal.  A region holds a persona for at least
+ *	--min-residency-ms unless a higher class than the one that loaded it
+ *	asks for another, and a full queue refuses low priority requests
+ *	first, with EBUSY.  An image with a digest sidecar, <image>.crc32c,
+ *	is checked against it when it is staged, and refused with EBADMSG if
+ *	it does not match, before the region is taken down.
+ *
+ *	ok <tag> <persona id> <how> <wait us> <load us>
+ *	    how is "loaded", "skipped" when the region already held the
+ *	    persona, or "coalesced" when the request was answered by a load
+ *	    queued or running for an identical request.
+ *	error <tag> <errno> <message>
+ *
+ *   broadcast <tag> <image> <regions> [persona id] [high|normal|low]
+ *	Load image into each of regions, a comma separated list of regions
+ *	or cards as for load, or "all" for every card.  The image is staged
+ *	once and the cards load it at the same time.  The reply is a line
+ *	per region, in the order given,
+ *
+ *	card <tag> <region> <persona id> <how> <wait us> <load us> <MB/s>
+ *	card <tag> <region> error <errno> <message>
+ *
+ *	followed, once every region is done, by
+ *
+ *	ok <tag> <regions> <image bytes> <total us> <aggregate MB/s>
+ *	error <tag> <errno> <failed> of <regions> cards failed
+ *
+ *	The aggregate throughput is over the time from the first load
+ *	starting to the last one ending.
+ *
+ *   stats
+ *	One line of counters, see fpga_pr_daemon_stats().
+ *
+ *   queues
+ *	A line per region and priority class with the queue depth, its
+ *	maximum, the loads served, the requests rejected and the average and
+ *	maximum time requests waited, then a line "end".
+ */
+
+#ifndef _FPGA_PR_DAEMON_H
+#define _FPGA_PR_DAEMON_H
+
+#define FPGA_PR_DAEMON_SOCKET	"/run/fpga_pr_daemon.sock"
+
+/* Longest request or reply line, including the newline */
+#define FPGA_PR_DAEMON_LINE_MAX	4352
+
+#define FPGA_PR_PERSONA_UNKNOWN	0xffffffffu
+
+#endif /* _FPGA_PR_DAEMON_H */
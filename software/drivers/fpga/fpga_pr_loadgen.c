@@ -0,0 +1,515 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Load generator for fpga_pr_daemon.  Each client thread keeps a window of
+ * load requests for random images in random regions outstanding and times
+ * every request; the totals give swaps (actual loads) and requests per
+ * second.  Requests are spread over the daemon's priority classes by the
+ * weights given with --priority, and latency is reported per class.
+ * With --cycle each client asks for the images in turn instead of at
+ * random, a load pattern the daemon's persona prediction can learn.
+ * With --broadcast it instead has the daemon load one image into every
+ * card, or the regions given, as often as --requests says, and prints the
+ * throughput per card and overall of each broadcast.
+ * Against a daemon started with --sim no cards are needed.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fpga_pr_daemon.h"
+
+#define MAX_REGIONS	64
+
+static const char * const class_names[] = { "high", "normal", "low" };
+#define NR_CLASSES	3
+
+struct client {
+	pthread_t thread;
+	unsigned int id;
+	unsigned int seed;
+	uint64_t *latency_ns;
+	unsigned char *class;
+	unsigned long loaded;
+	unsigned long skipped;
+	unsigned long coalesced;
+	unsigned long rejected;
+	unsigned long errors;
+};
+
+static const char *socket_path = FPGA_PR_DAEMON_SOCKET;
+static const char *regions[MAX_REGIONS];
+static unsigned int nr_regions;
+static const char *image_prefix = "/lib/firmware/persona";
+static unsigned int nr_images = 4;
+static unsigned int nr_requests = 100;
+static unsigned int window = 1;
+static unsigned int class_weight[NR_CLASSES] = { 0, 1, 0 };
+static int cycle;
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static int connect_daemon(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+static unsigned int pick_class(struct client *client)
+{
+	unsigned int total = 0, c, r;
+
+	for (c = 0; c < NR_CLASSES; c++)
+		total += class_weight[c];
+
+	r = rand_r(&client->seed) % total;
+	for (c = 0; r >= class_weight[c]; c++)
+		r -= class_weight[c];
+
+	return c;
+}
+
+static int send_request(struct client *client, int fd, unsigned int n)
+{
+	char line[FPGA_PR_DAEMON_LINE_MAX];
+	int len;
+
+	client->class[n] = pick_class(client);
+	len = snprintf(line, sizeof(line), "load %u %s %s%u.rbf %s\n", n,
+		       regions[rand_r(&client->seed) % nr_regions],
+		       image_prefix,
+		       cycle ? n % nr_images : rand_r(&client->seed) % nr_images,
+		       class_names[client->class[n]]);
+
+	return send(fd, line, len, 0) == len ? 0 : -errno;
+}
+
+static void account(struct client *client, char *line, uint64_t *sent_ns)
+{
+	char status[16], how[16];
+	unsigned int tag;
+	int err;
+
+	if (sscanf(line, "%15s %u", status, &tag) != 2 || tag >= nr_requests) {
+		printf("client %u: bad reply %s\n", client->id, line);
+		client->errors++;
+		return;
+	}
+
+	client->latency_ns[tag] = now_ns() - sent_ns[tag];
+
+	if (!strcmp(status, "error") &&
+	    sscanf(line, "%*s %*u %d", &err) == 1 && err == EBUSY) {
+		client->rejected++;
+	} else if (strcmp(status, "ok") ||
+		   sscanf(line, "%*s %*u %*x %15s", how) != 1) {
+		printf("client %u: %s\n", client->id, line);
+		client->errors++;
+	} else if (!strcmp(how, "loaded")) {
+		client->loaded++;
+	} else if (!strcmp(how, "skipped")) {
+		client->skipped++;
+	} else {
+		client->coalesced++;
+	}
+}
+
+static void *run_client(void *arg)
+{
+	struct client *client = arg;
+	char buf[FPGA_PR_DAEMON_LINE_MAX];
+	unsigned int sent = 0, answered = 0;
+	uint64_t *sent_ns;
+	size_t len = 0;
+	char *line, *end;
+	ssize_t ret;
+	int fd;
+
+	sent_ns = calloc(nr_requests, sizeof(*sent_ns));
+	fd = connect_daemon();
+	if (fd < 0 || !sent_ns) {
+		printf("client %u: cannot connect to %s\n", client->id,
+		       socket_path);
+		client->errors = nr_requests;
+		free(sent_ns);
+		return NULL;
+	}
+
+	while (answered < nr_requests) {
+		while (sent < nr_requests && sent - answered < window) {
+			sent_ns[sent] = now_ns();
+			if (send_request(client, fd, sent))
+				goto out;
+			sent++;
+		}
+
+		ret = read(fd, buf + len, sizeof(buf) - 1 - len);
+		if (ret <= 0)
+			break;
+		len += ret;
+		buf[len] = '\0';
+
+		line = buf;
+		while ((end = strchr(line, '\n'))) {
+			*end = '\0';
+			account(client, line, sent_ns);
+			answered++;
+			line = end + 1;
+		}
+		len -= line - buf;
+		memmove(buf, line, len);
+	}
+
+out:
+	if (answered < nr_requests) {
+		printf("client %u: connection lost after %u replies\n",
+		       client->id, answered);
+		client->errors += nr_requests - answered;
+	}
+	close(fd);
+	free(sent_ns);
+	return NULL;
+}
+
+/*
+ * Send rounds broadcasts of image one after the other and print the
+ * daemon's answers, a line per card ending with one starting with ok or
+ * error.  Returns the number of broadcasts that failed.
+ */
+static unsigned int run_broadcast(const char *image, unsigned int rounds)
+{
+	char list[FPGA_PR_DAEMON_LINE_MAX] = "all";
+	char buf[FPGA_PR_DAEMON_LINE_MAX];
+	unsigned int errors = 0, i;
+	size_t pos = 0, len = 0;
+	char *line, *end;
+	uint64_t start;
+	ssize_t ret;
+	int done;
+	int fd;
+
+	for (i = 0; i < nr_regions && pos < sizeof(list); i++)
+		pos += snprintf(list + pos, sizeof(list) - pos, "%s%s",
+				i ? "," : "", regions[i]);
+
+	fd = connect_daemon();
+	if (fd < 0) {
+		printf("cannot connect to %s\n", socket_path);
+		return rounds;
+	}
+
+	start = now_ns();
+	for (i = 0; i < rounds; i++) {
+		pos = snprintf(buf, sizeof(buf), "broadcast %u %s %s %s\n", i,
+			       image, list, class_names[1]);
+		if (send(fd, buf, pos, 0) != (ssize_t)pos)
+			break;
+
+		for (done = 0; !done; ) {
+			ret = read(fd, buf + len, sizeof(buf) - 1 - len);
+			if (ret <= 0)
+				break;
+			len += ret;
+			buf[len] = '\0';
+
+			line = buf;
+			while ((end = strchr(line, '\n'))) {
+				*end = '\0';
+				printf("%s\n", line);
+				if (!strncmp(line, "error ", 6))
+					errors++;
+				done |= strncmp(line, "card ", 5) != 0;
+				line = end + 1;
+			}
+			len -= line - buf;
+			memmove(buf, line, len);
+		}
+		if (!done)
+			break;
+	}
+	close(fd);
+
+	if (i < rounds) {
+		printf("connection lost after %u broadcasts\n", i);
+		errors += rounds - i;
+	}
+	printf("%u broadcasts of %s in %.3f s\n", rounds, image,
+	       (now_ns() - start) / 1e9);
+	return errors;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_latency(const char *name, uint64_t *latency, size_t count)
+{
+	if (!count)
+		return;
+
+	qsort(latency, count, sizeof(*latency), compare_u64);
+	printf("\t%-7s latency p50 %.3f ms, p99 %.3f ms, max %.3f ms (%zu requests)\n",
+	       name, latency[count / 2] / 1e6, latency[count * 99 / 100] / 1e6,
+	       latency[count - 1] / 1e6, count);
+}
+
+/* Print the daemon's reply to command, which ends with a line "end" if last */
+static void print_daemon(const char *command, const char *last)
+{
+	char buf[FPGA_PR_DAEMON_LINE_MAX * 4];
+	size_t len = 0;
+	ssize_t ret;
+	int fd;
+
+	fd = connect_daemon();
+	if (fd < 0)
+		return;
+
+	if (send(fd, command, strlen(command), 0) != (ssize_t)strlen(command)) {
+		close(fd);
+		return;
+	}
+
+	while (len < sizeof(buf) - 1) {
+		ret = read(fd, buf + len, sizeof(buf) - 1 - len);
+		if (ret <= 0)
+			break;
+		len += ret;
+		buf[len] = '\0';
+		if (!last && strchr(buf, '\n'))
+			break;
+		if (last && len >= strlen(last) &&
+		    !strcmp(buf + len - strlen(last), last))
+			break;
+	}
+	buf[len] = '\0';
+	printf("%s", buf);
+	close(fd);
+}
+
+static void usage(const char *prog_name)
+{
+	printf("\nUsage: %s [options]\n\n", prog_name);
+	printf("\t-s, --socket=<path>: daemon socket (default %s)\n",
+	       FPGA_PR_DAEMON_SOCKET);
+	printf("\t-r, --region=<name>: region to load, may be repeated (default sim0.0)\n");
+	printf("\t-i, --images=<n>: number of images <prefix><0..n-1>.rbf (default %u)\n",
+	       nr_images);
+	printf("\t-p, --prefix=<path>: image path prefix (default %s)\n",
+	       image_prefix);
+	printf("\t-c, --clients=<n>: client threads (default 4)\n");
+	printf("\t-n, --requests=<n>: requests per client (default %u)\n",
+	       nr_requests);
+	printf("\t-w, --window=<n>: outstanding requests per client (default %u)\n",
+	       window);
+	printf("\t-C, --cycle: ask for the images in turn, not at random\n");
+	printf("\t-B, --broadcast=<image>: load image into the regions given, or\n"
+	       "\t\tevery card, --requests times\n");
+	printf("\t-P, --priority=<high>:<normal>:<low>: weights of the priority\n"
+	       "\t\tclasses requests are sent with (default 0:1:0)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long loaded = 0, skipped = 0, coalesced = 0, errors = 0;
+	unsigned long rejected = 0;
+	size_t class_count[NR_CLASSES] = { 0 };
+	unsigned int nr_clients = 4;
+	const char *broadcast = NULL;
+	struct client *clients;
+	unsigned char *class;
+	uint64_t *latency, *class_latency;
+	uint64_t start, elapsed;
+	double seconds;
+	size_t total, j;
+	unsigned int i, c;
+	int opt;
+
+	static struct option long_options[] = {
+		{"socket", required_argument, 0, 's'},
+		{"region", required_argument, 0, 'r'},
+		{"images", required_argument, 0, 'i'},
+		{"prefix", required_argument, 0, 'p'},
+		{"clients", required_argument, 0, 'c'},
+		{"requests", required_argument, 0, 'n'},
+		{"window", required_argument, 0, 'w'},
+		{"priority", required_argument, 0, 'P'},
+		{"cycle", no_argument, 0, 'C'},
+		{"broadcast", required_argument, 0, 'B'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while ((opt = getopt_long(argc, argv, "s:r:i:p:c:n:w:P:CB:h", long_options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'r':
+			if (nr_regions < MAX_REGIONS)
+				regions[nr_regions++] = optarg;
+			break;
+		case 'i':
+			nr_images = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			image_prefix = optarg;
+			break;
+		case 'c':
+			nr_clients = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_requests = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			cycle = 1;
+			break;
+		case 'B':
+			broadcast = optarg;
+			break;
+		case 'P':
+			if (sscanf(optarg, "%u:%u:%u", &class_weight[0],
+				   &class_weight[1], &class_weight[2]) != 3)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (broadcast) {
+		errors = run_broadcast(broadcast, nr_requests);
+		printf("daemon ");
+		print_daemon("stats\n", NULL);
+		return errors ? 1 : 0;
+	}
+
+	if (!nr_regions)
+		regions[nr_regions++] = "sim0.0";
+	if (!nr_images || !nr_clients || !nr_requests || !window ||
+	    !(class_weight[0] + class_weight[1] + class_weight[2]))
+		usage(argv[0]);
+
+	total = (size_t)nr_clients * nr_requests;
+	clients = calloc(nr_clients, sizeof(*clients));
+	latency = calloc(total, sizeof(*latency));
+	class_latency = calloc(total, sizeof(*class_latency));
+	class = calloc(total, sizeof(*class));
+	if (!clients || !latency || !class_latency || !class) {
+		printf("out of memory\n");
+		return 1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < nr_clients; i++) {
+		clients[i].id = i;
+		clients[i].seed = i + 1;
+		clients[i].latency_ns = latency + (size_t)i * nr_requests;
+		clients[i].class = class + (size_t)i * nr_requests;
+		pthread_create(&clients[i].thread, NULL, run_client,
+			       &clients[i]);
+	}
+	for (i = 0; i < nr_clients; i++) {
+		pthread_join(clients[i].thread, NULL);
+		loaded += clients[i].loaded;
+		skipped += clients[i].skipped;
+		coalesced += clients[i].coalesced;
+		rejected += clients[i].rejected;
+		errors += clients[i].errors;
+	}
+	elapsed = now_ns() - start;
+	seconds = elapsed / 1e9;
+
+	printf("%zu requests from %u clients to %u regions over %u images in %.3f s\n",
+	       total, nr_clients, nr_regions, nr_images, seconds);
+	printf("\tloaded %lu, skipped %lu, coalesced %lu, rejected %lu, errors %lu\n",
+	       loaded, skipped, coalesced, rejected, errors);
+	printf("\t%.1f swaps/s, %.1f requests/s\n", loaded / seconds,
+	       total / seconds);
+
+	for (c = 0; c < NR_CLASSES; c++) {
+		for (j = 0, class_count[c] = 0; j < total; j++)
+			if (class[j] == c)
+				class_latency[class_count[c]++] = latency[j];
+		if (class_count[c] != total)
+			print_latency(class_names[c], class_latency,
+				      class_count[c]);
+	}
+	print_latency("all", latency, total);
+
+	printf("daemon ");
+	print_daemon("stats\n", NULL);
+	print_daemon("queues\n", "end\n");
+
+	free(clients);
+	free(latency);
+	free(class_latency);
+	free(class);
+	return errors ? 1 : 0;
+}
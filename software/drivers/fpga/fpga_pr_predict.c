@@ -0,0 +1,151 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "fpga_pr_predict.h"
+
+/* Counts are halved when one reaches these */
+#define PR_PREDICT_TRANSITION_LIMIT	256
+#define PR_PREDICT_FREQUENCY_LIMIT	1024
+
+void pr_predict_init(struct pr_predict *predict)
+{
+	memset(predict, 0, sizeof(*predict));
+	predict->current = -1;
+}
+
+static int find_state(const struct pr_predict *predict, uint32_t persona_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < predict->states; i++)
+		if (predict->persona_id[i] == persona_id)
+			return i;
+
+	return -1;
+}
+
+/* A new state, taking the place of the least loaded one when all are used */
+static int add_state(struct pr_predict *predict, uint32_t persona_id)
+{
+	unsigned int i;
+	int s = -1;
+
+	if (predict->states < PR_PREDICT_STATES) {
+		s = predict->states++;
+	} else {
+		for (i = 0; i < PR_PREDICT_STATES; i++)
+			if ((int)i != predict->current &&
+			    (s < 0 || predict->frequency[i] < predict->frequency[s]))
+				s = i;
+		for (i = 0; i < PR_PREDICT_STATES; i++)
+			predict->transitions[i][s] = 0;
+	}
+
+	predict->persona_id[s] = persona_id;
+	predict->frequency[s] = 0;
+	memset(predict->transitions[s], 0, sizeof(predict->transitions[s]));
+	return s;
+}
+
+int pr_predict_update(struct pr_predict *predict, uint32_t persona_id)
+{
+	unsigned int i;
+	int hit = 0;
+	int s;
+
+	for (i = 0; i < predict->nr_predicted; i++)
+		hit |= predict->predicted[i] == persona_id;
+	if (hit)
+		predict->hits++;
+	else if (predict->nr_predicted)
+		predict->misses++;
+	predict->nr_predicted = 0;
+
+	s = find_state(predict, persona_id);
+	if (s < 0)
+		s = add_state(predict, persona_id);
+
+	if (++predict->frequency[s] >= PR_PREDICT_FREQUENCY_LIMIT)
+		for (i = 0; i < predict->states; i++)
+			predict->frequency[i] /= 2;
+
+	if (predict->current >= 0 && predict->current != s &&
+	    ++predict->transitions[predict->current][s] >=
+	    PR_PREDICT_TRANSITION_LIMIT)
+		for (i = 0; i < predict->states; i++)
+			predict->transitions[predict->current][i] /= 2;
+
+	predict->current = s;
+	return hit;
+}
+
+/*
+ * Successors of the current persona rank by how often they followed it,
+ * ahead of the other personas, which rank by how often they were loaded.
+ */
+unsigned int pr_predict_next(struct pr_predict *predict, uint32_t *next,
+			     unsigned int max)
+{
+	uint64_t score[PR_PREDICT_MAX];
+	uint64_t s;
+	unsigned int n = 0;
+	unsigned int i, j;
+
+	if (max > PR_PREDICT_MAX)
+		max = PR_PREDICT_MAX;
+
+	for (i = 0; i < predict->states; i++) {
+		if ((int)i == predict->current || !predict->frequency[i])
+			continue;
+
+		s = predict->frequency[i];
+		if (predict->current >= 0)
+			s |= (uint64_t)predict->transitions[predict->current][i] << 32;
+
+		for (j = n; j > 0 && score[j - 1] < s; j--) {
+			if (j < max) {
+				score[j] = score[j - 1];
+				next[j] = next[j - 1];
+			}
+		}
+		if (j < max) {
+			score[j] = s;
+			next[j] = predict->persona_id[i];
+			if (n < max)
+				n++;
+		}
+	}
+
+	memcpy(predict->predicted, next, n * sizeof(*next));
+	predict->nr_predicted = n;
+	return n;
+}
@@ -0,0 +1,92 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Next persona prediction for a region, shared by fpga_pr_daemon and
+ * fpga_pr_replay.
+ *
+ * The model is a first order Markov chain over the persona ids loaded
+ * into the region: it counts the transitions from each persona to the
+ * next one and predicts the most frequent successors of the persona the
+ * region holds, falling back to the personas loaded most often.  Counts
+ * are halved as they grow, so the model follows a load mix that changes
+ * over the day.
+ *
+ * fpga_pr_daemon --trace writes a line per load, which fpga_pr_replay
+ * feeds back through the model:
+ *
+ *   <time us> <region> <persona id> <stage us> <cold>
+ *
+ * stage us is what staging the image (mapping, locking and validating
+ * it) cost the last time it was done, and cold is 1 if the load had to
+ * wait for that because the image was not staged.
+ */
+
+#ifndef _FPGA_PR_PREDICT_H
+#define _FPGA_PR_PREDICT_H
+
+#include <stdint.h>
+
+/* Personas a model keeps counts for */
+#define PR_PREDICT_STATES	32
+
+/* Most predictions asked for at once */
+#define PR_PREDICT_MAX		4
+
+struct pr_predict {
+	uint32_t persona_id[PR_PREDICT_STATES];
+	uint32_t frequency[PR_PREDICT_STATES];
+	uint32_t transitions[PR_PREDICT_STATES][PR_PREDICT_STATES];
+	unsigned int states;
+	int current;
+	/* the last prediction, checked by the next update */
+	uint32_t predicted[PR_PREDICT_MAX];
+	unsigned int nr_predicted;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+void pr_predict_init(struct pr_predict *predict);
+
+/*
+ * Persona persona_id was loaded: count it as a hit if the last prediction
+ * had it, a miss if there was a prediction, and learn the transition to
+ * it.  Returns 1 for a hit.
+ */
+int pr_predict_update(struct pr_predict *predict, uint32_t persona_id);
+
+/*
+ * Fill next with up to max personas likely to be loaded after the current
+ * one, most likely first, and return how many there are.
+ */
+unsigned int pr_predict_next(struct pr_predict *predict, uint32_t *next,
+			     unsigned int max);
+
+#endif /* _FPGA_PR_PREDICT_H */
@@ -0,0 +1,204 @@
+/*
+ *     Copyright (C) 2017 Intel Corporation
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replays the load traces fpga_pr_daemon --trace writes through the
+ * persona prediction model (see fpga_pr_predict.h), to see how well it
+ * would have predicted each region's loads and what prefetching would
+ * have saved, for a prediction depth other than the daemon's or a trace
+ * recorded with prefetching off.
+ *
+ * Each load the model predicted counts as saving the staging time the
+ * trace records for its image, as if the stage budget kept every
+ * prediction staged.
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fpga_pr_predict.h"
+
+#define NAME_MAX_LEN	64
+
+struct region {
+	char name[NAME_MAX_LEN];
+	struct pr_predict predict;
+	unsigned long loads;
+	unsigned long cold;
+	unsigned long cold_predicted;
+	uint64_t cold_us;
+	uint64_t saved_us;
+	struct region *next;
+};
+
+static struct region *regions;
+static unsigned int depth = 2;
+
+static struct region *get_region(const char *name)
+{
+	struct region *region, **tail;
+
+	for (tail = &regions; *tail; tail = &(*tail)->next)
+		if (!strcmp((*tail)->name, name))
+			return *tail;
+
+	region = calloc(1, sizeof(*region));
+	if (!region)
+		return NULL;
+	snprintf(region->name, sizeof(region->name), "%s", name);
+	pr_predict_init(&region->predict);
+	*tail = region;
+	return region;
+}
+
+static int replay(FILE *f, const char *name)
+{
+	char line[256], region_name[NAME_MAX_LEN];
+	uint32_t next[PR_PREDICT_MAX];
+	unsigned long long time_us, stage_us;
+	struct region *region;
+	unsigned int persona_id;
+	unsigned int lineno = 0;
+	int cold;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (sscanf(line, "%llu %63s %x %llu %d", &time_us, region_name,
+			   &persona_id, &stage_us, &cold) != 5) {
+			printf("%s:%u: bad trace line\n", name, lineno);
+			return 1;
+		}
+
+		region = get_region(region_name);
+		if (!region) {
+			printf("out of memory\n");
+			return 1;
+		}
+
+		region->loads++;
+		if (cold) {
+			region->cold++;
+			region->cold_us += stage_us;
+		}
+		if (pr_predict_update(&region->predict, persona_id)) {
+			region->saved_us += stage_us;
+			region->cold_predicted += cold;
+		}
+		pr_predict_next(&region->predict, next, depth);
+	}
+
+	return 0;
+}
+
+static void print_region(const char *name, unsigned long loads,
+			 unsigned long hits, unsigned long misses,
+			 unsigned long cold, unsigned long cold_predicted,
+			 uint64_t cold_us, uint64_t saved_us)
+{
+	printf("%-24s %8lu %7.1f%% %8lu %8lu %10.3f %10.3f\n", name, loads,
+	       hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+	       cold, cold_predicted, cold_us / 1e3, saved_us / 1e3);
+}
+
+static void usage(const char *prog_name)
+{
+	printf("\nUsage: %s [options] [trace...]\n\n", prog_name);
+	printf("\tReads the traces given, or stdin.\n");
+	printf("\t-d, --depth=<n>: personas predicted after each load, 1 to %u (default %u)\n",
+	       PR_PREDICT_MAX, depth);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long loads = 0, hits = 0, misses = 0;
+	unsigned long cold = 0, cold_predicted = 0;
+	uint64_t cold_us = 0, saved_us = 0;
+	struct region *region;
+	FILE *f;
+	int ret = 0;
+	int opt;
+
+	static struct option long_options[] = {
+		{"depth", required_argument, 0, 'd'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while ((opt = getopt_long(argc, argv, "d:h", long_options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'd':
+			depth = strtoul(optarg, NULL, 0);
+			if (!depth || depth > PR_PREDICT_MAX)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind == argc)
+		ret = replay(stdin, "stdin");
+	for (; optind < argc && !ret; optind++) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+		ret = replay(f, argv[optind]);
+		fclose(f);
+	}
+	if (ret)
+		return ret;
+
+	printf("%-24s %8s %8s %8s %8s %10s %10s\n", "region", "loads",
+	       "hit rate", "cold", "cold hit", "cold ms", "saved ms");
+	for (region = regions; region; region = region->next) {
+		print_region(region->name, region->loads,
+			     region->predict.hits, region->predict.misses,
+			     region->cold, region->cold_predicted,
+			     region->cold_us, region->saved_us);
+		loads += region->loads;
+		hits += region->predict.hits;
+		misses += region->predict.misses;
+		cold += region->cold;
+		cold_predicted += region->cold_predicted;
+		cold_us += region->cold_us;
+		saved_us += region->saved_us;
+	}
+	print_region("total", loads, hits, misses, cold, cold_predicted,
+		     cold_us, saved_us);
+
+	return 0;
+}
@@ -17,11 +17,15 @@
  */
 #include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/sizes.h>
+#include <linux/workqueue.h>
 
 #ifndef _LINUX_FPGA_MGR_H
 #define _LINUX_FPGA_MGR_H
 
 struct fpga_manager;
+struct fpga_mgr_pool;
+struct sg_table;
 
 /**
  * enum fpga_mgr_states - fpga framework states
@@ -87,22 +91,27 @@ struct fpga_image_info {
 
 /**
  * struct fpga_manager_ops - ops for low level fpga manager drivers
+ * @initial_header_size: Maximum number of bytes that should be passed into write_init
  * @state: returns an enum value of the FPGA's state
  * @write_init: prepare the FPGA to receive confuration data
  * @write: write count bytes of configuration data to the FPGA
+ * @write_sg: write the scatter list of configuration data to the FPGA
  * @write_complete: set FPGA to operating state after writing is done
  * @fpga_remove: optional: Set FPGA into a specific state during driver remove
  *
  * fpga_manager_ops are the low level functions implemented by a specific
  * fpga manager driver.  The optional ones are tested for NULL before being
- * called, so leaving them out is fine.
+ * called, so leaving them out is fine.  At least one of write and write_sg
+ * must be provided.
  */
 struct fpga_manager_ops {
+	size_t initial_header_size;
 	enum fpga_mgr_states (*state)(struct fpga_manager *mgr);
 	int (*write_init)(struct fpga_manager *mgr,
 			  struct fpga_image_info *info,
 			  const char *buf, size_t count);
 	int (*write)(struct fpga_manager *mgr, const char *buf, size_t count);
+	int (*write_sg)(struct fpga_manager *mgr, struct sg_table *sgt);
 	int (*write_complete)(struct fpga_manager *mgr,
 			      struct fpga_image_info *info);
 	void (*fpga_remove)(struct fpga_manager *mgr);
@@ -116,6 +125,8 @@ struct fpga_manager_ops {
  * @state: state of fpga manager
  * @mops: pointer to struct of fpga manager ops
  * @priv: low level driver private date
+ * @wq: work done for loads, on the CPUs of the NUMA node of the device
+ * @pool: staging memory reserved for loads, see fpga-mgr-pool.c
  */
 struct fpga_manager {
 	const char *name;
@@ -124,6 +135,8 @@ struct fpga_manager {
 	enum fpga_mgr_states state;
 	const struct fpga_manager_ops *mops;
 	void *priv;
+	struct workqueue_struct *wq;
+	struct fpga_mgr_pool *pool;
 #ifdef CONFIG_FPGA_MGR_DEBUG_FS
 	void *debugfs;
 #endif
@@ -133,11 +146,42 @@ struct fpga_manager {
 
 int fpga_mgr_buf_load(struct fpga_manager *mgr, struct fpga_image_info *info,
 		      const char *buf, size_t count);
+int fpga_mgr_buf_load_sg(struct fpga_manager *mgr,
+			 struct fpga_image_info *info,
+			 struct sg_table *sgt);
+int fpga_mgr_user_load(struct fpga_manager *mgr, struct fpga_image_info *info,
+		       const char __user *buf, size_t count);
 
 int fpga_mgr_firmware_load(struct fpga_manager *mgr,
 			   struct fpga_image_info *info,
 			   const char *image_name);
 
+/*
+ * Size of the chunks passed to the write op by fpga_mgr_stream_load(), a
+ * multiple of 4 so that only the last chunk of an image can end in a partial
+ * word.
+ */
+#define FPGA_MGR_STREAM_CHUNK_SIZE	SZ_64K
+
+/* Reads up to count bytes of image, returns 0 at the end or a negative error */
+typedef ssize_t (*fpga_mgr_stream_read_t)(void *src, char *buf, size_t count);
+
+int fpga_mgr_stream_load(struct fpga_manager *mgr,
+			 struct fpga_image_info *info,
+			 fpga_mgr_stream_read_t read, void *src);
+
+int fpga_mgr_file_load(struct fpga_manager *mgr,
+		       struct fpga_image_info *info,
+		       const char *path);
+
+/* The NUMA node of the device behind mgr, for buffers used to load it */
+static inline int fpga_mgr_node(struct fpga_manager *mgr)
+{
+	return dev_to_node(mgr->dev.parent);
+}
+
+struct fpga_manager *fpga_mgr_get(struct device *dev);
+
 struct fpga_manager *of_fpga_mgr_get(struct device_node *node);
 
 void fpga_mgr_put(struct fpga_manager *mgr);
@@ -0,0 +1,91 @@
+/*
+ * FPGA Region Framework
+ *
+ *  Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <linux/device.h>
+#include <linux/fpga/fpga-mgr.h>
+#include <linux/time.h>
+
+#ifndef _LINUX_FPGA_REGION_H
+#define _LINUX_FPGA_REGION_H
+
+/* Offset of the persona ID register from the base of a PR region */
+#define FPGA_REGION_PERSONA_ID_OFFSET	0x00
+
+/* Persona ID reported when the region's contents are not known */
+#define FPGA_REGION_PERSONA_NONE	0xffffffff
+
+/*
+ * Where the persona of a region comes from: none when it is not known and
+ * the region has to be loaded before use, warm when it was found in the
+ * region when the region was registered, loaded after a load through it.
+ */
+enum fpga_region_resident {
+	FPGA_REGION_RESIDENT_NONE,
+	FPGA_REGION_RESIDENT_WARM,
+	FPGA_REGION_RESIDENT_LOADED,
+};
+
+/**
+ * struct fpga_region - FPGA region structure
+ * @dev: FPGA region device, named after the region
+ * @mutex: serializes loads and updates of the fields below
+ * @mgr: FPGA manager used to program the region
+ * @bridge_list: bridges disabled while the region is programmed
+ * @info: image information passed to the manager and bridges
+ * @persona_base: mapped base of the region, where the persona ID lives
+ * @persona_id: persona ID read back after the last load or at registration
+ * @resident: where persona_id comes from
+ * @load_count: number of successful loads since registration
+ * @last_load: wall clock time of the last successful load
+ * @last_load_us: duration of the last successful load
+ */
+struct fpga_region {
+	struct device dev;
+	struct mutex mutex;
+	struct fpga_manager *mgr;
+	struct list_head bridge_list;
+	struct fpga_image_info info;
+	void __iomem *persona_base;
+	u32 persona_id;
+	enum fpga_region_resident resident;
+	unsigned long load_count;
+	struct timeval last_load;
+	unsigned long last_load_us;
+};
+
+#define to_fpga_region(d) container_of(d, struct fpga_region, dev)
+
+int fpga_region_program_fpga(struct fpga_region *region,
+			     const char *image_name);
+int fpga_region_program_file(struct fpga_region *region, const char *path);
+int fpga_region_load_by_name(const char *region_name, const char *image_name);
+
+const char *fpga_region_resident_name(enum fpga_region_resident resident);
+
+int fpga_region_attach_bridge(struct fpga_region *region,
+			      struct device *br_dev);
+
+struct fpga_region *fpga_region_register(struct device *dev, const char *name,
+					 struct device *mgr_dev,
+					 void __iomem *persona_base);
+void fpga_region_unregister(struct fpga_region *region);
+
+/* Called by the fpga manager framework when its module is loaded/unloaded */
+int fpga_region_class_init(void);
+void fpga_region_class_exit(void);
+
+#endif /* _LINUX_FPGA_REGION_H */
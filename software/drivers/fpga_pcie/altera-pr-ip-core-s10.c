@@ -285,6 +285,65 @@ int alt_pr_ip_fpga_write(struct fpga_pcie_priv *priv, struct file *fp)
 	return 0;
 }
 
+/*
+ * Write an image that is already mapped in memory, e.g. user pages pinned by
+ * the FPGA_INITIATE_PR_BUF ioctl, without reading it through a file.  Pauses
+ * between 4K chunks like alt_pr_ip_fpga_write().
+ */
+int alt_pr_ip_fpga_write_buf(struct fpga_pcie_priv *priv, const char *buf,
+			     size_t count)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	const u32 *buffer_32 = (const u32 *)buf;
+	u32 time_to_wait = WAIT_TIME; //compile parameter
+	u32 chunk_num = 0;
+	size_t i = 0;
+
+	dev_info(dev, "Checking pre-write state\n");
+	alt_pr_ip_fpga_state(priv);
+	dev_info(dev, "Done checking pre-write state\n");
+
+	/* Write out the complete 32-bit chunks */
+	/* Wait for a designated amount of time between 4K chunks */
+	while (count >= sizeof(u32)) {
+		writel(buffer_32[i++], priv->reg_base);
+		count -= sizeof(u32);
+
+		if (!(i % 1024)) {
+			chunk_num++;
+#ifdef VERBOSE_TRUE
+			dev_info(dev, "4K RBF chunk # %d written. Checking state and pausing for %d ms\n", chunk_num, time_to_wait);
+			if (alt_pr_ip_fpga_state(priv) != FPGA_PR_IP_STATE_WRITE)
+			{
+				dev_err(dev, "PR IP Error while writing RBF\n");
+				return -EIO;
+			}
+#endif
+			msleep(time_to_wait);
+		}
+	}
+
+	/* Write out remaining non 32-bit chunks */
+	switch (count) {
+	case 3:
+		writel(buffer_32[i] & 0x00ffffff, priv->reg_base);
+		break;
+	case 2:
+		writel(buffer_32[i] & 0x0000ffff, priv->reg_base);
+		break;
+	case 1:
+		writel(buffer_32[i] & 0x000000ff, priv->reg_base);
+		break;
+	default:
+		break;
+	}
+
+	if (alt_pr_ip_fpga_state(priv) == FPGA_PR_IP_STATE_WRITE_ERR)
+		return -EIO;
+
+	return 0;
+}
+
 int alt_pr_ip_fpga_write_complete(struct fpga_pcie_priv *priv,
 				      int config_timeout_us)
 {
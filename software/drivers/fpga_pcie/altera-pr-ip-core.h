@@ -71,6 +71,9 @@ int alt_pr_ip_write_init(struct fpga_pcie_priv *priv,
 
 int alt_pr_ip_fpga_write(struct fpga_pcie_priv *priv, struct file *fp);
 
+int alt_pr_ip_fpga_write_buf(struct fpga_pcie_priv *priv, const char *buf,
+			     size_t count);
+
 int alt_pr_ip_fpga_write_complete(struct fpga_pcie_priv *priv,
 				      int config_timeout_us);
 
@@ -5,6 +5,8 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
  
 #include "fpga-ioctl.h"
 
@@ -58,6 +60,74 @@ int partial_reconfig(int fd, char *rbf_path, int region_controller_addr) {
 	return 0;
 }
 
+/*
+ * Same as partial_reconfig(), but the RBF is mapped into memory and the driver
+ * writes it to the PR IP straight from the mapped pages, without a copy.
+ * Returns 0 on siccess, -1 on failure
+ */
+int partial_reconfig_buf(int fd, char *rbf_path, int region_controller_addr) {
+
+	pr_buf_arg_t pr_buf_args;
+	struct stat st;
+	void *rbf;
+	int rbf_fd;
+	int ret = -1;
+
+	rbf_fd = open(rbf_path, O_RDONLY);
+	if (rbf_fd == -1 || fstat(rbf_fd, &st) == -1)
+	{
+		perror("rbf open");
+		return -1;
+	}
+
+	rbf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, rbf_fd, 0);
+	close(rbf_fd);
+	if (rbf == MAP_FAILED)
+	{
+		perror("rbf mmap");
+		return -1;
+	}
+
+	memset(&pr_buf_args, 0, sizeof(pr_buf_args));
+	pr_buf_args.buf = (unsigned long)rbf;
+	pr_buf_args.size = st.st_size;
+	pr_buf_args.config_timeout = 10;
+
+	printf("Enabling freeze at address 0x%08X\n", region_controller_addr);
+
+	if (ioctl(fd, FPGA_PR_REGION_CONTROLLER_FREEZE_ENABLE, &region_controller_addr) == -1)
+	{
+		printf("Error enabling freeze at specified address. Please look at /var/log/messages for more information.\n");
+		goto out;
+	}
+
+	printf("Initiating PR with RBF %s from user buffer\n", rbf_path);
+
+	if (ioctl(fd, FPGA_INITIATE_PR_BUF, &pr_buf_args) == -1)
+	{
+		printf("Error during PR. Please look at /var/log/messages for more information.\n");
+		goto out;
+	}
+
+	printf("Disabling freeze at address 0x%08X\n", region_controller_addr);
+
+	if (ioctl(fd, FPGA_PR_REGION_CONTROLLER_FREEZE_DISABLE, &region_controller_addr) == -1)
+	{
+		printf("Error disabling freeze at specified address. Please look at /var/log/messages for more information.\n");
+		goto out;
+	}
+
+	printf("PR complete: %lld bytes in %llu us (%.1f MB/s)\n",
+	       (long long)st.st_size, pr_buf_args.elapsed_us,
+	       pr_buf_args.elapsed_us ?
+	       (double)st.st_size / pr_buf_args.elapsed_us : 0.0);
+	ret = 0;
+
+out:
+	munmap(rbf, st.st_size);
+	return ret;
+}
+
 /*
  * Called to disable Advanced Error Reporting on the PCIe card. Needs to be called before full chip reconfig.
  * Returns 0 on siccess, -1 on failure
@@ -108,6 +178,37 @@ int print_rom(int fd) {
 	return 0;
 }
 
+/*
+ * Prints the PCIe link speed and width, and how the link was recovered after the
+ * last full chip reconfig.
+ * Returns 0 on siccess, -1 on failure
+ */
+int print_link(int fd) {
+
+	static const char *speeds[] = { "unknown", "2.5", "5.0", "8.0", "16.0", "32.0" };
+	link_status_arg_t link_args;
+
+	if (ioctl(fd, FPGA_GET_LINK_STATUS, &link_args) == -1)
+	{
+		printf("Error reading link status. Look at /var/log/messages for more information\n");
+		return -1;
+	}
+
+	if (link_args.speed > 5)
+		link_args.speed = 0;
+	if (link_args.target_speed > 5)
+		link_args.target_speed = 0;
+
+	printf("Link: %s GT/s x%u (capable of %s GT/s x%u)\n",
+	       speeds[link_args.speed], link_args.width,
+	       speeds[link_args.target_speed], link_args.target_width);
+	printf("Last recovery: link up after %llu us, %u retrain(s)\n",
+	       link_args.last_up_us, link_args.last_retrains);
+	printf("Recoveries: %llu, retrains: %llu, failures: %llu\n",
+	       link_args.recoveries, link_args.retrains, link_args.failures);
+	return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -119,9 +220,11 @@ int main(int argc, char *argv[])
 	enum
 	{
 		e_partial_reconfig,
+		e_partial_reconfig_buf,
 		e_disable_aer,
 		e_enable_aer,
-		e_print_rom
+		e_print_rom,
+		e_print_link
 	} option;
 
 	if (strcmp(argv[1], "-p") == 0)
@@ -130,6 +233,12 @@ int main(int argc, char *argv[])
 		rbf_path = argv[2];
 		region_controller_addr = strtoul(argv[3],NULL,16);
 	}
+	else if (strcmp(argv[1], "-b") == 0)
+	{
+		option = e_partial_reconfig_buf;
+		rbf_path = argv[2];
+		region_controller_addr = strtoul(argv[3],NULL,16);
+	}
 	else if (strcmp(argv[1], "-d") == 0)
 	{
 		option = e_disable_aer;
@@ -142,9 +251,13 @@ int main(int argc, char *argv[])
 	{
 		option = e_print_rom;
 	}	
+	else if (strcmp(argv[1], "-l") == 0)
+	{
+		option = e_print_link;
+	}
 	else
 	{
-		fprintf(stderr, "Usage: %s [-p | -d | -e | -r]\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-p | -b | -d | -e | -r | -l]\n", argv[0]);
 		return 1;
 	}
 
@@ -161,6 +274,9 @@ int main(int argc, char *argv[])
 		case e_partial_reconfig:
 			return partial_reconfig(fd, rbf_path, region_controller_addr);
 			break;
+		case e_partial_reconfig_buf:
+			return partial_reconfig_buf(fd, rbf_path, region_controller_addr);
+			break;
 		case e_disable_aer:
 			return disable_aer(fd);
 			break;
@@ -170,6 +286,9 @@ int main(int argc, char *argv[])
 		case e_print_rom:
 			return print_rom(fd);
 			break;
+		case e_print_link:
+			return print_link(fd);
+			break;
 		default:
 			printf("Invalid option\n");
 			break;
@@ -1,6 +1,7 @@
 #ifndef QUERY_IOCTL_H
 #define QUERY_IOCTL_H
 #include <linux/ioctl.h>
+#include <linux/types.h>
  
 
 typedef struct
@@ -10,6 +11,40 @@ typedef struct
 } pr_arg_t;
 
 
+/*
+ * Image in user memory for FPGA_INITIATE_PR_BUF.  buf must be 4 byte aligned;
+ * the driver writes from the user pages directly and returns the time the
+ * load took in elapsed_us.  Fixed width fields and explicit padding keep the
+ * layout the same for 32 and 64 bit userspace.
+ */
+typedef struct
+{
+    __u64 buf;
+    __u64 size;
+    __u32 config_timeout;
+    __u32 pad;
+    __u64 elapsed_us;
+} pr_buf_arg_t;
+
+/*
+ * Link state returned by FPGA_GET_LINK_STATUS.  Speeds use the encoding of
+ * the PCIe Link Status register (1 = 2.5 GT/s ... 5 = 32 GT/s); the recovery
+ * fields describe the retraining done when upstream AER is re-enabled after
+ * a full chip configuration.
+ */
+typedef struct
+{
+    unsigned int speed;
+    unsigned int width;
+    unsigned int target_speed;
+    unsigned int target_width;
+    unsigned long long last_up_us;
+    unsigned int last_retrains;
+    unsigned long long recoveries;
+    unsigned long long retrains;
+    unsigned long long failures;
+} link_status_arg_t;
+
 typedef struct
 {
     int offset;
@@ -29,6 +64,8 @@ typedef struct
 #define FPGA_PR_REGION_CONTROLLER_FREEZE_DISABLE _IOW('q', 6, int *)
 #define FPGA_PR_REGION_READ _IOR('q', 7, rw_arg_t *)
 #define FPGA_PR_REGION_WRITE _IOW('q', 8, rw_arg_t *)
+#define FPGA_INITIATE_PR_BUF _IOWR('q', 9, pr_buf_arg_t *)
+#define FPGA_GET_LINK_STATUS _IOR('q', 10, link_status_arg_t *)
 
 
  
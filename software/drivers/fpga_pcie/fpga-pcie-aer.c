@@ -0,0 +1,153 @@
+/*
+ * Upstream AER quiesce and restore for FPGA cards
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "fpga-pcie-aer.h"
+
+#define FPGA_PCIE_AER_DEVCTL_REPORTING	(PCI_EXP_DEVCTL_CERE | \
+					 PCI_EXP_DEVCTL_NFERE | \
+					 PCI_EXP_DEVCTL_FERE | \
+					 PCI_EXP_DEVCTL_URRE)
+
+#define FPGA_PCIE_AER_DEVSTA_ERRORS	(PCI_EXP_DEVSTA_CED | \
+					 PCI_EXP_DEVSTA_NFED | \
+					 PCI_EXP_DEVSTA_FED | \
+					 PCI_EXP_DEVSTA_URD)
+
+static void fpga_pcie_aer_put(struct fpga_pcie_aer *aer)
+{
+	while (aer->num_ports > 0)
+		pci_dev_put(aer->ports[--aer->num_ports].dev);
+}
+
+/*
+ * Saves the error reporting registers of every bridge between dev and its
+ * root port, then masks the errors a full chip configuration raises and
+ * turns off error reporting on those bridges, so that the link going down
+ * is not escalated to a fatal error and a reset of the hierarchy.
+ */
+int fpga_pcie_aer_quiesce(struct pci_dev *dev, struct fpga_pcie_aer *aer)
+{
+	struct fpga_pcie_aer_port *port;
+	struct pci_dev *bridge;
+	int i;
+
+	if (aer->num_ports) {
+		dev_info(&dev->dev, "Upstream AER already quiesced\n");
+		return 0;
+	}
+
+	for (bridge = pci_upstream_bridge(dev); bridge;
+	     bridge = pci_upstream_bridge(bridge)) {
+		if (aer->num_ports == FPGA_PCIE_AER_MAX_PORTS) {
+			dev_err(&dev->dev, "more than %d bridges to the root port\n",
+				FPGA_PCIE_AER_MAX_PORTS);
+			fpga_pcie_aer_put(aer);
+			return -E2BIG;
+		}
+
+		port = &aer->ports[aer->num_ports++];
+		port->dev = pci_dev_get(bridge);
+		port->aer_pos = pci_find_ext_capability(bridge,
+							PCI_EXT_CAP_ID_ERR);
+		if (port->aer_pos) {
+			pci_read_config_dword(bridge,
+					      port->aer_pos + PCI_ERR_UNCOR_MASK,
+					      &port->uncor_mask);
+			pci_read_config_dword(bridge,
+					      port->aer_pos + PCI_ERR_UNCOR_SEVER,
+					      &port->uncor_sever);
+		}
+		pcie_capability_read_word(bridge, PCI_EXP_DEVCTL,
+					  &port->devctl);
+
+		if (pci_is_pcie(bridge) &&
+		    pci_pcie_type(bridge) == PCI_EXP_TYPE_ROOT_PORT)
+			break;
+	}
+
+	if (!aer->num_ports) {
+		dev_err(&dev->dev, "no upstream bridge\n");
+		return -ENODEV;
+	}
+
+	for (i = 0; i < aer->num_ports; i++) {
+		port = &aer->ports[i];
+
+		if (port->aer_pos)
+			pci_write_config_dword(port->dev,
+					       port->aer_pos + PCI_ERR_UNCOR_MASK,
+					       port->uncor_mask |
+					       FPGA_PCIE_AER_UNCOR_QUIESCE);
+		pcie_capability_clear_word(port->dev, PCI_EXP_DEVCTL,
+					   FPGA_PCIE_AER_DEVCTL_REPORTING);
+
+		dev_info(&dev->dev,
+			 "%s quiesced: uncor mask 0x%08x sever 0x%08x devctl 0x%04x\n",
+			 pci_name(port->dev), port->uncor_mask,
+			 port->uncor_sever, port->devctl);
+	}
+
+	return 0;
+}
+
+/*
+ * Puts back the registers saved by fpga_pcie_aer_quiesce().  The errors
+ * logged while they were masked are cleared first, so they are not reported
+ * once unmasked.  User space config access to the bridges is blocked while
+ * they are restored, so no one sees a partly restored path.
+ */
+void fpga_pcie_aer_restore(struct pci_dev *dev, struct fpga_pcie_aer *aer)
+{
+	struct fpga_pcie_aer_port *port;
+	int i;
+
+	if (!aer->num_ports)
+		return;
+
+	for (i = 0; i < aer->num_ports; i++)
+		pci_cfg_access_lock(aer->ports[i].dev);
+
+	for (i = aer->num_ports - 1; i >= 0; i--) {
+		port = &aer->ports[i];
+
+		if (port->aer_pos) {
+			pci_write_config_dword(port->dev,
+					       port->aer_pos + PCI_ERR_UNCOR_STATUS,
+					       FPGA_PCIE_AER_UNCOR_QUIESCE);
+			pci_write_config_dword(port->dev,
+					       port->aer_pos + PCI_ERR_UNCOR_SEVER,
+					       port->uncor_sever);
+			pci_write_config_dword(port->dev,
+					       port->aer_pos + PCI_ERR_UNCOR_MASK,
+					       port->uncor_mask);
+		}
+		pcie_capability_write_word(port->dev, PCI_EXP_DEVSTA,
+					   FPGA_PCIE_AER_DEVSTA_ERRORS);
+		pcie_capability_write_word(port->dev, PCI_EXP_DEVCTL,
+					   port->devctl);
+
+		dev_info(&dev->dev,
+			 "%s restored: uncor mask 0x%08x sever 0x%08x devctl 0x%04x\n",
+			 pci_name(port->dev), port->uncor_mask,
+			 port->uncor_sever, port->devctl);
+	}
+
+	for (i = aer->num_ports - 1; i >= 0; i--)
+		pci_cfg_access_unlock(aer->ports[i].dev);
+
+	fpga_pcie_aer_put(aer);
+}
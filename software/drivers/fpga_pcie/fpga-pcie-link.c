@@ -0,0 +1,224 @@
+/*
+ * PCIe link recovery for FPGA cards
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "fpga-pcie-link.h"
+#include <linux/delay.h>
+#include <linux/ktime.h>
+
+/* Supported Link Speeds Vector, bit n is set if LNKSTA_CLS n is supported */
+#define FPGA_PCIE_LNKCAP2_SLS			0x000000fe
+
+#ifndef PCI_EXP_LNKSTA_CLS_16_0GB
+#define PCI_EXP_LNKSTA_CLS_16_0GB		0x0004
+#endif
+#ifndef PCI_EXP_LNKSTA_CLS_32_0GB
+#define PCI_EXP_LNKSTA_CLS_32_0GB		0x0005
+#endif
+
+static const char * const fpga_pcie_link_speeds[] = {
+	[PCI_EXP_LNKSTA_CLS_2_5GB] = "2.5",
+	[PCI_EXP_LNKSTA_CLS_5_0GB] = "5.0",
+	[PCI_EXP_LNKSTA_CLS_8_0GB] = "8.0",
+	[PCI_EXP_LNKSTA_CLS_16_0GB] = "16.0",
+	[PCI_EXP_LNKSTA_CLS_32_0GB] = "32.0",
+};
+
+const char *fpga_pcie_link_speed_name(u16 speed)
+{
+	if (speed < ARRAY_SIZE(fpga_pcie_link_speeds) &&
+	    fpga_pcie_link_speeds[speed])
+		return fpga_pcie_link_speeds[speed];
+
+	return "unknown";
+}
+
+/*
+ * Highest speed a port supports.  Gen3 and later ports list every supported
+ * speed in LNKCAP2; older ports only report the maximum in LNKCAP.
+ */
+static u16 fpga_pcie_link_max_speed(struct pci_dev *dev)
+{
+	u32 lnkcap = 0, lnkcap2 = 0;
+
+	pcie_capability_read_dword(dev, PCI_EXP_LNKCAP2, &lnkcap2);
+	lnkcap2 &= FPGA_PCIE_LNKCAP2_SLS;
+	if (lnkcap2)
+		return fls(lnkcap2) - 1;
+
+	pcie_capability_read_dword(dev, PCI_EXP_LNKCAP, &lnkcap);
+
+	return lnkcap & PCI_EXP_LNKCAP_SLS;
+}
+
+static u16 fpga_pcie_link_max_width(struct pci_dev *dev)
+{
+	u32 lnkcap = 0;
+
+	pcie_capability_read_dword(dev, PCI_EXP_LNKCAP, &lnkcap);
+
+	return (lnkcap & PCI_EXP_LNKCAP_MLW) >> 4;
+}
+
+static void fpga_pcie_link_read(struct pci_dev *dev,
+				struct fpga_pcie_link *link)
+{
+	u16 lnksta = 0;
+
+	pcie_capability_read_word(dev, PCI_EXP_LNKSTA, &lnksta);
+
+	/* all ones means the card did not answer, i.e. the link is down */
+	if (lnksta == 0xffff)
+		lnksta = 0;
+
+	link->speed = lnksta & PCI_EXP_LNKSTA_CLS;
+	link->width = (lnksta & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
+}
+
+static bool fpga_pcie_link_at_target(struct fpga_pcie_link *link)
+{
+	return link->speed >= link->target_speed &&
+	       link->width >= link->target_width;
+}
+
+/*
+ * Refresh the target and negotiated speed and width of the link without
+ * retraining it.
+ */
+void fpga_pcie_link_update(struct pci_dev *dev, struct pci_dev *upstream,
+			   struct fpga_pcie_link *link)
+{
+	link->target_speed = min(fpga_pcie_link_max_speed(dev),
+				 fpga_pcie_link_max_speed(upstream));
+	link->target_width = min(fpga_pcie_link_max_width(dev),
+				 fpga_pcie_link_max_width(upstream));
+
+	fpga_pcie_link_read(dev, link);
+}
+
+/*
+ * Wait for the upstream port to finish training.  The first poll is made
+ * after one interval, since LT may not be set yet right after the retrain
+ * request.  Ports that report Data Link Layer Link Active are also waited
+ * on until the link can carry TLPs again.
+ */
+static int fpga_pcie_link_wait(struct pci_dev *upstream, bool dllla)
+{
+	ktime_t start = ktime_get();
+	u16 lnksta;
+	bool expired;
+
+	do {
+		usleep_range(FPGA_PCIE_LINK_POLL_MIN_US,
+			     FPGA_PCIE_LINK_POLL_MAX_US);
+
+		expired = ktime_us_delta(ktime_get(), start) >=
+			  FPGA_PCIE_LINK_TRAIN_TIMEOUT_US;
+
+		pcie_capability_read_word(upstream, PCI_EXP_LNKSTA, &lnksta);
+		if (!(lnksta & PCI_EXP_LNKSTA_LT) &&
+		    (!dllla || (lnksta & PCI_EXP_LNKSTA_DLLLA)))
+			return 0;
+	} while (!expired);
+
+	return -ETIMEDOUT;
+}
+
+/*
+ * Used after full chip configuration, to ensure the link came back at the
+ * fastest speed and width both ends support, retraining it if not.
+ */
+int fpga_pcie_link_recover(struct pci_dev *dev, struct pci_dev *upstream,
+			   struct fpga_pcie_link *link)
+{
+	ktime_t start;
+	u32 lnkcap = 0;
+	u16 lnkctl;
+	bool dllla;
+	int attempt, ret;
+
+	if (!pci_is_pcie(dev) || !upstream || !pci_is_pcie(upstream)) {
+		dev_err(&dev->dev, "Can't find PCI Express capability!\n");
+		return -ENODEV;
+	}
+
+	fpga_pcie_link_update(dev, upstream, link);
+
+	link->recoveries++;
+	link->last_retrains = 0;
+	link->last_up_us = 0;
+
+	if (fpga_pcie_link_at_target(link)) {
+		dev_info(&dev->dev, "Link operating at %s GT/s with %d lanes\n",
+			 fpga_pcie_link_speed_name(link->speed), link->width);
+		return 0;
+	}
+
+	dev_info(&dev->dev,
+		 "Link speed is %s GT/s with %d lanes, expected %s GT/s with %d lanes. Retraining.\n",
+		 fpga_pcie_link_speed_name(link->speed), link->width,
+		 fpga_pcie_link_speed_name(link->target_speed),
+		 link->target_width);
+
+	pcie_capability_read_dword(upstream, PCI_EXP_LNKCAP, &lnkcap);
+	dllla = lnkcap & PCI_EXP_LNKCAP_DLLLARC;
+
+	start = ktime_get();
+
+	for (attempt = 0; attempt < FPGA_PCIE_LINK_RETRIES; attempt++) {
+		if (attempt)
+			usleep_range(FPGA_PCIE_LINK_BACKOFF_US << (attempt - 1),
+				     FPGA_PCIE_LINK_BACKOFF_US << attempt);
+
+		link->last_retrains++;
+		link->retrains++;
+
+		pcie_capability_read_word(upstream, PCI_EXP_LNKCTL, &lnkctl);
+		pcie_capability_write_word(upstream, PCI_EXP_LNKCTL,
+					   lnkctl | PCI_EXP_LNKCTL_RL);
+
+		ret = fpga_pcie_link_wait(upstream, dllla);
+		link->last_up_us = ktime_us_delta(ktime_get(), start);
+		if (ret) {
+			dev_warn(&dev->dev, "Link training timed out (attempt %d)\n",
+				 attempt + 1);
+			continue;
+		}
+
+		fpga_pcie_link_read(dev, link);
+		if (fpga_pcie_link_at_target(link)) {
+			dev_info(&dev->dev,
+				 "Link operating at %s GT/s with %d lanes after %lu us and %u retrain(s)\n",
+				 fpga_pcie_link_speed_name(link->speed),
+				 link->width, link->last_up_us,
+				 link->last_retrains);
+			return 0;
+		}
+
+		dev_info(&dev->dev, "Link trained to %s GT/s with %d lanes (attempt %d)\n",
+			 fpga_pcie_link_speed_name(link->speed), link->width,
+			 attempt + 1);
+	}
+
+	fpga_pcie_link_read(dev, link);
+	link->failures++;
+
+	dev_warn(&dev->dev, "** WARNING: Link training failed.\n");
+	dev_warn(&dev->dev, "Link speed is %s GT/s with %d lanes.\n",
+		 fpga_pcie_link_speed_name(link->speed), link->width);
+
+	return -EIO;
+}
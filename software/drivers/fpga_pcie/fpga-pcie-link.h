@@ -0,0 +1,68 @@
+/*
+ * PCIe link recovery for FPGA cards
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FPGA_PCIE_LINK_H
+#define _FPGA_PCIE_LINK_H
+
+#include <linux/pci.h>
+
+/* Number of times the link is retrained before giving up */
+#define FPGA_PCIE_LINK_RETRIES			3
+
+/* Time allowed for a single retrain to bring the link back up */
+#define FPGA_PCIE_LINK_TRAIN_TIMEOUT_US		100000
+
+/* Interval between link status polls while training */
+#define FPGA_PCIE_LINK_POLL_MIN_US		100
+#define FPGA_PCIE_LINK_POLL_MAX_US		200
+
+/* Pause before the first retry, doubled for each further retry */
+#define FPGA_PCIE_LINK_BACKOFF_US		1000
+
+/**
+ * struct fpga_pcie_link - link state and recovery statistics of a card
+ * @target_speed: fastest speed supported by both ends, as PCI_EXP_LNKSTA_CLS
+ * @target_width: widest width supported by both ends
+ * @speed: negotiated speed, as PCI_EXP_LNKSTA_CLS
+ * @width: negotiated width
+ * @last_up_us: time from the first retrain of the last recovery to link up,
+ *              0 if that recovery did not need to retrain
+ * @last_retrains: retrains issued by the last recovery
+ * @recoveries: number of recoveries
+ * @retrains: retrains issued by all recoveries
+ * @failures: recoveries that did not reach the target speed and width
+ */
+struct fpga_pcie_link {
+	u16 target_speed;
+	u16 target_width;
+	u16 speed;
+	u16 width;
+	unsigned long last_up_us;
+	unsigned int last_retrains;
+	unsigned long recoveries;
+	unsigned long retrains;
+	unsigned long failures;
+};
+
+const char *fpga_pcie_link_speed_name(u16 speed);
+
+void fpga_pcie_link_update(struct pci_dev *dev, struct pci_dev *upstream,
+			   struct fpga_pcie_link *link);
+int fpga_pcie_link_recover(struct pci_dev *dev, struct pci_dev *upstream,
+			   struct fpga_pcie_link *link);
+
+#endif /* _FPGA_PCIE_LINK_H */
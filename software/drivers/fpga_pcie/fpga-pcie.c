@@ -33,6 +33,11 @@
 
 #include <linux/firmware.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/time.h>
+#include <linux/vmalloc.h>
 
 #include "fpga-ioctl.h"
 
@@ -85,63 +90,6 @@ struct fpga_drv_entry {
 	int (*remove)(struct device *dev);
 };
 
-static u32 get_aer_uerr_mask_reg(struct pci_dev *dev)
-{
-	u32 reg = 0;
-	int pos;
-
-	pos = pci_find_ext_capability(dev, PCI_EXT_CAP_ID_ERR);
-
-	if (!pos) {
-		dev_err(&dev->dev, "failed to find AER extended capability\n");
-		return -EIO;
-	}
-
-	pci_read_config_dword(dev, pos+PCI_EXP_DEVCAP, &reg);
-
-	pci_read_config_dword(dev, pos+PCI_EXP_DEVCTL, &reg);
-
-	return reg;
-}
-
-static void set_aer_uerr_mask_reg(struct pci_dev *dev, u32 val)
-{
-	int pos;
-
-	pos = pci_find_ext_capability(dev, PCI_EXT_CAP_ID_ERR);
-
-	if (!pos) {
-		dev_err(&dev->dev, "failed to find AER extended capability\n");
-		return;
-	}
-
-
-	pci_write_config_dword(dev, pos+PCI_EXP_DEVCAP, PCI_ERR_UNC_SURPDN | PCI_ERR_UNC_COMP_TIME | PCI_ERR_UNC_UNSUP);
-
-	pci_write_config_dword(dev, pos+PCI_EXP_DEVCTL, val);
-}
-
-static u32 disable_upstream_aer(struct pci_dev *dev,
-				struct pci_dev *upstream_dev)
-{
-	u32 reg = 0;
-
-	if (dev == NULL) {
-		pr_err("%s NULL dev\n", __func__);
-		return -EINVAL;
-	} else if (upstream_dev == NULL) {
-		
-		dev_err(&dev->dev, "%s NULL upstream_dev\n", __func__);
-		return -EINVAL;
-	}
-
-	reg = get_aer_uerr_mask_reg(upstream_dev);
-
-	set_aer_uerr_mask_reg(upstream_dev, reg | PCI_ERR_UNC_SURPDN | PCI_ERR_UNC_COMP_TIME | PCI_ERR_UNC_UNSUP);
-
-	return reg;
-}
-
 static void fpga_pcie_print_rom(struct fpga_pcie_priv *priv)
 {
 	struct pci_dev *dev = priv->pci_dev;
@@ -156,117 +104,6 @@ static void fpga_pcie_print_rom(struct fpga_pcie_priv *priv)
 	}
 }
 
-/*
- * USed for after full chip configuration, to ensure the correct speed is reported, and if not,
- * re initialize
- */
-static void retrain_device_speed(struct pci_dev *dev, struct pci_dev *upstream)
-{
-	u16 linkstat, speed, width;
-	int pos, upos;
-	u16 status_reg, control_reg, link_cap_reg;
-	u16 status, control;
-	u32 link_cap;
-	int training, timeout;
-
-	pos = pci_find_capability(dev, PCI_CAP_ID_EXP);
-
-	if (!pos) {
-		dev_err(&dev->dev, "Can't find PCI Express capability!\n");
-		return;
-	}
-
-	upos = pci_find_capability(upstream, PCI_CAP_ID_EXP);
-	status_reg = upos + PCI_EXP_LNKSTA;
-	control_reg = upos + PCI_EXP_LNKCTL;
-	link_cap_reg = upos + PCI_EXP_LNKCAP;
-	pci_read_config_word(upstream, status_reg, &status);
-	pci_read_config_word(upstream, control_reg, &control);
-	pci_read_config_dword(upstream, link_cap_reg, &link_cap);
-	
-	
-	pci_read_config_word(dev, pos + PCI_EXP_LNKSTA, &linkstat);
-	pci_read_config_dword(upstream, link_cap_reg, &link_cap);
-	speed = linkstat & PCI_EXP_LNKSTA_CLS;
-	width = (linkstat & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-	
-	if (speed == PCI_EXP_LNKSTA_CLS_2_5GB) {
-		dev_info(&dev->dev, "Link speed is 2.5 GT/s with %d lanes.\n",
-			 width);
-		dev_info(&dev->dev, "Need to retrain.");
-	} else if (speed == PCI_EXP_LNKSTA_CLS_5_0GB) {
-		dev_info(&dev->dev, "Link speed is 5.0 GT/s with %d lanes.\n",
-			 width);
-		if (width == DEV_LINK_WIDTH) {
-			dev_info(&dev->dev, "  All is good!\n");
-			return;
-		} else {
-			dev_info(&dev->dev, "  Need to retrain.\n");
-		}
-	} else if (speed == PCI_EXP_LNKSTA_CLS_8_0GB) {
-		dev_info(&dev->dev, "Link speed is 8.0 GT/s with %d lanes.\n",
-			 width);
-		if (width == DEV_LINK_WIDTH) {
-			dev_info(&dev->dev, "  All is good!\n");
-			return;
-		} else {
-			dev_info(&dev->dev, "  Need to retrain.\n");
-		}
-	} else {
-		dev_warn(&dev->dev, "Not sure what's going on. Retraining.\n");
-	}
-	
-		  
-	/* Perform the training. */
-	training = 1;
-	timeout = 0;
-	pci_read_config_word(upstream, control_reg, &control);
-	pci_write_config_word(upstream, control_reg,
-			      control | PCI_EXP_LNKCTL_RL);
-	
-	while (training && timeout < 50)
-	{
-		pci_read_config_word (upstream, status_reg, &status);
-		training = (status & PCI_EXP_LNKSTA_LT);
-		msleep (1); /* 1 ms */
-		++timeout;
-	}
-	if(training)
-	{
-		 dev_info(&dev->dev, "Error: Link training timed out.\n");
-		 dev_info(&dev->dev, "PCIe link not established.\n");
-	}
-	else
-	{
-		 dev_info(&dev->dev, "Link training completed in %d ms.\n",
-			  timeout);
-	}
-	 
-
-	/* Verify that it's a 8 GT/s link now */
-	pci_read_config_word(dev, pos + PCI_EXP_LNKSTA, &linkstat);
-	pci_read_config_dword(upstream, link_cap_reg, &link_cap);
-	speed = linkstat & PCI_EXP_LNKSTA_CLS;
-	width = (linkstat & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-	
-	if(speed == PCI_EXP_LNKSTA_CLS_8_0GB)
-	{
-		dev_info(&dev->dev, "Link operating at 8 GT/s with %d lanes\n",
-			 width);
-	}
-	else if(speed == PCI_EXP_LNKSTA_CLS_5_0GB)
-	{
-		dev_info(&dev->dev, "Link operating at 5 GT/s with %d lanes\n",
-			 width);
-	}
-	else
-	{
-		dev_warn(&dev->dev, "** WARNING: Link training failed.\n");
-		dev_warn(&dev->dev, "Link speed is 2.5 GT/s with %d lanes.\n",
-			 width);
-	}
-}
-
 static void fpga_pcie_shutdown_pci(struct pci_dev *dev,
 				   struct fpga_pcie_priv *priv)
 {
@@ -288,7 +125,6 @@ static int fpga_pcie_setup_pci(struct pci_dev *dev, struct fpga_pcie_priv *priv)
 	static const const char *bar_fmt =
 		"BAR[%d] 0x%08lx-0x%08lx (%lu bytes) flags 0x%08lx\n";
 	int i, err;
-	int pos = 0;
 
 
 	pci_set_drvdata(dev, priv);
@@ -313,38 +149,14 @@ static int fpga_pcie_setup_pci(struct pci_dev *dev, struct fpga_pcie_priv *priv)
 	/* Make sure that the card is set as a bus master. */
 	pci_set_master(dev);
 
-	/* Get some info on the PCI Express (PCI_CAP_ID_EXP) capabilities */
-	pos = pci_find_capability(dev, PCI_CAP_ID_EXP);
-
-	/* Read the link status */
-	if (pos) {
-		unsigned short linkstat = 0;
-		int link_speed = 0;
-		int link_width = 0;
-
-		pci_read_config_word(dev, pos + PCI_EXP_LNKSTA, &linkstat);
-
-		link_speed = linkstat & PCI_EXP_LNKSTA_CLS;
-		link_width =
-		    (linkstat & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-
-		if (link_speed == PCI_EXP_LNKSTA_CLS_2_5GB) {
-			dev_info(
-			    &dev->dev,
-			    "Link speed is 2.5 GT/s with %d lanes.\n",
-			    link_width);
-		} else if (link_speed == PCI_EXP_LNKSTA_CLS_5_0GB) {
-			dev_info(
-			    &dev->dev,
-			    "Link speed is 5.0 GT/s with %d lanes.\n",
-			    link_width);
-		} else if (link_speed == PCI_EXP_LNKSTA_CLS_8_0GB) {
-			dev_info(
-			    &dev->dev,
-			    "Link speed is 8.0 GT/s with %d lanes.\n",
-			    link_width);
-		}
-	}
+	/* Read the link status, and what it should be, to report it */
+	fpga_pcie_link_update(dev, priv->pci_upstream_dev, &priv->link);
+
+	dev_info(&dev->dev,
+		 "Link speed is %s GT/s with %d lanes (capable of %s GT/s with %d lanes).\n",
+		 fpga_pcie_link_speed_name(priv->link.speed), priv->link.width,
+		 fpga_pcie_link_speed_name(priv->link.target_speed),
+		 priv->link.target_width);
 
 	if (pci_request_regions(dev, DRIVER_NAME)) {
 		dev_err(&dev->dev, "Failed to request regions");
@@ -469,6 +281,98 @@ int fpga_config_buf_load(struct fpga_pcie_priv *priv, int config_timeout, struct
 
 
 
+/*
+ * Load an image straight from user memory: the user pages are pinned and
+ * mapped into one contiguous kernel range, so the image is written to the PR
+ * IP without being copied.  On success *elapsed_us holds the time the whole
+ * load took.
+ */
+static int fpga_config_user_load(struct fpga_pcie_priv *priv,
+				 int config_timeout, u64 start, u64 count,
+				 u64 *elapsed_us)
+{
+	struct device *dev = &(priv->pci_dev->dev);
+	unsigned long nr_pages;
+	struct page **pages;
+	ktime_t start_time;
+	int pinned = 0, i;
+	void *vaddr;
+	char *buf;
+	int ret;
+
+	/*
+	 * Both come straight from userspace: bound the image before sizing the
+	 * page array from it, and refuse addresses that do not fit this kernel.
+	 */
+	if (!count || count > MAX_RW_COUNT || start != (unsigned long)start ||
+	    !IS_ALIGNED(start, sizeof(u32)))
+		return -EINVAL;
+
+	nr_pages = DIV_ROUND_UP(offset_in_page(start) + count, PAGE_SIZE);
+	if (nr_pages > INT_MAX || start + count < start)
+		return -EINVAL;
+
+	start_time = ktime_get();
+
+	pages = vmalloc_node(nr_pages * sizeof(*pages), dev_to_node(dev));
+	if (!pages)
+		return -ENOMEM;
+
+	pinned = get_user_pages_fast(start & PAGE_MASK, nr_pages, 0, pages);
+	if (pinned != nr_pages) {
+		dev_err(dev, "Could only pin %d of %lu pages\n", pinned,
+			nr_pages);
+		ret = pinned < 0 ? pinned : -EFAULT;
+		goto err_put_pages;
+	}
+
+	vaddr = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL_RO);
+	if (!vaddr) {
+		ret = -ENOMEM;
+		goto err_put_pages;
+	}
+	buf = vaddr + offset_in_page(start);
+
+	priv->config_state = FPGA_CONFIG_STATE_WRITE_INIT;
+	ret = alt_pr_ip_write_init(priv, buf, count);
+	if (ret) {
+		dev_err(dev, "Error preparing FPGA for writing\n");
+		priv->config_state = FPGA_CONFIG_STATE_WRITE_INIT_ERR;
+		goto err_unmap;
+	}
+
+	priv->config_state = FPGA_CONFIG_STATE_WRITE;
+	ret = alt_pr_ip_fpga_write_buf(priv, buf, count);
+	if (ret) {
+		dev_err(dev, "Error while writing image data to FPGA\n");
+		priv->config_state = FPGA_CONFIG_STATE_WRITE_ERR;
+		goto err_unmap;
+	}
+
+	priv->config_state = FPGA_CONFIG_STATE_WRITE_COMPLETE;
+	ret = alt_pr_ip_fpga_write_complete(priv, config_timeout);
+	if (ret) {
+		dev_err(dev, "Error after writing image data to FPGA\n");
+		priv->config_state = FPGA_CONFIG_STATE_WRITE_COMPLETE_ERR;
+		goto err_unmap;
+	}
+	priv->config_state = FPGA_CONFIG_STATE_OPERATING;
+
+	*elapsed_us = ktime_us_delta(ktime_get(), start_time);
+
+	dev_info(dev, "Wrote %llu bytes from user pages in %llu us (%llu MB/s)\n",
+		 count, *elapsed_us, div64_u64(count, max(*elapsed_us, 1ULL)));
+
+err_unmap:
+	vunmap(vaddr);
+err_put_pages:
+	for (i = 0; i < pinned; i++)
+		put_page(pages[i]);
+	vfree(pages);
+
+	return ret;
+}
+
 /*
  * All user mode interactions with driver pass through this ioctl function.
  * User mode program will pass commands to this function in order to active specifc subroutines.
@@ -483,6 +387,9 @@ static long my_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 {
 
 	pr_arg_t pr_args;
+	pr_buf_arg_t pr_buf_args;
+	link_status_arg_t link_args;
+	u64 elapsed_us;
 	struct fpga_pcie_priv *priv = (struct fpga_pcie_priv *)f->private_data;
 	struct device *dev = &(priv->pci_dev->dev);
 	int offset, data;
@@ -501,12 +408,10 @@ static long my_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 				dev_info(dev, "Upstream AER already disabled\n");
 			}
 			else {		
-				priv->aer_uerr_mask_reg = 
-					disable_upstream_aer(priv->pci_dev,
-						     priv->pci_upstream_dev);
-
-				dev_info(dev, "%s aer is %x\n", __func__,
-					 priv->aer_uerr_mask_reg);
+				result = fpga_pcie_aer_quiesce(priv->pci_dev,
+							       &priv->aer);
+				if (result)
+					return result;
 
 				pci_save_state(priv->pci_dev);
 
@@ -518,17 +423,13 @@ static long my_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 			dev_info(dev, "Preparing to enable upstream AER\n");
 			if (priv->state == ST_AER_DISABLED) {
 				pci_restore_state(priv->pci_dev);
-				dev_info(dev, "%s setting aer to %x\n",
-					 __func__, priv->aer_uerr_mask_reg);
-
-				set_aer_uerr_mask_reg(priv->pci_upstream_dev,
-						      priv->aer_uerr_mask_reg);
 
-				/*
-				 * USed for after full chip configuration, to ensure the correct speed is reported, and if not,
-				 * re initialize
-				 */
-				retrain_device_speed(priv->pci_dev, priv->pci_upstream_dev);
+				/* retrain before unmasking so link flaps are not reported */
+				fpga_pcie_link_recover(priv->pci_dev,
+						       priv->pci_upstream_dev,
+						       &priv->link);
+				fpga_pcie_aer_restore(priv->pci_dev,
+						      &priv->aer);
 				priv->state = ST_IDLE;
 			} else if (priv->state == ST_IDLE) {
 				dev_info(dev, "PR subsystem already idle\n");
@@ -559,7 +460,54 @@ static long my_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 
 			break;
 
+		case FPGA_INITIATE_PR_BUF:
+			dev_info(dev, "Preparing to initiate PR from user buffer\n");
 
+			if (copy_from_user(&pr_buf_args, (pr_buf_arg_t *)arg,
+					   sizeof(pr_buf_arg_t)))
+			{
+				return -EACCES;
+			}
+
+			result = fpga_config_user_load(priv,
+						       pr_buf_args.config_timeout,
+						       pr_buf_args.buf,
+						       pr_buf_args.size,
+						       &elapsed_us);
+			if (result)
+				break;
+
+			pr_buf_args.elapsed_us = elapsed_us;
+			if (copy_to_user((pr_buf_arg_t *)arg, &pr_buf_args,
+					 sizeof(pr_buf_arg_t)))
+			{
+				return -EACCES;
+			}
+
+			break;
+
+		case FPGA_GET_LINK_STATUS:
+			fpga_pcie_link_update(priv->pci_dev,
+					      priv->pci_upstream_dev,
+					      &priv->link);
+
+			link_args.speed = priv->link.speed;
+			link_args.width = priv->link.width;
+			link_args.target_speed = priv->link.target_speed;
+			link_args.target_width = priv->link.target_width;
+			link_args.last_up_us = priv->link.last_up_us;
+			link_args.last_retrains = priv->link.last_retrains;
+			link_args.recoveries = priv->link.recoveries;
+			link_args.retrains = priv->link.retrains;
+			link_args.failures = priv->link.failures;
+
+			if (copy_to_user((link_status_arg_t *)arg, &link_args,
+					 sizeof(link_status_arg_t)))
+			{
+				return -EACCES;
+			}
+
+			break;
 
 		case FPGA_PR_REGION_CONTROLLER_FREEZE_ENABLE:
 			dev_info(dev, "Preparing to freeze PR region\n");
@@ -762,6 +710,7 @@ static void fpga_pcie_remove(struct pci_dev *dev)
 
 	dev_info(&dev->dev, "%s\n", __func__);
 
+	fpga_pcie_aer_restore(dev, &priv->aer);
 
 	fpga_pcie_shutdown_pci(dev, priv);
 
@@ -16,6 +16,8 @@
 
  
 #include "fpga-ioctl.h"
+#include "fpga-pcie-aer.h"
+#include "fpga-pcie-link.h"
 
 /* Shorthand PCIe properties */
 #define ALTR_PCI_CVP_NUM_BARS (PCI_STD_RESOURCE_END+1)
@@ -35,8 +37,6 @@
 #define ALTR_PCI_CVP_SUB_VENDOR_ID 0x1172
 #define ALTR_PCI_CVP_SUB_DEVICE_ID 0x0001
 
-#define DEV_LINK_WIDTH 8
-
 enum fpga_config_states {
 	/* default FPGA states */
 	FPGA_CONFIG_STATE_UNKNOWN,
@@ -65,7 +65,7 @@ struct fpga_pcie_priv {
 	struct dentry *debugfs_root;
 	struct pci_dev *pci_dev;
 	struct pci_dev *pci_upstream_dev;
-	u32 aer_uerr_mask_reg;
+	struct fpga_pcie_aer aer;
 	const char *state;
 	enum fpga_config_states config_state;
 	struct uio_info uio_info;
@@ -74,5 +74,6 @@ struct fpga_pcie_priv {
 	struct cdev cdev;
 	void __iomem *reg_base;
 	struct device *my_device;
+	struct fpga_pcie_link link;
 	
 };